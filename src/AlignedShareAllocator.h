@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_ALIGNEDSHAREALLOCATOR_H
+#define SHAREMIND_PDKHEADERS_ALIGNEDSHAREALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <sys/mman.h>
+#include <type_traits>
+
+
+namespace sharemind {
+
+/**
+ * \brief Run-time configuration of AlignedShareAllocator.
+ */
+struct __attribute__ ((visibility("internal"))) AlignedShareStorage {
+
+    /** Size and alignment of transparent huge pages. */
+    static constexpr std::size_t hugePageSize = 2u * 1024u * 1024u;
+
+    /**
+     * \returns the allocation size in bytes starting from which storage is
+     *          backed by transparent huge pages, zero disables huge pages.
+     */
+    static std::size_t hugePageThreshold() noexcept
+    { return thresholdRef().load(std::memory_order_relaxed); }
+
+    static void setHugePageThreshold(std::size_t const bytes) noexcept
+    { thresholdRef().store(bytes, std::memory_order_relaxed); }
+
+private: /* Methods: */
+
+    static std::atomic<std::size_t> & thresholdRef() noexcept {
+        static std::atomic<std::size_t> threshold(32u * 1024u * 1024u);
+        return threshold;
+    }
+
+}; /* struct AlignedShareStorage { */
+
+/**
+ * \brief Allocator for SIMD friendly share storage.
+ * Every allocation is aligned to \a Alignment bytes and its size is rounded
+ * up to a multiple of \a Alignment, hence vectorized kernels may access whole
+ * SIMD registers past the last element without faulting. Allocations of at
+ * least AlignedShareStorage::hugePageThreshold() bytes are aligned to huge
+ * pages and advised to be backed by transparent huge pages.
+ *
+ * The allocator is selected either explicitly as the second template
+ * argument of ShareVec or for all vectors of a type by defining
+ * \a share_allocator in the value type, see ValueTraits.
+ */
+template <typename T, std::size_t Alignment = 64u>
+class __attribute__ ((visibility("internal"))) AlignedShareAllocator {
+
+    static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1u)) == 0u,
+                  "Alignment must be a power of two not less than alignof(T).");
+
+public: /* Types: */
+
+    using value_type = T;
+    using is_always_equal = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    template <typename U>
+    struct rebind { using other = AlignedShareAllocator<U, Alignment>; };
+
+    static constexpr std::size_t alignment = Alignment;
+
+public: /* Methods: */
+
+    AlignedShareAllocator() noexcept {}
+
+    template <typename U>
+    AlignedShareAllocator(const AlignedShareAllocator<U, Alignment> &) noexcept {}
+
+    T * allocate(std::size_t const n) {
+        if (n > (std::numeric_limits<std::size_t>::max() - Alignment) / sizeof(T))
+            throw std::bad_alloc();
+
+        std::size_t bytes = paddedSize(n);
+        std::size_t const threshold = AlignedShareStorage::hugePageThreshold();
+        void * mem;
+        if (threshold != 0u && bytes >= threshold) {
+            std::size_t const hugeSize = AlignedShareStorage::hugePageSize;
+            bytes = (bytes + (hugeSize - 1u)) & ~(hugeSize - 1u);
+            if (posix_memalign(&mem, hugeSize, bytes) != 0)
+                throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+            madvise(mem, bytes, MADV_HUGEPAGE);
+#endif
+        } else if (posix_memalign(&mem, Alignment, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+
+        return static_cast<T *>(mem);
+    }
+
+    void deallocate(T * const ptr, std::size_t) noexcept { std::free(ptr); }
+
+    /** \returns the number of bytes actually reserved for \a n elements. */
+    static std::size_t paddedSize(std::size_t const n) noexcept
+    { return (n * sizeof(T) + (Alignment - 1u)) & ~(Alignment - 1u); }
+
+    template <typename U>
+    friend bool operator==(const AlignedShareAllocator &,
+                           const AlignedShareAllocator<U, Alignment> &) noexcept
+    { return true; }
+
+    template <typename U>
+    friend bool operator!=(const AlignedShareAllocator &,
+                           const AlignedShareAllocator<U, Alignment> &) noexcept
+    { return false; }
+
+}; /* class AlignedShareAllocator { */
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_ALIGNEDSHAREALLOCATOR_H */
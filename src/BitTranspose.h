@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_BITTRANSPOSE_H
+#define SHAREMIND_PDKHEADERS_BITTRANSPOSE_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include "ShareVecKernels.h"
+#include "ShareVector.h"
+#include "ValueTraits.h"
+
+
+/**
+ * Conversion between element-major share vectors and bit-major (bit-sliced)
+ * bit share vectors. In the bit-major layout of n elements of w bits, bit j
+ * of element k is stored at index j * n + k, i.e. the bit share vector is
+ * the concatenation of w slices of n bits.
+ */
+
+namespace sharemind {
+namespace detail {
+
+#define SHAREMIND_PDKHEADERS_TRANSPOSE_INLINE inline __attribute__ ((always_inline))
+
+/**
+ * Transposes a 64x64 bit matrix in place, bit c of row r is swapped with
+ * bit r of row c. Every stage swaps off-diagonal blocks of half the size of
+ * the previous stage with data parallel shifts and masks over rows.
+ */
+SHAREMIND_PDKHEADERS_TRANSPOSE_INLINE
+void transpose64x64Inline(std::uint64_t * const rows) noexcept {
+    std::uint64_t mask = 0x00000000ffffffffu;
+    for (unsigned width = 32u; width != 0u; width >>= 1u, mask ^= mask << width) {
+        for (unsigned base = 0u; base < 64u; base += 2u * width) {
+            for (unsigned k = base; k < base + width; ++k) {
+                std::uint64_t const t = ((rows[k] >> width) ^ rows[k + width]) & mask;
+                rows[k] ^= t << width;
+                rows[k + width] ^= t;
+            }
+        }
+    }
+}
+
+/* Reads 64 bits from position pos of a block array, bits past limit are 0. */
+SHAREMIND_PDKHEADERS_TRANSPOSE_INLINE
+std::uint64_t readBits(const std::uint64_t * const blocks,
+                       std::size_t const pos,
+                       std::size_t const count) noexcept
+{
+    std::size_t const block = pos / 64u;
+    unsigned const shift = pos % 64u;
+    std::uint64_t r = blocks[block] >> shift;
+    if (shift != 0u && shift + count > 64u)
+        r |= blocks[block + 1u] << (64u - shift);
+    return count == 64u ? r : (r & ((std::uint64_t(1u) << count) - 1u));
+}
+
+/* Writes the low count bits of word to position pos of a block array. */
+SHAREMIND_PDKHEADERS_TRANSPOSE_INLINE
+void writeBits(std::uint64_t * const blocks,
+               std::size_t const pos,
+               std::uint64_t word,
+               std::size_t const count) noexcept
+{
+    std::size_t const block = pos / 64u;
+    unsigned const shift = pos % 64u;
+    std::uint64_t const mask = count == 64u
+                             ? ~std::uint64_t(0u)
+                             : ((std::uint64_t(1u) << count) - 1u);
+    word &= mask;
+    if (shift == 0u && count == 64u) {
+        blocks[block] = word;
+        return;
+    }
+    blocks[block] = (blocks[block] & ~(mask << shift)) | (word << shift);
+    if (shift != 0u && shift + count > 64u) {
+        blocks[block + 1u] = (blocks[block + 1u] & ~(mask >> (64u - shift)))
+                           | (word >> (64u - shift));
+    }
+}
+
+template <typename S>
+SHAREMIND_PDKHEADERS_TRANSPOSE_INLINE
+void decomposeLoop(std::uint64_t * const out,
+                   const S * const in,
+                   std::size_t const n,
+                   std::size_t const bits) noexcept
+{
+    std::uint64_t rows[64u];
+    for (std::size_t k = 0u; k < n; k += 64u) {
+        std::size_t const count = (n - k < 64u) ? (n - k) : 64u;
+        for (std::size_t i = 0u; i < count; ++i)
+            rows[i] = static_cast<std::uint64_t>(in[k + i]);
+        for (std::size_t i = count; i < 64u; ++i)
+            rows[i] = 0u;
+        transpose64x64Inline(rows);
+        for (std::size_t j = 0u; j < bits; ++j)
+            writeBits(out, j * n + k, rows[j], count);
+    }
+}
+
+template <typename S>
+SHAREMIND_PDKHEADERS_TRANSPOSE_INLINE
+void composeLoop(S * const out,
+                 const std::uint64_t * const in,
+                 std::size_t const n,
+                 std::size_t const bits) noexcept
+{
+    std::uint64_t rows[64u];
+    for (std::size_t k = 0u; k < n; k += 64u) {
+        std::size_t const count = (n - k < 64u) ? (n - k) : 64u;
+        for (std::size_t j = 0u; j < bits; ++j)
+            rows[j] = readBits(in, j * n + k, count);
+        for (std::size_t j = bits; j < 64u; ++j)
+            rows[j] = 0u;
+        transpose64x64Inline(rows);
+        for (std::size_t i = 0u; i < count; ++i)
+            out[k + i] = static_cast<S>(rows[i]);
+    }
+}
+
+#define SHAREMIND_PDKHEADERS_TRANSPOSE_VARIANT(name, target) \
+    template <typename S> \
+    SHAREMIND_PDKHEADERS_KERNELS_TARGET(target) \
+    void decompose ## name(std::uint64_t * out, const S * in, std::size_t n, std::size_t bits) \
+    { decomposeLoop(out, in, n, bits); } \
+    template <typename S> \
+    SHAREMIND_PDKHEADERS_KERNELS_TARGET(target) \
+    void compose ## name(S * out, const std::uint64_t * in, std::size_t n, std::size_t bits) \
+    { composeLoop(out, in, n, bits); }
+
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+SHAREMIND_PDKHEADERS_TRANSPOSE_VARIANT(Avx2, "avx2")
+SHAREMIND_PDKHEADERS_TRANSPOSE_VARIANT(Avx512, "avx512f,avx512bw")
+#endif
+
+template <typename S>
+void decomposeGeneric(std::uint64_t * out, const S * in, std::size_t n, std::size_t bits)
+{ decomposeLoop(out, in, n, bits); }
+
+template <typename S>
+void composeGeneric(S * out, const std::uint64_t * in, std::size_t n, std::size_t bits)
+{ composeLoop(out, in, n, bits); }
+
+#undef SHAREMIND_PDKHEADERS_TRANSPOSE_VARIANT
+#undef SHAREMIND_PDKHEADERS_TRANSPOSE_INLINE
+
+template <typename S>
+inline void decomposeBits(std::uint64_t * out, const S * in, std::size_t n, std::size_t bits) {
+    using Kernel = void (*)(std::uint64_t *, const S *, std::size_t, std::size_t);
+    static Kernel const kernel = [] () -> Kernel {
+        switch (kernels::selectedIsa()) {
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+        case kernels::Isa::Avx512: return &decomposeAvx512<S>;
+        case kernels::Isa::Avx2: return &decomposeAvx2<S>;
+#endif
+        default: return &decomposeGeneric<S>;
+        }
+    }();
+    kernel(out, in, n, bits);
+}
+
+template <typename S>
+inline void composeBits(S * out, const std::uint64_t * in, std::size_t n, std::size_t bits) {
+    using Kernel = void (*)(S *, const std::uint64_t *, std::size_t, std::size_t);
+    static Kernel const kernel = [] () -> Kernel {
+        switch (kernels::selectedIsa()) {
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+        case kernels::Isa::Avx512: return &composeAvx512<S>;
+        case kernels::Isa::Avx2: return &composeAvx2<S>;
+#endif
+        default: return &composeGeneric<S>;
+        }
+    }();
+    kernel(out, in, n, bits);
+}
+
+} /* namespace detail { */
+
+/**
+ * Transposes a 64x64 bit matrix given as 64 rows in place.
+ */
+inline void transpose64x64(std::uint64_t * const rows) noexcept
+{ detail::transpose64x64Inline(rows); }
+
+/**
+ * Converts element-major shares to the bit-major layout.
+ * \param[out] out Resized to in.size () * num_of_bits bits.
+ * \param[in] in Input shares, bits above num_of_bits are ignored.
+ */
+template <typename T, typename Allocator, typename BitShareType>
+void bitDecompose(BitShareVec<BitShareType> & out, const ShareVec<T, Allocator> & in) {
+    static_assert(ValueTraits<T>::num_of_bits <= 64u, "Too many bits.");
+    constexpr std::size_t bits = ValueTraits<T>::num_of_bits;
+    out.resize_uninitialized(in.size() * bits);
+    if (in.empty())
+        return;
+    detail::decomposeBits(out.blocks(), in.data(), in.size(), bits);
+    out.clear_unused_bits();
+}
+
+/**
+ * Converts shares in the bit-major layout to element-major shares.
+ * \param[out] out Resized to in.size () / num_of_bits elements.
+ * \param[in] in Bit-major shares of a multiple of num_of_bits bits.
+ */
+template <typename T, typename Allocator, typename BitShareType>
+void bitCompose(ShareVec<T, Allocator> & out, const BitShareVec<BitShareType> & in) {
+    static_assert(ValueTraits<T>::num_of_bits <= 64u, "Too many bits.");
+    constexpr std::size_t bits = ValueTraits<T>::num_of_bits;
+    assert(in.size() % bits == 0u && "Bit vector does not hold whole elements.");
+    std::size_t const n = in.size() / bits;
+    out.resize_uninitialized(n);
+    if (n == 0u)
+        return;
+    detail::composeBits(out.data(), in.blocks(), n, bits);
+}
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_BITTRANSPOSE_H */
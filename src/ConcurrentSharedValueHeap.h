@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_CONCURRENTSHAREDVALUEHEAP_H
+#define SHAREMIND_PDKHEADERS_CONCURRENTSHAREDVALUEHEAP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ShareVector.h"
+#include "ValueTraits.h"
+
+
+namespace sharemind {
+
+/**
+ * \brief Heap of share vectors that may be used from several threads.
+ * Like SharedValueHeap the vectors are stored in a generational slot map and
+ * referred to by handles encoding the slot index and generation. The slots
+ * are kept in segments of doubling size which never move, and the
+ * generation, liveness and type of a slot are kept in a single atomic word,
+ * hence check() and get() are wait-free. Freed slots are kept in several
+ * free lists, each behind its own lock, which inserting threads pick by
+ * their thread identifier. On targets with pointers narrower than 64 bits
+ * there is no room for tagged handles, the handles are then the addresses
+ * of the vectors and are looked up in hash maps, each behind its own lock,
+ * so check() and get() lock too.
+ *
+ * As in SharedValueHeap, handles are checked and erased by the heap_type_id
+ * of the vector only, whereas get() and check_exact() require the exact
+ * ShareVec type including its allocator.
+ *
+ * A vector must not be erased while another thread is using it.
+ */
+class __attribute__ ((visibility("internal"))) ConcurrentSharedValueHeap {
+
+private: /* Types: */
+
+    struct Slot {
+        /** Bits 0-23 type id, 24-31 heap_type_id, bit 32 live, bits 33-63 generation. */
+        std::atomic<uint64_t> state;
+        std::atomic<ShareVecBase *> vec;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<uint32_t> freeSlots;
+    };
+
+    /* Vectors by address, for targets without tagged handles: */
+    struct AddressShard {
+        std::mutex mutex;
+        std::unordered_map<const ShareVecBase *, uint32_t> indices;
+    };
+
+    /* Whether a pointer can hold the slot index and generation of a tagged handle: */
+    static constexpr bool taggedHandles = sizeof (uintptr_t) >= sizeof (uint64_t);
+
+    static constexpr unsigned firstSegmentLog = 10u;
+    static constexpr unsigned numSegments = 32u - firstSegmentLog;
+    static constexpr std::size_t numShards = 16u;
+    static constexpr std::size_t numAddressShards = taggedHandles ? 1u : numShards;
+    static constexpr uint64_t liveBit = uint64_t (1u) << 32u;
+    static constexpr unsigned heapTypeShift = 24u;
+    static constexpr uint32_t typeMask = (uint32_t (1u) << heapTypeShift) - 1u;
+    static constexpr uint32_t maxGeneration = UINT32_MAX >> 1u;
+
+public: /* Methods: */
+
+    ConcurrentSharedValueHeap () {
+        for (std::atomic<Slot *> & segment : m_segments)
+            segment.store (nullptr, std::memory_order_relaxed);
+    }
+
+    ConcurrentSharedValueHeap(const ConcurrentSharedValueHeap &) = delete;
+    ConcurrentSharedValueHeap & operator=(const ConcurrentSharedValueHeap &) = delete;
+
+    /**
+     * Frees all stored share vectors.
+     * \pre No other thread uses the heap.
+     */
+    ~ConcurrentSharedValueHeap () {
+        const uint64_t used = std::min<uint64_t> (m_nextIndex.load (std::memory_order_acquire), UINT32_MAX);
+        for (uint64_t i = 0u; i < used; ++ i) {
+            Slot * const slot = findSlot (static_cast<uint32_t>(i));
+            if (slot && (slot->state.load (std::memory_order_relaxed) & liveBit))
+                delete slot->vec.load (std::memory_order_relaxed);
+        }
+
+        for (std::atomic<Slot *> & segment : m_segments)
+            delete[] segment.load (std::memory_order_relaxed);
+    }
+
+    /**
+     * Inserts a share vector of type T into the heap.
+     * \param[in] vec Vector to be inserted into the heap, must not be stored in the heap already.
+     * \returns the handle of the vector or null if vec was null pointer.
+     */
+    template <typename T, typename Allocator>
+    void * insert_handle (ShareVec<T, Allocator>* vec) {
+        if (! vec)
+            return nullptr;
+
+        const uint32_t type = typeId<ShareVec<T, Allocator> > ();
+        const uint32_t index = acquireIndex ();
+        if (! taggedHandles) {
+            AddressShard & shard = addressShard (vec);
+            std::lock_guard<std::mutex> const guard (shard.mutex);
+            try {
+                shard.indices.insert (std::make_pair (static_cast<const ShareVecBase *>(vec), index));
+            } catch (...) {
+                releaseIndex (index);
+                throw;
+            }
+        }
+
+        Slot & slot = *findSlot (index);
+        const uint32_t generation = generationOf (slot.state.load (std::memory_order_relaxed));
+        slot.vec.store (vec, std::memory_order_relaxed);
+        slot.state.store (pack (generation, true, ValueTraits<T>::heap_type_id, type),
+                          std::memory_order_release);
+        m_size.fetch_add (1u, std::memory_order_relaxed);
+        return taggedHandles
+               ? encode (index, generation)
+               : static_cast<void *>(static_cast<ShareVecBase *>(vec));
+    }
+
+    /**
+     * Erases a share vector of given type from the heap.
+     * \param[in] hndl A handle to a share vector.
+     * \retval true If vector was successfully freed from the heap.
+     * \retval false If the handle is not stored in the heap, or is stored with incorrect type.
+     */
+    template <typename T>
+    bool erase_handle (void* hndl) {
+        uint32_t index, generation;
+        if (! decode (hndl, index, generation))
+            return false;
+
+        Slot * const slot = findSlot (index);
+        if (! slot)
+            return false;
+
+        uint64_t expected = slot->state.load (std::memory_order_relaxed);
+        if (! matches<T> (expected, generation)
+            || ! slot->state.compare_exchange_strong (expected,
+                                                      pack (generation + 1u, false, 0u, 0u),
+                                                      std::memory_order_acq_rel))
+            return false;
+
+        m_size.fetch_sub (1u, std::memory_order_relaxed);
+        ShareVecBase * const vec = slot->vec.exchange (nullptr, std::memory_order_relaxed);
+
+        /* The address must be unregistered before it can be reused: */
+        if (! taggedHandles) {
+            AddressShard & shard = addressShard (vec);
+            std::lock_guard<std::mutex> const guard (shard.mutex);
+            shard.indices.erase (vec);
+        }
+
+        delete vec;
+
+        /* Slots whose generation is exhausted are never reused: */
+        if (generation + 1u <= maxGeneration)
+            releaseIndex (index);
+
+        return true;
+    }
+
+    /**
+     * Checks if given handle is stored in the heap with given type.
+     * \param[in] hndl A handle to a share vector.
+     * \retval true If the \a hndl was stored in the heap with type \a T.
+     * \retval false If the handle is not stored in the heap, or is stored with incorrect type.
+     * \note Only the heap_type_id of T is compared, the vector may have any
+     *       allocator, see check_exact().
+     */
+    template <typename T>
+    bool check (void* hndl) const {
+        uint32_t index, generation;
+        if (! decode (hndl, index, generation))
+            return false;
+
+        const Slot * const slot = findSlot (index);
+        return slot && matches<T> (slot->state.load (std::memory_order_acquire), generation);
+    }
+
+    /** Checks if given handle is stored in the heap as a ShareVec<T, Allocator>. */
+    template <typename T, typename Allocator = typename share_allocator_of<T>::type>
+    bool check_exact (void* hndl) const {
+        return get<T, Allocator> (hndl) != nullptr;
+    }
+
+    /**
+     * \returns the vector of the handle or null if the handle is not stored
+     *          in the heap, or is not stored as a ShareVec<T, Allocator>.
+     */
+    template <typename T, typename Allocator = typename share_allocator_of<T>::type>
+    ShareVec<T, Allocator> * get (void* hndl) const {
+        uint32_t index, generation;
+        if (! decode (hndl, index, generation))
+            return nullptr;
+
+        const Slot * const slot = findSlot (index);
+        if (! slot)
+            return nullptr;
+
+        if (slot->state.load (std::memory_order_acquire)
+            != pack (generation, true, ValueTraits<T>::heap_type_id, typeId<ShareVec<T, Allocator> > ()))
+            return nullptr;
+
+        return static_cast<ShareVec<T, Allocator> *>(slot->vec.load (std::memory_order_relaxed));
+    }
+
+    /** \returns the number of stored vectors. */
+    std::size_t size () const noexcept { return m_size.load (std::memory_order_relaxed); }
+
+private: /* Methods: */
+
+    static uint32_t nextTypeId () noexcept {
+        static std::atomic<uint32_t> next (1u);
+        const uint32_t id = next.fetch_add (1u, std::memory_order_relaxed);
+        assert (id <= typeMask);
+        return id;
+    }
+
+    /* Vectors of the same value type with different storage are different types. */
+    template <typename Vec>
+    static uint32_t typeId () noexcept {
+        static const uint32_t id = nextTypeId ();
+        return id;
+    }
+
+    static uint64_t pack (const uint32_t generation,
+                          const bool live,
+                          const uint8_t heapTypeId,
+                          const uint32_t type) noexcept
+    {
+        return (uint64_t (generation) << 33u)
+               | (live ? liveBit : 0u)
+               | (uint64_t (heapTypeId) << heapTypeShift)
+               | type;
+    }
+
+    /* Whether the state is of a live vector of the generation with the heap_type_id of T. */
+    template <typename T>
+    static bool matches (const uint64_t state, const uint32_t generation) noexcept {
+        return (state >> heapTypeShift) == (pack (generation, true, ValueTraits<T>::heap_type_id, 0u) >> heapTypeShift);
+    }
+
+    static uint32_t generationOf (const uint64_t state) noexcept {
+        return static_cast<uint32_t>(state >> 33u);
+    }
+
+    static void * encode (const uint32_t index, const uint32_t generation) noexcept {
+        return reinterpret_cast<void *>(static_cast<uintptr_t>(((uint64_t (generation) << 32u | index) << 1u) | 1u));
+    }
+
+    /* Finds the slot index and generation of a handle, without tagged handles that of the address. */
+    bool decode (const void * hndl, uint32_t & index, uint32_t & generation) const {
+        if (! taggedHandles) {
+            const ShareVecBase * const vec = static_cast<const ShareVecBase *>(hndl);
+            AddressShard & shard = addressShard (vec);
+            {
+                std::lock_guard<std::mutex> const guard (shard.mutex);
+                const auto i = shard.indices.find (vec);
+                if (i == shard.indices.end ())
+                    return false;
+                index = i->second;
+            }
+            generation = generationOf (findSlot (index)->state.load (std::memory_order_acquire));
+            return true;
+        }
+
+        const uint64_t value = reinterpret_cast<uintptr_t>(hndl);
+        if ((value & 1u) == 0u)
+            return false;
+        index = static_cast<uint32_t>(value >> 1u);
+        generation = static_cast<uint32_t>(value >> 33u);
+        return true;
+    }
+
+    AddressShard & addressShard (const ShareVecBase * const vec) const noexcept {
+        return m_addresses[std::hash<const ShareVecBase *> () (vec) % numAddressShards];
+    }
+
+    /* Segment k holds the indices [base * (2^k - 1), base * (2^(k + 1) - 1)). */
+    static unsigned segmentOf (const uint32_t index, std::size_t & offset) noexcept {
+        const uint64_t scaled = (uint64_t (index) >> firstSegmentLog) + 1u;
+        const unsigned k = 63u - static_cast<unsigned>(__builtin_clzll (scaled));
+        offset = index - ((uint64_t (1u) << (k + firstSegmentLog)) - (uint64_t (1u) << firstSegmentLog));
+        return k;
+    }
+
+    Slot * findSlot (const uint32_t index) const noexcept {
+        std::size_t offset;
+        const unsigned k = segmentOf (index, offset);
+        if (k >= numSegments)
+            return nullptr;
+        Slot * const segment = m_segments[k].load (std::memory_order_acquire);
+        return segment ? segment + offset : nullptr;
+    }
+
+    uint32_t acquireIndex () {
+        static thread_local const std::size_t home = std::hash<std::thread::id> () (std::this_thread::get_id ());
+        for (std::size_t i = 0u; i < numShards; ++ i) {
+            Shard & shard = m_shards[(home + i) % numShards];
+            std::lock_guard<std::mutex> const guard (shard.mutex);
+            if (! shard.freeSlots.empty ()) {
+                const uint32_t index = shard.freeSlots.back ();
+                shard.freeSlots.pop_back ();
+                return index;
+            }
+        }
+
+        const uint64_t index = m_nextIndex.fetch_add (1u, std::memory_order_relaxed);
+        if (index >= UINT32_MAX)
+            throw std::bad_alloc ();
+
+        std::size_t offset;
+        const unsigned k = segmentOf (static_cast<uint32_t>(index), offset);
+        if (k >= numSegments)
+            throw std::bad_alloc ();
+
+        if (! m_segments[k].load (std::memory_order_acquire)) {
+            const std::size_t length = std::size_t (1u) << (k + firstSegmentLog);
+            Slot * const fresh = new Slot[length];
+            for (std::size_t j = 0u; j < length; ++ j) {
+                fresh[j].state.store (0u, std::memory_order_relaxed);
+                fresh[j].vec.store (nullptr, std::memory_order_relaxed);
+            }
+
+            Slot * expected = nullptr;
+            if (! m_segments[k].compare_exchange_strong (expected, fresh, std::memory_order_acq_rel))
+                delete[] fresh;
+        }
+
+        return static_cast<uint32_t>(index);
+    }
+
+    void releaseIndex (const uint32_t index) {
+        Shard & shard = m_shards[index % numShards];
+        std::lock_guard<std::mutex> const guard (shard.mutex);
+        try {
+            shard.freeSlots.push_back (index);
+        } catch (...) {
+            /* Leak the slot rather than fail the erasure. */
+        }
+    }
+
+private: /* Fields: */
+
+    std::atomic<Slot *> m_segments[numSegments];
+    std::atomic<uint64_t> m_nextIndex { 0u };
+    std::atomic<std::size_t> m_size { 0u };
+    Shard m_shards[numShards];
+    mutable AddressShard m_addresses[numAddressShards];
+
+}; /* class ConcurrentSharedValueHeap { */
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_CONCURRENTSHAREDVALUEHEAP_H */
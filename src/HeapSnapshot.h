@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_HEAPSNAPSHOT_H
+#define SHAREMIND_PDKHEADERS_HEAPSNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace sharemind {
+
+/**
+ * \brief Tags the share vectors stored in a SharedValueHeap by the current
+ * thread while the object is alive with an allocation site.
+ * \a site must be a string with static storage duration, e.g. the name of
+ * the syscall. Nested sites override the enclosing ones.
+ */
+class __attribute__ ((visibility("internal"))) HeapAllocationSite {
+
+public: /* Methods: */
+
+    explicit HeapAllocationSite (const char * const site) noexcept
+        : m_previous (current ())
+    { current () = site; }
+
+    HeapAllocationSite (const HeapAllocationSite &) = delete;
+    HeapAllocationSite & operator= (const HeapAllocationSite &) = delete;
+
+    ~HeapAllocationSite () noexcept { current () = m_previous; }
+
+    /** \returns the innermost site of the calling thread or null. */
+    static const char * active () noexcept { return current (); }
+
+private: /* Methods: */
+
+    static const char * & current () noexcept {
+        static thread_local const char * site = nullptr;
+        return site;
+    }
+
+private: /* Fields: */
+
+    const char * const m_previous;
+
+}; /* class HeapAllocationSite { */
+
+/**
+ * \brief Contents of a SharedValueHeap at a point in time, see
+ * SharedValueHeap::snapshot(). Everything is ordered by key, so dumps of
+ * different runs can be compared line by line.
+ */
+struct __attribute__ ((visibility("internal"))) HeapSnapshot {
+
+    struct SiteStats {
+        std::size_t vectors = 0u;
+        std::size_t bytes = 0u;
+    };
+
+    struct TypeStats {
+        std::size_t liveVectors = 0u;
+        std::size_t bytes = 0u;
+        std::size_t pooledVectors = 0u;
+        std::size_t pooledBytes = 0u;
+        /** Element k > 0 counts live vectors of [2^(k-1), 2^k) bytes, element 0 the empty ones. */
+        std::vector<std::size_t> sizeHistogram;
+        std::map<std::string, SiteStats> sites;
+    };
+
+    /** \brief Estimated allocations of a site and heap_type_id. */
+    struct ProfileStats {
+        uint64_t samples = 0u;
+        uint64_t bytes = 0u; /**< Samples times the sampling interval. */
+    };
+
+    using Profile = std::map<std::pair<std::string, unsigned>, ProfileStats>;
+
+    /** Site of vectors stored outside of any HeapAllocationSite. */
+    static const char * unknownSite () noexcept { return "unknown"; }
+
+    /** \returns the histogram bucket of a vector of \a bytes bytes. */
+    static std::size_t sizeBucket (const std::size_t bytes) noexcept {
+        return bytes == 0u ? 0u : 64u - static_cast<std::size_t>(__builtin_clzll (bytes));
+    }
+
+    /** Writes the snapshot as a JSON object. */
+    void write_json (std::ostream & os) const {
+        os << "{\n  \"currentBytes\": " << currentBytes
+           << ",\n  \"peakBytes\": " << peakBytes
+           << ",\n  \"pooledBytes\": " << pooledBytes
+           << ",\n  \"liveVectors\": " << liveVectors
+           << ",\n  \"types\": [";
+        const char * sep = "\n";
+        for (const std::pair<const unsigned, TypeStats> & t : types) {
+            os << sep << "    {\n      \"heapTypeId\": " << t.first
+               << ",\n      \"liveVectors\": " << t.second.liveVectors
+               << ",\n      \"bytes\": " << t.second.bytes
+               << ",\n      \"pooledVectors\": " << t.second.pooledVectors
+               << ",\n      \"pooledBytes\": " << t.second.pooledBytes
+               << ",\n      \"sizeHistogram\": [";
+            for (std::size_t k = 0u; k < t.second.sizeHistogram.size (); ++ k)
+                os << (k ? ", " : "") << t.second.sizeHistogram[k];
+            os << "],\n      \"sites\": {";
+            const char * siteSep = "\n";
+            for (const std::pair<const std::string, SiteStats> & s : t.second.sites) {
+                os << siteSep << "        ";
+                writeString (os, s.first);
+                os << ": { \"vectors\": " << s.second.vectors
+                   << ", \"bytes\": " << s.second.bytes << " }";
+                siteSep = ",\n";
+            }
+            os << (t.second.sites.empty () ? "}" : "\n      }") << "\n    }";
+            sep = ",\n";
+        }
+
+        os << (types.empty () ? "]" : "\n  ]")
+           << ",\n  \"profile\": {\n    \"sampleBytes\": " << sampleBytes
+           << ",\n    \"samples\": [";
+        sep = "\n";
+        for (const Profile::value_type & p : profile) {
+            os << sep << "      { \"site\": ";
+            writeString (os, p.first.first);
+            os << ", \"heapTypeId\": " << p.first.second
+               << ", \"samples\": " << p.second.samples
+               << ", \"bytes\": " << p.second.bytes << " }";
+            sep = ",\n";
+        }
+        os << (profile.empty () ? "]" : "\n    ]") << "\n  }\n}\n";
+    }
+
+    std::size_t currentBytes = 0u;
+    std::size_t peakBytes = 0u;
+    std::size_t pooledBytes = 0u;
+    std::size_t liveVectors = 0u;
+    std::map<unsigned, TypeStats> types; /**< By heap_type_id. */
+    std::size_t sampleBytes = 0u; /**< Sampling interval, zero if profiling is disabled. */
+    Profile profile;
+
+private: /* Methods: */
+
+    static void writeString (std::ostream & os, const std::string & s) {
+        static const char hex[] = "0123456789abcdef";
+        os << '"';
+        for (const char c : s) {
+            if (c == '"' || c == '\\') {
+                os << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20u) {
+                os << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+            } else {
+                os << c;
+            }
+        }
+        os << '"';
+    }
+
+}; /* struct HeapSnapshot { */
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_HEAPSNAPSHOT_H */
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_MAPPEDFILEALLOCATOR_H
+#define SHAREMIND_PDKHEADERS_MAPPEDFILEALLOCATOR_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+#include "ShareVector.h"
+
+
+namespace sharemind {
+
+/**
+ * \brief Run-time configuration of MappedFileAllocator.
+ */
+struct __attribute__ ((visibility("internal"))) MappedFileStorage {
+
+    /**
+     * \returns the allocation size in bytes starting from which storage is
+     *          backed by a temporary file, smaller allocations use the heap.
+     */
+    static std::size_t minFileSize() noexcept
+    { return minFileSizeRef().load(std::memory_order_relaxed); }
+
+    /**
+     * Applies to subsequent allocations. Storage allocated before is freed
+     * the way it was allocated.
+     */
+    static void setMinFileSize(std::size_t const bytes) noexcept
+    { minFileSizeRef().store(bytes, std::memory_order_relaxed); }
+
+    /**
+     * \returns the directory for temporary files, by default $TMPDIR or
+     *          /var/tmp.
+     * \warning The directory must be on a disk backed file system. Files on a
+     *          tmpfs, which /tmp and $TMPDIR often are, live in memory and
+     *          swap themselves, which defeats the purpose of the allocator.
+     *          Deployments should set a directory with setDirectory().
+     */
+    static std::string directory() {
+        std::lock_guard<std::mutex> const guard(directoryMutex());
+        return directoryRef();
+    }
+
+    static void setDirectory(std::string dir) {
+        std::lock_guard<std::mutex> const guard(directoryMutex());
+        directoryRef() = std::move(dir);
+    }
+
+    /**
+     * Maps \a bytes bytes of a new unlinked temporary file.
+     * \throws std::bad_alloc if the file can not be created or mapped.
+     */
+    static void * map(std::size_t const bytes) {
+        std::string const dir = directory();
+        int fd = -1;
+#ifdef O_TMPFILE
+        fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+        if (fd < 0) {
+            std::vector<char> path(dir.begin(), dir.end());
+            static char const suffix[] = "/sharemind-sharevec-XXXXXX";
+            path.insert(path.end(), suffix, suffix + sizeof(suffix));
+            fd = ::mkstemp(path.data());
+            if (fd < 0)
+                throw std::bad_alloc();
+            ::unlink(path.data());
+        }
+
+        void * mem = MAP_FAILED;
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+            mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED)
+            throw std::bad_alloc();
+
+        ::madvise(mem, bytes, MADV_SEQUENTIAL);
+        try {
+            std::lock_guard<std::mutex> const guard(mappingsMutex());
+            mappings().insert(mem);
+            if (bytes < smallestMappingRef().load(std::memory_order_relaxed))
+                smallestMappingRef().store(bytes, std::memory_order_relaxed);
+        } catch (...) {
+            ::munmap(mem, bytes);
+            throw;
+        }
+        return mem;
+    }
+
+    /**
+     * Unmaps \a mem if it was returned by map().
+     * \retval false If \a mem was not mapped, e.g. it came from the heap.
+     */
+    static bool unmap(void * const mem, std::size_t const bytes) noexcept {
+        /* Sizes below any mapping ever made are heap memory, skip the lock: */
+        if (bytes < smallestMappingRef().load(std::memory_order_relaxed))
+            return false;
+
+        {
+            std::lock_guard<std::mutex> const guard(mappingsMutex());
+            if (mappings().erase(mem) == 0u)
+                return false;
+        }
+        ::munmap(mem, bytes);
+        return true;
+    }
+
+    /**
+     * Drops the resident pages fully inside [begin, begin + bytes). The data
+     * stays in the file and is paged back in on the next access.
+     */
+    static void release(void * const begin, std::size_t const bytes) noexcept {
+        std::uintptr_t const pageSize = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+        std::uintptr_t first = reinterpret_cast<std::uintptr_t>(begin);
+        std::uintptr_t const last = (first + bytes) & ~(pageSize - 1u);
+        first = (first + pageSize - 1u) & ~(pageSize - 1u);
+        if (first < last)
+            ::madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+    }
+
+private: /* Methods: */
+
+    static std::atomic<std::size_t> & minFileSizeRef() noexcept {
+        static std::atomic<std::size_t> size(64u * 1024u * 1024u);
+        return size;
+    }
+
+    /* Storage may outlive a change of minFileSize(), so mappings are recorded. */
+    static std::unordered_set<void *> & mappings() noexcept {
+        static std::unordered_set<void *> r;
+        return r;
+    }
+
+    static std::mutex & mappingsMutex() noexcept {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::atomic<std::size_t> & smallestMappingRef() noexcept {
+        static std::atomic<std::size_t> size(SIZE_MAX);
+        return size;
+    }
+
+    static std::mutex & directoryMutex() noexcept {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::string & directoryRef() {
+        static std::string dir(defaultDirectory());
+        return dir;
+    }
+
+    static const char * defaultDirectory() noexcept {
+        const char * const dir = std::getenv("TMPDIR");
+        return (dir && *dir) ? dir : "/var/tmp";
+    }
+
+}; /* struct MappedFileStorage { */
+
+/**
+ * \brief Allocator backing large share vectors by memory mapped temporary
+ * files instead of anonymous memory.
+ * Pages of such vectors are written back to the file instead of swap under
+ * memory pressure, so vectors larger than the physical memory can be
+ * processed sequentially. Allocations smaller than
+ * MappedFileStorage::minFileSize() are served from the heap.
+ *
+ * The allocator is selected per vector, see MappedShareVec, or for all
+ * vectors of a value type by defining \a share_allocator, see ValueTraits.
+ * Only the latter vectors are operands of the syscalls in MetaSyscalls,
+ * which resolve handles to ShareVec<T>. A MappedShareVec<T> of a value type
+ * with another allocator can be stored in a SharedValueHeap and used by the
+ * module directly, but syscalls fail on its handle.
+ */
+template <typename T>
+class __attribute__ ((visibility("internal"))) MappedFileAllocator {
+
+public: /* Types: */
+
+    using value_type = T;
+    using is_always_equal = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    template <typename U>
+    struct rebind { using other = MappedFileAllocator<U>; };
+
+public: /* Methods: */
+
+    MappedFileAllocator() noexcept {}
+
+    template <typename U>
+    MappedFileAllocator(const MappedFileAllocator<U> &) noexcept {}
+
+    T * allocate(std::size_t const n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_alloc();
+        std::size_t const bytes = n * sizeof(T);
+        if (!isMapped(bytes))
+            return std::allocator<T>().allocate(n);
+        return static_cast<T *>(MappedFileStorage::map(bytes));
+    }
+
+    void deallocate(T * const ptr, std::size_t const n) noexcept {
+        if (!MappedFileStorage::unmap(ptr, n * sizeof(T)))
+            std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U>
+    friend bool operator==(const MappedFileAllocator &, const MappedFileAllocator<U> &) noexcept
+    { return true; }
+
+    template <typename U>
+    friend bool operator!=(const MappedFileAllocator &, const MappedFileAllocator<U> &) noexcept
+    { return false; }
+
+private: /* Methods: */
+
+    static bool isMapped(std::size_t const bytes) noexcept
+    { return bytes >= MappedFileStorage::minFileSize(); }
+
+}; /* class MappedFileAllocator { */
+
+template <typename T>
+using MappedShareVec = ShareVec<T, MappedFileAllocator<typename T::share_type> >;
+
+/**
+ * Hints that the elements [begin, end) of a file backed vector have been
+ * processed and their pages can be evicted from memory.
+ */
+template <typename T, typename U>
+inline void release_processed(ShareVec<T, MappedFileAllocator<U> > & vec,
+                              std::size_t const begin,
+                              std::size_t const end) noexcept
+{
+    assert(begin <= end && end <= vec.size());
+    MappedFileStorage::release(vec.data() + begin, (end - begin) * sizeof(U));
+}
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_MAPPEDFILEALLOCATOR_H */
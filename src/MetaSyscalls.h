@@ -20,14 +20,26 @@
 #ifndef SHAREMIND_PDKHEADERS_METASYSCALLS_H
 #define SHAREMIND_PDKHEADERS_METASYSCALLS_H
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <sharemind/module-apis/api_0x1.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "HeapSnapshot.h"
 #include "ShareVector.h"
+#include "ShareVecView.h"
 #include "SyscallsCommon.h"
 #include "VmVector.h"
 
 /**
  * Meta-syscalls for many common cases.
+ * Protocols are invoked with whole share vectors, which convert implicitly to
+ * ShareVecView and ConstShareVecView parameters.
+ * Vectors stored in a SharedValueHeap during a syscall are tagged with the
+ * HeapAllocationSite of the syscall name.
  */
 
 namespace sharemind {
@@ -37,6 +49,14 @@ struct __attribute__ ((visibility("internal"))) MetaSyscalls {
 
 public:
 
+    /** \brief Instruction of batch_arith_vec. */
+    struct BatchInstruction {
+        uint64_t opcode; /**< Index of the protocol in the Protocols of the syscall. */
+        void * output;
+        void * lhs; /**< The input of unary protocols. */
+        void * rhs; /**< Ignored by unary protocols. */
+    };
+
     /**
      * SysCall: binary_vec<T1, T2, T3, Protocol>
      * Args:
@@ -61,29 +81,27 @@ public:
         }
 
         try {
+            const HeapAllocationSite site ("binary_vec");
             PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
             if (! pdpi->isComputingNode ()) {
                 return SHAREMIND_MODULE_API_0x1_OK;
             }
 
-            void* lhsHandle = args[1].p[0];
-            void* rhsHandle = args[2].p[0];
-            void* resultHandle = args[3].p[0];
+            const ShareVec<T1>* param1 = resolveHandle<T1>(pdpi, args[1].p[0]);
+            const ShareVec<T2>* param2 = resolveHandle<T2>(pdpi, args[2].p[0]);
+            ShareVec<T3>* result = resolveHandle<T3>(pdpi, args[3].p[0]);
 
-            if (! pdpi->template isValidHandle<T1>(lhsHandle) ||
-                ! pdpi->template isValidHandle<T2>(rhsHandle) ||
-                ! pdpi->template isValidHandle<T3>(resultHandle)) {
+            if (! param1 || ! param2 || ! result) {
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
             }
 
-            const ShareVec<T1>& param1 = *static_cast<ShareVec<T1>*>(lhsHandle);
-            const ShareVec<T2>& param2 = *static_cast<ShareVec<T2>*>(rhsHandle);
-            ShareVec<T3>& result = *static_cast<ShareVec<T3>*>(resultHandle);
-
+            checkUsage<T3>(pdpi, args[3].p[0], param1->size ());
             Protocol protocol(*pdpi);
-            if (! protocol.invoke (param1, param2, result))
+            if (! protocol.invoke (*param1, *param2, *result))
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
 
+            updateUsage (pdpi, args[3].p[0], 0);
+
             return SHAREMIND_MODULE_API_0x1_OK;
         } catch (...) {
             return catchModuleApiErrors ();
@@ -150,26 +168,26 @@ public:
         }
 
         try {
+            const HeapAllocationSite site ("unary_vec");
             PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
             if (! pdpi->isComputingNode ()) {
                 return SHAREMIND_MODULE_API_0x1_OK;
             }
 
-            void* paramHandle = args[1].p[0];
-            void* resultHandle = args[2].p[0];
+            const ShareVec<T>* param = resolveHandle<T>(pdpi, args[1].p[0]);
+            ShareVec<L>* result = resolveHandle<L>(pdpi, args[2].p[0]);
 
-            if (! pdpi->template isValidHandle<T>(paramHandle) ||
-                ! pdpi->template isValidHandle<L>(resultHandle)) {
+            if (! param || ! result) {
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
             }
 
-            const ShareVec<T>& param = *static_cast<ShareVec<T>*>(paramHandle);
-            ShareVec<L>& result = *static_cast<ShareVec<L>*>(resultHandle);
-
+            checkUsage<L>(pdpi, args[2].p[0], param->size ());
             Protocol protocol(*pdpi);
-            if (! protocol.invoke (param, result))
+            if (! protocol.invoke (*param, *result))
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
 
+            updateUsage (pdpi, args[2].p[0], 0);
+
             return SHAREMIND_MODULE_API_0x1_OK;
         } catch (...) {
             return catchModuleApiErrors ();
@@ -211,21 +229,21 @@ public:
         }
 
         try {
+            const HeapAllocationSite site ("nullary_vec");
             PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
             if (! pdpi->isComputingNode ()) {
                 return SHAREMIND_MODULE_API_0x1_OK;
             }
 
-            void* resultHandle = args[1].p[0];
+            ShareVec<T>* result = resolveHandle<T>(pdpi, args[1].p[0]);
 
-            if (! pdpi->template isValidHandle<T>(resultHandle)) {
+            if (! result) {
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
             }
 
-            ShareVec<T>& result = *static_cast<ShareVec<T>*>(resultHandle);
-
-            if (!Protocol(*pdpi).invoke(result))
+            if (!Protocol(*pdpi).invoke(*result))
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
+            updateUsage (pdpi, args[1].p[0], 0);
             return SHAREMIND_MODULE_API_0x1_OK;
         } catch (...) {
             return catchModuleApiErrors ();
@@ -244,25 +262,25 @@ public:
         }
 
         try {
+            const HeapAllocationSite site ("opc_vec");
             PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
             if (! pdpi->isComputingNode ()) {
                 return SHAREMIND_MODULE_API_0x1_OK;
             }
 
-            void* param1Handle = args[1].p[0];
-            void* resultHandle = args[2].p[0];
+            const ShareVec<T>* param1 = resolveHandle<T>(pdpi, args[1].p[0]);
+            ShareVec<T>* result = resolveHandle<T>(pdpi, args[2].p[0]);
 
-            if (! pdpi->template isValidHandle<T>(param1Handle) ||
-                ! pdpi->template isValidHandle<T>(resultHandle)) {
+            if (! param1 || ! result) {
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
             }
 
-            const ShareVec<T>& param1 = *static_cast<ShareVec<T>*>(param1Handle);
             const ImmutableVmVec<L> param2 (crefs[0]);
-            ShareVec<T>& result = *static_cast<ShareVec<T>*>(resultHandle);
 
-            if (!Protocol(*pdpi).invoke(param1, param2, result))
+            checkUsage<T>(pdpi, args[2].p[0], param1->size ());
+            if (!Protocol(*pdpi).invoke(*param1, param2, *result))
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
+            updateUsage (pdpi, args[2].p[0], 0);
             return SHAREMIND_MODULE_API_0x1_OK;
         } catch (...) {
             return catchModuleApiErrors ();
@@ -303,28 +321,184 @@ public:
         }
 
         try {
+            const HeapAllocationSite site ("compare_vec");
             PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
             if (! pdpi->isComputingNode ()) {
                 return SHAREMIND_MODULE_API_0x1_OK;
             }
 
-            void* param1Handle = args[flipParams ? 2 : 1].p[0];
-            void* param2Handle = args[flipParams ? 1 : 2].p[0];
-            void* resultHandle = args[3].p[0];
+            const ShareVec<T>* param1 = resolveHandle<T>(pdpi, args[flipParams ? 2 : 1].p[0]);
+            const ShareVec<T>* param2 = resolveHandle<T>(pdpi, args[flipParams ? 1 : 2].p[0]);
+            ShareVec<BoolT>* result = resolveHandle<BoolT>(pdpi, args[3].p[0]);
 
-            if (! pdpi->template isValidHandle<T>(param1Handle) ||
-                ! pdpi->template isValidHandle<T>(param2Handle) ||
-                ! pdpi->template isValidHandle<BoolT>(resultHandle)) {
+            if (! param1 || ! param2 || ! result) {
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
             }
 
-            const ShareVec<T>& param1 = *static_cast<ShareVec<T>*>(param1Handle);
-            const ShareVec<T>& param2 = *static_cast<ShareVec<T>*>(param2Handle);
-            ShareVec<BoolT>& result = *static_cast<ShareVec<BoolT>*>(resultHandle);
-
+            checkUsage<BoolT>(pdpi, args[3].p[0], param1->size ());
             Protocol comparisonProtocol(*pdpi);
-            if (!comparisonProtocol.invoke (param1, param2, result))
+            if (!comparisonProtocol.invoke (*param1, *param2, *result))
+                return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
+
+            updateUsage (pdpi, args[3].p[0], 0);
+
+            return SHAREMIND_MODULE_API_0x1_OK;
+        } catch (...) {
+            return catchModuleApiErrors ();
+        }
+    }
+
+    /**
+     * SysCall: new_vec_many<T>
+     * Args:
+     *      0) uint64[0]     pd index
+     *      1) uint64[0]     number of elements of each vector
+     * Refs:
+     *      0) array of p[0] output handles, a vector is allocated for each
+     * Precondition:
+     *      PdpiType::sharedValueHeap () returns the SharedValueHeap the PDPI
+     *      resolves handles with.
+     *
+     * Saves a syscall per vector, the vectors themselves are still allocated
+     * one by one, see SharedValueHeap::allocate_many.
+     */
+    template <typename T>
+    static SHAREMIND_MODULE_API_0x1_SYSCALL(new_vec_many,
+                                     args, num_args, refs, crefs,
+                                     returnValue, c)
+    {
+        PdpiVmHandles<pdkIndex> handles;
+        if (! SyscallArgs<2, false, 1, 0>::check (num_args, refs, crefs, returnValue) ||
+            ! handles.get (c, args) ||
+            refs[0].size % sizeof (void *) != 0u) {
+            return SHAREMIND_MODULE_API_0x1_INVALID_CALL;
+        }
+
+        try {
+            const HeapAllocationSite site ("new_vec_many");
+            PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
+            if (! pdpi->isComputingNode ()) {
+                return SHAREMIND_MODULE_API_0x1_OK;
+            }
+
+            pdpi->sharedValueHeap ().template allocate_many<T> (
+                        static_cast<void **>(refs[0].pData),
+                        refs[0].size / sizeof (void *),
+                        args[1].uint64[0]);
+            return SHAREMIND_MODULE_API_0x1_OK;
+        } catch (...) {
+            return catchModuleApiErrors ();
+        }
+    }
+
+    /**
+     * SysCall: delete_vec_many<T>
+     * Args:
+     *      0) uint64[0]     pd index
+     * CRefs:
+     *      0) array of p[0] handles to be freed
+     * Precondition:
+     *      PdpiType::sharedValueHeap () returns the SharedValueHeap the PDPI
+     *      resolves handles with.
+     * \returns SHAREMIND_MODULE_API_0x1_GENERAL_ERROR if some of the handles
+     *          were not vectors of type T, the other vectors are freed.
+     */
+    template <typename T>
+    static SHAREMIND_MODULE_API_0x1_SYSCALL(delete_vec_many,
+                                     args, num_args, refs, crefs,
+                                     returnValue, c)
+    {
+        PdpiVmHandles<pdkIndex> handles;
+        if (! SyscallArgs<1, false, 0, 1>::check (num_args, refs, crefs, returnValue) ||
+            ! handles.get (c, args) ||
+            crefs[0].size % sizeof (void *) != 0u) {
+            return SHAREMIND_MODULE_API_0x1_INVALID_CALL;
+        }
+
+        try {
+            PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
+            if (! pdpi->isComputingNode ()) {
+                return SHAREMIND_MODULE_API_0x1_OK;
+            }
+
+            const std::size_t n = crefs[0].size / sizeof (void *);
+            if (pdpi->sharedValueHeap ().template erase_many<T> (
+                        static_cast<void * const *>(crefs[0].pData), n) != n)
                 return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
+            return SHAREMIND_MODULE_API_0x1_OK;
+        } catch (...) {
+            return catchModuleApiErrors ();
+        }
+    }
+
+    /**
+     * SysCall: batch_arith_vec<T, Protocols...>
+     * Args:
+     *      0) uint64[0]     pd index
+     * CRefs:
+     *      0) array of BatchInstruction
+     * Precondition:
+     *      All handles are valid vectors of type T.
+     *      Every protocol is elementwise and is invoked with (lhs, rhs,
+     *      output) or (input, output) like in binary_vec and unary_vec.
+     *
+     * Runs the program in order with a single dispatch. Only consecutive
+     * instructions with the same opcode are merged, and only if they do not
+     * depend on each other's outputs and their vectors are small: they are
+     * run as one invocation of the protocol over the concatenated inputs.
+     * Their local work is then done in one pass and their network rounds are
+     * shared. Instructions are never reordered to form larger groups.
+     * All handles are validated before any instruction is run.
+     * \returns SHAREMIND_MODULE_API_0x1_INVALID_CALL if an opcode is not an
+     *          index of Protocols.
+     */
+    template <typename T, typename ... Protocols>
+    static SHAREMIND_MODULE_API_0x1_SYSCALL(batch_arith_vec,
+                                     args, num_args, refs, crefs,
+                                     returnValue, c)
+    {
+        PdpiVmHandles<pdkIndex> handles;
+        if (! SyscallArgs<1, false, 0, 1>::check (num_args, refs, crefs, returnValue) ||
+            ! handles.get (c, args) ||
+            crefs[0].size % sizeof (BatchInstruction) != 0u) {
+            return SHAREMIND_MODULE_API_0x1_INVALID_CALL;
+        }
+
+        try {
+            const HeapAllocationSite site ("batch_arith_vec");
+            PdpiType* pdpi = static_cast<PdpiType *>(handles.pdpiHandle);
+            if (! pdpi->isComputingNode ()) {
+                return SHAREMIND_MODULE_API_0x1_OK;
+            }
+
+            static const bool binary[] = { decltype (isBinaryProtocol<T, Protocols>(0))::value..., false };
+            const BatchInstruction * const program = static_cast<const BatchInstruction *>(crefs[0].pData);
+            const std::size_t n = crefs[0].size / sizeof (BatchInstruction);
+            std::vector<BatchStep<T> > steps (n);
+            for (std::size_t i = 0u; i < n; ++ i) {
+                if (program[i].opcode >= sizeof... (Protocols))
+                    return SHAREMIND_MODULE_API_0x1_INVALID_CALL;
+
+                BatchStep<T> & step = steps[i];
+                step.opcode = static_cast<std::size_t>(program[i].opcode);
+                step.out = resolveHandle<T>(pdpi, program[i].output);
+                step.lhs = resolveHandle<T>(pdpi, program[i].lhs);
+                step.rhs = binary[step.opcode] ? resolveHandle<T>(pdpi, program[i].rhs) : nullptr;
+                if (! step.out || ! step.lhs || (binary[step.opcode] && ! step.rhs))
+                    return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
+            }
+
+            for (std::size_t i = 0u; i < n; ) {
+                const std::size_t end = batchGroupEnd (steps, i);
+                for (std::size_t k = i; k < end; ++ k)
+                    checkUsage<T>(pdpi, program[k].output, steps[k].lhs->size ());
+
+                if (! runBatchOp<T, Protocols...>(*pdpi, &steps[i], end - i, 0u))
+                    return SHAREMIND_MODULE_API_0x1_GENERAL_ERROR;
+
+                for (; i < end; ++ i)
+                    updateUsage (pdpi, program[i].output, 0);
+            }
 
             return SHAREMIND_MODULE_API_0x1_OK;
         } catch (...) {
@@ -332,6 +506,198 @@ public:
         }
     }
 
+private:
+
+    /* Total length of the vectors of merged batch instructions. */
+    static constexpr std::size_t batchMergeElements = 65536u;
+    static constexpr std::size_t batchMaxGroup = 64u;
+
+    template <typename T>
+    struct BatchStep {
+        std::size_t opcode;
+        ShareVec<T> * out;
+        const ShareVec<T> * lhs;
+        const ShareVec<T> * rhs; /**< Null for unary protocols. */
+    };
+
+    template <typename T, typename P>
+    static auto isBinaryProtocol (int)
+            -> decltype (std::declval<P &>().invoke (std::declval<const ShareVec<T> &>(),
+                                                     std::declval<const ShareVec<T> &>(),
+                                                     std::declval<ShareVec<T> &>()),
+                         std::true_type ());
+
+    template <typename T, typename P>
+    static std::false_type isBinaryProtocol (long);
+
+    /* \returns the end of the group of instructions merged with steps[begin]. */
+    template <typename T>
+    static std::size_t batchGroupEnd (const std::vector<BatchStep<T> > & steps, const std::size_t begin) {
+        const auto mergeable = [] (const BatchStep<T> & s) {
+            return ! s.rhs || s.rhs->size () == s.lhs->size ();
+        };
+
+        std::size_t elements = steps[begin].lhs->size ();
+        if (! mergeable (steps[begin]) || elements > batchMergeElements)
+            return begin + 1u;
+
+        std::size_t end = begin + 1u;
+        for (; end < steps.size () && end - begin < batchMaxGroup; ++ end) {
+            const BatchStep<T> & s = steps[end];
+            if (s.opcode != steps[begin].opcode
+                || ! mergeable (s)
+                || s.lhs->size () > batchMergeElements - elements)
+                break;
+
+            bool independent = true;
+            for (std::size_t k = begin; k < end && independent; ++ k) {
+                const BatchStep<T> & p = steps[k];
+                independent = s.out != p.out
+                        && static_cast<const ShareVec<T> *>(s.out) != p.lhs
+                        && static_cast<const ShareVec<T> *>(s.out) != p.rhs
+                        && s.lhs != p.out
+                        && (! s.rhs || s.rhs != p.out);
+            }
+
+            if (! independent)
+                break;
+            elements += s.lhs->size ();
+        }
+
+        return end;
+    }
+
+    template <typename T>
+    static bool runBatchOp (PdpiType &, BatchStep<T> *, std::size_t, std::size_t) { return false; }
+
+    template <typename T, typename P, typename ... Ps>
+    static bool runBatchOp (PdpiType & pdpi, BatchStep<T> * steps, std::size_t n, std::size_t index) {
+        if (steps[0].opcode != index)
+            return runBatchOp<T, Ps...>(pdpi, steps, n, index + 1u);
+        return runBatchGroup<T, P>(pdpi, steps, n, decltype (isBinaryProtocol<T, P>(0)) ());
+    }
+
+    template <typename T, typename P>
+    static bool runBatchGroup (PdpiType & pdpi, BatchStep<T> * steps, std::size_t n, std::true_type) {
+        P protocol (pdpi);
+        if (n == 1u)
+            return protocol.invoke (*steps[0].lhs, *steps[0].rhs, *steps[0].out);
+
+        std::size_t total = 0u;
+        for (std::size_t k = 0u; k < n; ++ k)
+            total += steps[k].lhs->size ();
+
+        ShareVec<T> lhs (total, no_init), rhs (total, no_init), out (total, no_init);
+        for (std::size_t k = 0u, offset = 0u; k < n; offset += steps[k].lhs->size (), ++ k) {
+            std::copy (steps[k].lhs->begin (), steps[k].lhs->end (), lhs.begin () + offset);
+            std::copy (steps[k].rhs->begin (), steps[k].rhs->end (), rhs.begin () + offset);
+        }
+
+        return protocol.invoke (lhs, rhs, out) && splitBatchOutput (out, steps, n);
+    }
+
+    template <typename T, typename P>
+    static bool runBatchGroup (PdpiType & pdpi, BatchStep<T> * steps, std::size_t n, std::false_type) {
+        P protocol (pdpi);
+        if (n == 1u)
+            return protocol.invoke (*steps[0].lhs, *steps[0].out);
+
+        std::size_t total = 0u;
+        for (std::size_t k = 0u; k < n; ++ k)
+            total += steps[k].lhs->size ();
+
+        ShareVec<T> in (total, no_init), out (total, no_init);
+        for (std::size_t k = 0u, offset = 0u; k < n; offset += steps[k].lhs->size (), ++ k)
+            std::copy (steps[k].lhs->begin (), steps[k].lhs->end (), in.begin () + offset);
+
+        return protocol.invoke (in, out) && splitBatchOutput (out, steps, n);
+    }
+
+    /* Copies the slices of a merged output to the outputs of the instructions. */
+    template <typename T>
+    static bool splitBatchOutput (const ShareVec<T> & out, BatchStep<T> * steps, std::size_t n) {
+        std::size_t offset = 0u;
+        for (std::size_t k = 0u; k < n; ++ k) {
+            const std::size_t size = steps[k].lhs->size ();
+            if (out.size () - offset < size)
+                return false;
+            steps[k].out->resize_uninitialized (size);
+            std::copy (out.begin () + offset, out.begin () + offset + size, steps[k].out->begin ());
+            offset += size;
+        }
+        return offset == out.size ();
+    }
+
+    /*
+     * Resolves a share vector handle with PdpiType::resolveHandle<T> if the
+     * PDPI provides it, otherwise with SharedValueHeap::get if the PDPI
+     * provides sharedValueHeap (), which resolves generational handles
+     * without hashing. Otherwise validates the handle with isValidHandle<T>
+     * and uses it as a pointer to a ShareVec<T>.
+     *
+     * The syscalls operate on ShareVec<T>, i.e. on vectors with the
+     * share_allocator of T. Vectors of the same value type with another
+     * allocator, e.g. a MappedShareVec<T> if T does not select
+     * MappedFileAllocator, are never resolved and the syscalls fail on them.
+     */
+    template <typename T, typename P>
+    static auto resolveHandle (P * pdpi, void * handle, int)
+            -> decltype (pdpi->template resolveHandle<T>(handle))
+    { return pdpi->template resolveHandle<T>(handle); }
+
+    template <typename T, typename P>
+    static ShareVec<T>* resolveHandle (P * pdpi, void * handle, long)
+    { return resolveHeapHandle<T, P>(pdpi, handle, 0); }
+
+    template <typename T, typename P>
+    static auto resolveHeapHandle (P * pdpi, void * handle, int)
+            -> decltype (pdpi->sharedValueHeap ().template get<T>(handle))
+    { return pdpi->sharedValueHeap ().template get<T>(handle); }
+
+    template <typename T, typename P>
+    static ShareVec<T>* resolveHeapHandle (P * pdpi, void * handle, long) {
+        /* isValidHandle may check the value type only, not the allocator: */
+        return pdpi->template isValidHandle<T>(handle)
+               ? dynamic_cast<ShareVec<T>*>(static_cast<ShareVecBase*>(handle))
+               : nullptr;
+    }
+
+    template <typename T>
+    static ShareVec<T>* resolveHandle (PdpiType * pdpi, void * handle)
+    { return resolveHandle<T, PdpiType>(pdpi, handle, 0); }
+
+    /*
+     * Lets the PDPI account for the storage of an output vector after the
+     * protocol has resized it, e.g. through SharedValueHeap::update_usage,
+     * if it provides updateHandleUsage. Throws std::bad_alloc past a quota.
+     */
+    template <typename P>
+    static auto updateUsage (P * pdpi, void * handle, int)
+            -> decltype (pdpi->updateHandleUsage (handle), void ())
+    { pdpi->updateHandleUsage (handle); }
+
+    template <typename P>
+    static void updateUsage (P *, void *, long) {}
+
+    /*
+     * Lets the PDPI fail before the protocol runs if an output vector of
+     * \a size elements would exceed a quota, e.g. through
+     * SharedValueHeap::check_usage, if it provides checkHandleUsage. Throws
+     * std::bad_alloc then. Without it quotas are enforced only afterwards by
+     * updateUsage.
+     */
+    template <typename T, typename P>
+    static auto checkUsage (P * pdpi, void * handle, std::size_t size, int)
+            -> decltype (pdpi->checkHandleUsage (handle, std::size_t ()), void ())
+    { pdpi->checkHandleUsage (handle, ShareVec<T>::bytes_for (size)); }
+
+    template <typename T, typename P>
+    static void checkUsage (P *, void *, std::size_t, long) {}
+
+    template <typename T>
+    static void checkUsage (PdpiType * pdpi, void * handle, std::size_t size)
+    { checkUsage<T, PdpiType>(pdpi, handle, size, 0); }
+
 };
 
 } /* namespace sharemind */
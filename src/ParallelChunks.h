@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_PARALLELCHUNKS_H
+#define SHAREMIND_PDKHEADERS_PARALLELCHUNKS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "ShareVector.h"
+
+
+namespace sharemind {
+
+/**
+ * \brief Thread pool executing numbered chunks of work.
+ * The chunks of a job are initially split into contiguous ranges, one per
+ * participating thread (the workers and the calling thread). A thread that
+ * runs out of its own chunks steals the remaining chunks of other threads.
+ * Calls from within a job run serially on the calling thread.
+ */
+class __attribute__ ((visibility("internal"))) ChunkThreadPool {
+
+private: /* Types: */
+
+    static constexpr std::size_t cacheLine = 64u;
+
+    /* Ranges of different threads are on different cache lines: */
+    struct Range {
+        std::atomic<std::size_t> next;
+        std::size_t end;
+        char padding[cacheLine - sizeof(std::atomic<std::size_t>) - sizeof(std::size_t)];
+    };
+    static_assert(sizeof(Range) == cacheLine, "Range does not fill a cache line.");
+    static_assert(std::is_trivially_destructible<Range>::value, "Ranges are never destroyed.");
+
+    using Invoker = void (*)(void * context, std::size_t chunk);
+
+public: /* Methods: */
+
+    /**
+     * \param[in] numWorkers Number of worker threads, the thread calling
+     *                       run() participates as well.
+     */
+    explicit ChunkThreadPool(std::size_t const numWorkers = defaultNumWorkers())
+        : m_rangeStorage(new char[(numWorkers + 1u) * sizeof(Range) + cacheLine - 1u])
+        , m_ranges(alignRanges(m_rangeStorage.get()))
+        , m_numParticipants(numWorkers + 1u)
+    {
+        for (std::size_t i = 0u; i < m_numParticipants; ++i)
+            new (&m_ranges[i]) Range();
+        m_workers.reserve(numWorkers);
+        try {
+            for (std::size_t i = 1u; i <= numWorkers; ++i)
+                m_workers.emplace_back(&ChunkThreadPool::workerMain, this, i);
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    ChunkThreadPool(const ChunkThreadPool &) = delete;
+    ChunkThreadPool & operator=(const ChunkThreadPool &) = delete;
+
+    ~ChunkThreadPool() noexcept { stop(); }
+
+    /** \returns the number of threads executing a job. */
+    std::size_t concurrency() const noexcept { return m_numParticipants; }
+
+    /**
+     * Calls \a f (i) for every i in [0, numChunks) and waits for completion.
+     * \throws the first exception thrown by \a f, after all threads are done.
+     */
+    template <typename F>
+    void run(std::size_t const numChunks, F && f) {
+        if (numChunks == 0u)
+            return;
+
+        if (numChunks == 1u || m_numParticipants == 1u || inJob()) {
+            for (std::size_t i = 0u; i < numChunks; ++i)
+                f(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> const runGuard(m_runMutex);
+        m_context = const_cast<void *>(static_cast<const void *>(std::addressof(f)));
+        m_invoke = [](void * context, std::size_t chunk)
+                   { (*static_cast<typename std::remove_reference<F>::type *>(context))(chunk); };
+        for (std::size_t i = 0u; i < m_numParticipants; ++i) {
+            m_ranges[i].next.store(numChunks * i / m_numParticipants, std::memory_order_relaxed);
+            m_ranges[i].end = numChunks * (i + 1u) / m_numParticipants;
+        }
+        m_failed.store(false, std::memory_order_relaxed);
+        m_error = nullptr;
+
+        {
+            std::lock_guard<std::mutex> const guard(m_mutex);
+            m_active = m_numParticipants - 1u;
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        participate(0u);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_active == 0u; });
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+    /** \returns the pool shared by the PDK helpers of this module. */
+    static ChunkThreadPool & global() {
+        static ChunkThreadPool pool;
+        return pool;
+    }
+
+    static std::size_t defaultNumWorkers() noexcept {
+        unsigned const n = std::thread::hardware_concurrency();
+        return n > 1u ? n - 1u : 0u;
+    }
+
+private: /* Methods: */
+
+    /* new[] does not align to cache lines before C++17. */
+    static Range * alignRanges(char * const storage) noexcept {
+        std::uintptr_t const p = reinterpret_cast<std::uintptr_t>(storage);
+        return reinterpret_cast<Range *>((p + (cacheLine - 1u)) & ~std::uintptr_t(cacheLine - 1u));
+    }
+
+    static bool & inJob() noexcept {
+        static thread_local bool r = false;
+        return r;
+    }
+
+    void workerMain(std::size_t const self) {
+        std::uint64_t seen = 0u;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this, seen] { return m_stop || m_generation != seen; });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+            }
+
+            participate(self);
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> const guard(m_mutex);
+                last = (--m_active == 0u);
+            }
+            if (last)
+                m_done.notify_one();
+        }
+    }
+
+    void participate(std::size_t const self) noexcept {
+        inJob() = true;
+        for (std::size_t k = 0u; k < m_numParticipants; ++k) {
+            Range & range = m_ranges[(self + k) % m_numParticipants];
+            for (;;) {
+                if (m_failed.load(std::memory_order_relaxed))
+                    break;
+                std::size_t const chunk = range.next.fetch_add(1u, std::memory_order_relaxed);
+                if (chunk >= range.end)
+                    break;
+                try {
+                    m_invoke(m_context, chunk);
+                } catch (...) {
+                    std::lock_guard<std::mutex> const guard(m_mutex);
+                    if (!m_error)
+                        m_error = std::current_exception();
+                    m_failed.store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+        inJob() = false;
+    }
+
+    void stop() noexcept {
+        {
+            std::lock_guard<std::mutex> const guard(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread & t : m_workers)
+            t.join();
+        m_workers.clear();
+    }
+
+private: /* Fields: */
+
+    std::unique_ptr<char[]> m_rangeStorage;
+    Range * const m_ranges;
+    std::size_t const m_numParticipants;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_runMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::uint64_t m_generation = 0u;
+    std::size_t m_active = 0u;
+    bool m_stop = false;
+
+    void * m_context = nullptr;
+    Invoker m_invoke = nullptr;
+    std::atomic<bool> m_failed{false};
+    std::exception_ptr m_error;
+
+}; /* class ChunkThreadPool { */
+
+namespace detail {
+
+/* Rounds grain up to a nonzero multiple of \a multiple, without overflowing. */
+inline std::size_t roundChunkGrain(std::size_t const grain, std::size_t const multiple) noexcept {
+    std::size_t const maxGrain = SIZE_MAX / multiple * multiple;
+    if (grain > maxGrain)
+        return maxGrain;
+    std::size_t const r = grain % multiple;
+    return grain == 0u ? multiple : (r == 0u ? grain : grain + (multiple - r));
+}
+
+} /* namespace detail */
+
+/**
+ * Splits [0, size) into chunks of \a grain elements and calls
+ * \a f (begin, end) for each chunk on the threads of \a pool. The chunk
+ * boundaries depend only on \a size and \a grain, hence results computed per
+ * chunk are independent of the number of threads.
+ */
+template <typename F>
+void parallel_for_chunks(ChunkThreadPool & pool,
+                         std::size_t const size,
+                         std::size_t grain,
+                         F && f)
+{
+    if (grain == 0u)
+        grain = 1u;
+    std::size_t const numChunks = size / grain + (size % grain != 0u);
+    pool.run(numChunks, [&f, size, grain] (std::size_t const chunk) {
+        std::size_t const begin = chunk * grain;
+        std::size_t const end = (size - begin < grain) ? size : begin + grain;
+        f(begin, end);
+    });
+}
+
+template <typename F>
+inline void parallel_for_chunks(std::size_t const size, std::size_t const grain, F && f)
+{ parallel_for_chunks(ChunkThreadPool::global(), size, grain, std::forward<F>(f)); }
+
+/**
+ * Calls \a f (begin, end) for chunks of element indices of a share vector.
+ * The grain is rounded up so that every chunk boundary lies a multiple of 64
+ * bytes past data(), chunks of vectors with cache line aligned storage (see
+ * AlignedShareAllocator) thus never share a cache line.
+ */
+template <typename T, typename A, typename F>
+inline void parallel_for_chunks(ShareVec<T, A> & vec, std::size_t const grain, F && f) {
+    using elementBytes = std::integral_constant<std::size_t, sizeof(typename ShareVec<T, A>::value_type)>;
+    /* The least number of elements spanning a multiple of 64 bytes: */
+    std::size_t lineElements = 64u;
+    while (lineElements % 2u == 0u && (lineElements / 2u) * elementBytes::value % 64u == 0u)
+        lineElements /= 2u;
+    parallel_for_chunks(vec.size(), detail::roundChunkGrain(grain, lineElements), std::forward<F>(f));
+}
+
+/**
+ * Calls \a f (begin, end) for chunks of bit indices of a bit share vector.
+ * The grain is rounded up to whole blocks, so chunks never share a block
+ * and may be written concurrently.
+ */
+template <typename B, typename F>
+inline void parallel_for_chunks(BitShareVec<B> & vec, std::size_t const grain, F && f) {
+    parallel_for_chunks(vec.size(),
+                        detail::roundChunkGrain(grain, BitShareVec<B>::bits_per_block),
+                        std::forward<F>(f));
+}
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_PARALLELCHUNKS_H */
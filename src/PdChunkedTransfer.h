@@ -0,0 +1,104 @@
+/*
+ * This file is a part of the Sharemind framework.
+ * Copyright (C) Cybernetica AS
+ *
+ * All rights are reserved. Reproduction in whole or part is prohibited
+ * without the written consent of the copyright owner. The usage of this
+ * code is subject to the appropriate license agreement.
+ */
+
+
+#ifndef SHAREMIND_PDKHEADERS_PDCHUNKEDTRANSFER_H
+#define SHAREMIND_PDKHEADERS_PDCHUNKEDTRANSFER_H
+
+#include <cassert>
+#include <cstddef>
+#include "libpd.h"
+#include "PdIncomingMessage.h"
+#include "PdOutgoingMessage.h"
+#include "ShareVector.h"
+
+
+/**
+ * Streaming transfer of large share vectors. The sender splits a vector into
+ * chunks and sends every chunk as a separate message, the receiver fills the
+ * vector one chunk at a time and can process chunk k while chunk k + 1 is
+ * still being received. Both parties must use the same vector size and
+ * chunk size.
+ */
+
+namespace sharemind {
+
+/** Default size of a chunk in bytes. */
+constexpr std::size_t defaultTransferChunkBytes = 1u << 20u;
+
+/** \returns the number of shares of type T in a chunk of \a chunkBytes bytes. */
+template <typename T>
+constexpr std::size_t transferChunkSize(std::size_t const chunkBytes = defaultTransferChunkBytes) noexcept {
+    return chunkBytes / sizeof(typename ValueTraits<T>::share_type) > 0u
+           ? chunkBytes / sizeof(typename ValueTraits<T>::share_type)
+           : 1u;
+}
+
+/**
+ * Sends the vector in messages of at most \a chunkSize shares. The shares
+ * are referenced by the messages and not copied into them if \a gather, the
+ * gathering send facility of the PDPI, is given.
+ * \returns false if sending any of the chunks failed.
+ */
+template <typename T, typename Allocator>
+bool sendChunked(SharemindNode & destination,
+                 const ShareVec<T, Allocator> & vec,
+                 std::size_t const chunkSize = transferChunkSize<T>(),
+                 const SharemindNodeGatherFacility * const gather = nullptr)
+{
+    assert(chunkSize > 0u);
+    for (std::size_t begin = 0u; begin < vec.size(); begin += chunkSize) {
+        std::size_t const end = (vec.size() - begin < chunkSize) ? vec.size() : begin + chunkSize;
+        PdOutgoingMessage msg(destination, gather);
+        vec.serialize_range_zero_copy(msg, begin, end);
+        if (!msg.send())
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Receives a vector sent by sendChunked() into \a vec, which must already
+ * have the size of the sent vector. After each chunk is stored
+ * \a onChunk (begin, end) is called with the range of received shares.
+ * \returns false if receiving any of the chunks failed or a chunk did not
+ *          hold exactly the expected number of shares, e.g. as the sender
+ *          used another chunk size. The rest of the vector is not received
+ *          then.
+ */
+template <typename T, typename Allocator, typename OnChunk>
+bool receiveChunked(SharemindNode & source,
+                    ShareVec<T, Allocator> & vec,
+                    std::size_t const chunkSize,
+                    OnChunk && onChunk)
+{
+    assert(chunkSize > 0u);
+    for (std::size_t begin = 0u; begin < vec.size(); begin += chunkSize) {
+        std::size_t const end = (vec.size() - begin < chunkSize) ? vec.size() : begin + chunkSize;
+        SharemindMessage const message = source.receive_message(&source);
+        if (!message.data)
+            return false;
+        PdIncomingMessage msg(message, source);
+        if (message.size != (end - begin) * sizeof(typename ValueTraits<T>::share_type)
+            || !vec.deserialize_range(msg, begin, end))
+            return false;
+        onChunk(begin, end);
+    }
+    return true;
+}
+
+template <typename T, typename Allocator>
+inline bool receiveChunked(SharemindNode & source,
+                           ShareVec<T, Allocator> & vec,
+                           std::size_t const chunkSize = transferChunkSize<T>())
+{ return receiveChunked(source, vec, chunkSize, [] (std::size_t, std::size_t) {}); }
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_PDKHEADERS_PDCHUNKEDTRANSFER_H */
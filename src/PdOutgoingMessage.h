@@ -11,7 +11,10 @@
 #ifndef SHAREMIND_PDKHEADERS_PDOUTGOINGMESSAGE_H
 #define SHAREMIND_PDKHEADERS_PDOUTGOINGMESSAGE_H
 
+#include <cstddef>
 #include <sharemind/NetworkMessage.h>
+#include <type_traits>
+#include <vector>
 #include "libpd.h"
 
 
@@ -19,23 +22,124 @@ namespace sharemind {
 
 class PdOutgoingMessage: public OutgoingNetworkMessage {
 
+private: /* Types: */
+
+    /**
+     * A part of the message. Referenced segments point to external memory,
+     * the others to the range [offset, offset + size) of the own buffer,
+     * which may still move while the message is being written.
+     */
+    struct Segment {
+        const void * ref;
+        size_t offset;
+        size_t size;
+    };
+
 public: /* Methods: */
 
-    PdOutgoingMessage(SharemindNode & destination)
-        : m_destination(destination) {}
+    /**
+     * \param[in] gather The gathering send facility of the PDPI, see
+     *                   SHAREMIND_NODE_GATHER_FACILITY_NAME, or null if the
+     *                   miner does not provide it.
+     */
+    PdOutgoingMessage(SharemindNode & destination,
+                      const SharemindNodeGatherFacility * const gather = nullptr)
+        : m_destination(destination)
+        , m_gather(canGather(gather) ? gather : nullptr) {}
+
+    /**
+     * Appends \a n elements of \a array to the message by reference instead
+     * of copying them to the message buffer.
+     * \pre The array must not be modified or deallocated before send()
+     *      returns.
+     */
+    template <typename T>
+    void writeArrayRef(const T * const array, size_t const n) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "Only trivially copyable types can be referenced.");
+        if (n == 0u)
+            return;
+        flushBuffered();
+        Segment const segment = { array, 0u, n * sizeof(T) };
+        m_segments.push_back(segment);
+    }
 
+    /** \returns the total size of the message, including referenced data. */
+    size_t totalSize() const noexcept {
+        size_t r = size - m_buffered;
+        for (const Segment & segment : m_segments)
+            r += segment.size;
+        return r;
+    }
+
+    /**
+     * Sends the message. Referenced data is handed to the network as separate
+     * segments if a gathering send facility was given, otherwise it is
+     * copied.
+     * \bug Messages are sent without the header, the miner constructs a new
+     *      message with the header and copies the data to it unless the
+     *      message is sent in segments.
+     */
     bool send() const {
-        /** \bug Currently we send pure data without the header. As a result the
-                 miner will construct a new message with required header and
-                 COPY (!!!) the data over to that message before sending.
-                 Refactor this to remove the extra copying of sent data. */
-        return m_destination.send_message(&m_destination, { data, size })
+        if (m_segments.empty())
+            return m_destination.send_message(&m_destination, { data, size })
+                   == SHAREMIND_NETWORK_OK;
+
+        std::vector<SharemindMessage> parts;
+        parts.reserve(m_segments.size() + 1u);
+        for (const Segment & segment : m_segments)
+            parts.push_back({ segment.ref
+                              ? segment.ref
+                              : static_cast<const char *>(data) + segment.offset,
+                              segment.size });
+        if (size != m_buffered)
+            parts.push_back({ static_cast<const char *>(data) + m_buffered,
+                              size - m_buffered });
+
+        if (m_gather)
+            return m_gather->send_message_v(m_gather,
+                                            &m_destination,
+                                            parts.data(),
+                                            parts.size())
+                   == SHAREMIND_NETWORK_OK;
+
+        /* The network can not gather, concatenate the segments here: */
+        std::vector<char> whole;
+        whole.reserve(totalSize());
+        for (const SharemindMessage & part : parts) {
+            const char * const first = static_cast<const char *>(part.data);
+            whole.insert(whole.end(), first, first + part.size);
+        }
+        return m_destination.send_message(&m_destination, { whole.data(), whole.size() })
                == SHAREMIND_NETWORK_OK;
     }
 
+private: /* Methods: */
+
+    /* Checks that the miner's facility is recent enough to have send_message_v. */
+    static bool canGather(const SharemindNodeGatherFacility * const gather) noexcept {
+        return gather
+               && gather->version >= 1u
+               && gather->size >= offsetof(SharemindNodeGatherFacility, send_message_v)
+                                  + sizeof(gather->send_message_v)
+               && gather->send_message_v;
+    }
+
+    /* Turns the data written to the buffer since the last reference into a segment. */
+    void flushBuffered() {
+        if (size != m_buffered) {
+            Segment const segment = { nullptr, m_buffered, size - m_buffered };
+            m_segments.push_back(segment);
+            m_buffered = size;
+        }
+    }
+
 private: /* Fields: */
 
     SharemindNode & m_destination; /**< Destination node: */
+    const SharemindNodeGatherFacility * const m_gather;
+    std::vector<Segment> m_segments;
+    size_t m_buffered = 0u; /**< Size of the buffer covered by m_segments. */
 };
 
 } /* namespace sharemind { */
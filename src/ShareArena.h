@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_SHAREARENA_H
+#define SHAREMIND_PDKHEADERS_SHAREARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+
+namespace sharemind {
+
+/**
+ * \brief Memory arena for short-lived share vectors.
+ * Memory is carved out of large chunks and freed blocks are kept on size
+ * class free lists for reuse. All memory is returned to the system at once
+ * when the arena is released or destroyed, hence an arena is intended to be
+ * owned by a PDPI and to live exactly as long as the PDPI does, see
+ * PdpiShareArena. The arena counts its live blocks and refuses to be released
+ * while any block is still allocated.
+ * \warning The arena is not thread-safe.
+ */
+class __attribute__ ((visibility("internal"))) ShareArena {
+
+public: /* Constants: */
+
+    /** Alignment of all blocks returned by the arena. */
+    static constexpr std::size_t alignment = 64u;
+
+private: /* Types: */
+
+    struct ChunkHeader {
+        ChunkHeader * prev;
+        ChunkHeader * next;
+        std::size_t size;
+    };
+
+    struct FreeBlock {
+        FreeBlock * next;
+    };
+
+    static constexpr std::size_t headerSize = alignment;
+    static constexpr std::size_t minClassLog = 6u;
+    static constexpr std::size_t numClasses = 32u;
+
+    static_assert(sizeof(ChunkHeader) <= headerSize, "Chunk header too large.");
+
+public: /* Methods: */
+
+    /**
+     * \param[in] chunkSize Size of the chunks memory is carved from. Blocks
+     *                      larger than a quarter of the chunk size get a
+     *                      dedicated chunk which is returned to the system as
+     *                      soon as the block is deallocated.
+     */
+    explicit ShareArena(std::size_t const chunkSize = 4u * 1024u * 1024u)
+        : m_chunkSize(roundUp(chunkSize < 4096u ? 4096u : chunkSize))
+        , m_maxPooledSize(m_chunkSize / 4u)
+    {
+        for (FreeBlock * & f : m_freeLists)
+            f = nullptr;
+    }
+
+    ShareArena(const ShareArena &) = delete;
+    ShareArena & operator=(const ShareArena &) = delete;
+
+    /** \pre No block allocated from the arena is live. */
+    ~ShareArena() noexcept {
+        assert(m_liveBlocks == 0u);
+        release_abandoned();
+    }
+
+    /**
+     * Allocates a block of at least \a bytes bytes aligned to \a alignment.
+     * \throws std::bad_alloc on allocation failure.
+     */
+    void * allocate(std::size_t const bytes) {
+        if (bytes > m_maxPooledSize) {
+            char * const r = newChunk(bytes) + headerSize;
+            ++m_liveBlocks;
+            return r;
+        }
+
+        std::size_t const cls = sizeClass(bytes);
+        if (FreeBlock * const block = m_freeLists[cls]) {
+            m_freeLists[cls] = block->next;
+            ++m_liveBlocks;
+            return block;
+        }
+
+        std::size_t const blockSize = std::size_t(1u) << (cls + minClassLog);
+        if (m_bumpEnd - m_bump < static_cast<std::ptrdiff_t>(blockSize)) {
+            m_bump = newChunk(m_chunkSize - headerSize) + headerSize;
+            m_bumpEnd = m_bump + (m_chunkSize - headerSize);
+        }
+        void * const r = m_bump;
+        m_bump += blockSize;
+        ++m_liveBlocks;
+        return r;
+    }
+
+    /**
+     * Returns a block to the arena.
+     * \param[in] ptr Pointer previously returned by allocate().
+     * \param[in] bytes The size given to allocate().
+     */
+    void deallocate(void * const ptr, std::size_t const bytes) noexcept {
+        if (!ptr)
+            return;
+
+        assert(m_liveBlocks > 0u);
+        --m_liveBlocks;
+        if (bytes > m_maxPooledSize) {
+            freeChunk(reinterpret_cast<ChunkHeader *>(
+                          static_cast<char *>(ptr) - headerSize));
+            return;
+        }
+
+        std::size_t const cls = sizeClass(bytes);
+        FreeBlock * const block = static_cast<FreeBlock *>(ptr);
+        block->next = m_freeLists[cls];
+        m_freeLists[cls] = block;
+    }
+
+    /**
+     * Returns all memory held by the arena to the system in one step.
+     * \retval false If blocks allocated from the arena are still live, the
+     *               arena is left intact then.
+     */
+    bool release() noexcept {
+        if (m_liveBlocks != 0u)
+            return false;
+        release_abandoned();
+        return true;
+    }
+
+    /**
+     * Returns all memory held by the arena to the system in one step, even if
+     * blocks are still live.
+     * \warning Invalidates every block allocated from the arena. Only for
+     *          owners which guarantee that the live blocks are never accessed
+     *          nor deallocated afterwards, e.g. by skipping the destructors of
+     *          objects stored in the arena.
+     */
+    void release_abandoned() noexcept {
+        while (m_chunks)
+            freeChunk(m_chunks);
+        for (FreeBlock * & f : m_freeLists)
+            f = nullptr;
+        m_bump = m_bumpEnd = nullptr;
+        m_liveBlocks = 0u;
+    }
+
+    /** \returns the number of bytes currently reserved from the system. */
+    std::size_t reservedBytes() const noexcept { return m_reservedBytes; }
+
+    /** \returns the number of blocks allocated and not yet deallocated. */
+    std::size_t liveBlocks() const noexcept { return m_liveBlocks; }
+
+    friend bool operator==(const ShareArena & x, const ShareArena & y) noexcept
+    { return &x == &y; }
+
+    friend bool operator!=(const ShareArena & x, const ShareArena & y) noexcept
+    { return &x != &y; }
+
+private: /* Methods: */
+
+    static std::size_t roundUp(std::size_t const bytes) noexcept
+    { return (bytes + (alignment - 1u)) & ~(alignment - 1u); }
+
+    static std::size_t sizeClass(std::size_t const bytes) noexcept {
+        std::size_t cls = 0u;
+        while ((std::size_t(1u) << (cls + minClassLog)) < bytes)
+            ++cls;
+        assert(cls < numClasses);
+        return cls;
+    }
+
+    char * newChunk(std::size_t const payloadSize) {
+        if (payloadSize > std::numeric_limits<std::size_t>::max() - 2u * headerSize)
+            throw std::bad_alloc();
+
+        std::size_t const size = headerSize + roundUp(payloadSize);
+        void * mem;
+        if (posix_memalign(&mem, alignment, size) != 0)
+            throw std::bad_alloc();
+
+        ChunkHeader * const chunk = static_cast<ChunkHeader *>(mem);
+        chunk->prev = nullptr;
+        chunk->next = m_chunks;
+        chunk->size = size;
+        if (m_chunks)
+            m_chunks->prev = chunk;
+        m_chunks = chunk;
+        m_reservedBytes += size;
+        return static_cast<char *>(mem);
+    }
+
+    void freeChunk(ChunkHeader * const chunk) noexcept {
+        if (chunk->prev)
+            chunk->prev->next = chunk->next;
+        else
+            m_chunks = chunk->next;
+        if (chunk->next)
+            chunk->next->prev = chunk->prev;
+        m_reservedBytes -= chunk->size;
+        std::free(chunk);
+    }
+
+private: /* Fields: */
+
+    std::size_t const m_chunkSize;
+    std::size_t const m_maxPooledSize;
+    ChunkHeader * m_chunks = nullptr;
+    char * m_bump = nullptr;
+    char * m_bumpEnd = nullptr;
+    std::size_t m_reservedBytes = 0u;
+    std::size_t m_liveBlocks = 0u;
+    FreeBlock * m_freeLists[numClasses];
+
+}; /* class ShareArena { */
+
+/**
+ * \brief Standard allocator drawing memory from a ShareArena.
+ * \code
+ * using TempVec = ShareVec<T, ShareArenaAllocator<typename T::share_type> >;
+ * TempVec tmp (n, {}, pdpi.arena ());
+ * \endcode
+ */
+template <typename T>
+class __attribute__ ((visibility("internal"))) ShareArenaAllocator {
+
+    template <typename U> friend class ShareArenaAllocator;
+
+public: /* Types: */
+
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind { using other = ShareArenaAllocator<U>; };
+
+public: /* Methods: */
+
+    ShareArenaAllocator(ShareArena & arena) noexcept
+        : m_arena(&arena)
+    { }
+
+    template <typename U>
+    ShareArenaAllocator(const ShareArenaAllocator<U> & other) noexcept
+        : m_arena(other.m_arena)
+    { }
+
+    T * allocate(std::size_t const n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T *>(m_arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T * const ptr, std::size_t const n) noexcept
+    { m_arena->deallocate(ptr, n * sizeof(T)); }
+
+    ShareArena & arena() const noexcept { return *m_arena; }
+
+    template <typename U>
+    friend bool operator==(const ShareArenaAllocator & x,
+                           const ShareArenaAllocator<U> & y) noexcept
+    { return x.m_arena == y.m_arena; }
+
+    template <typename U>
+    friend bool operator!=(const ShareArenaAllocator & x,
+                           const ShareArenaAllocator<U> & y) noexcept
+    { return x.m_arena != y.m_arena; }
+
+private: /* Fields: */
+
+    ShareArena * m_arena;
+
+}; /* class ShareArenaAllocator { */
+
+/**
+ * \brief The ShareArena of a PDPI.
+ * A protection domain keeps one instance per PDPI, hands allocator() out to
+ * the protocols for their temporaries, and calls pdpi_stopped() from its PDPI
+ * shutdown handler, which returns all arena memory to the system at once.
+ * \code
+ * struct MyPdpi {
+ *     PdpiShareArena m_arena;
+ *     ...
+ * };
+ * ShareVec<T, ShareArenaAllocator<S> > tmp (n, no_init, pdpi.m_arena.allocator<S> ());
+ * ...
+ * void MyPdpi::stop () { m_arena.pdpi_stopped (); }
+ * \endcode
+ */
+class __attribute__ ((visibility("internal"))) PdpiShareArena {
+
+public: /* Methods: */
+
+    explicit PdpiShareArena(std::size_t const chunkSize = 4u * 1024u * 1024u)
+        : m_arena(chunkSize)
+    { }
+
+    PdpiShareArena(const PdpiShareArena &) = delete;
+    PdpiShareArena & operator=(const PdpiShareArena &) = delete;
+
+    ShareArena & arena() noexcept { return m_arena; }
+
+    template <typename T>
+    ShareArenaAllocator<T> allocator() noexcept
+    { return ShareArenaAllocator<T>(m_arena); }
+
+    /**
+     * Releases the memory of the arena at the end of the PDPI.
+     * \retval false If temporaries allocated from the arena are still live,
+     *               which is a bug in the protocol holding them. The memory is
+     *               kept then, so the temporaries stay valid, and is released
+     *               by a later call once they have been destroyed.
+     */
+    bool pdpi_stopped() noexcept { return m_arena.release(); }
+
+private: /* Fields: */
+
+    ShareArena m_arena;
+
+}; /* class PdpiShareArena { */
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_SHAREARENA_H */
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_SHAREPERMUTATION_H
+#define SHAREMIND_PDKHEADERS_SHAREPERMUTATION_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ParallelChunks.h"
+#include "ShareVector.h"
+
+
+/**
+ * Gather, scatter and permutation of share vectors by public indices. The
+ * random accesses are software prefetched a fixed distance ahead and large
+ * inputs are split into chunks processed on the ChunkThreadPool, every chunk
+ * writing a disjoint part of the output.
+ */
+
+namespace sharemind {
+namespace detail {
+
+/* Number of elements processed per parallel chunk. */
+constexpr std::size_t permutationGrain = 16384u;
+
+/* Number of elements the random accesses are prefetched ahead. */
+constexpr std::size_t prefetchDistance = 16u;
+
+template <typename S, typename Index>
+inline void gatherRange(S * const out,
+                        const S * const in,
+                        const Index * const indices,
+                        std::size_t const begin,
+                        std::size_t const end) noexcept
+{
+    std::size_t i = begin;
+    for (; i + prefetchDistance < end; ++i) {
+        __builtin_prefetch(in + indices[i + prefetchDistance], 0, 0);
+        out[i] = in[indices[i]];
+    }
+    for (; i < end; ++i)
+        out[i] = in[indices[i]];
+}
+
+template <typename S, typename Index>
+inline void scatterRange(S * const out,
+                         const S * const in,
+                         const Index * const indices,
+                         std::size_t const begin,
+                         std::size_t const end) noexcept
+{
+    std::size_t i = begin;
+    for (; i + prefetchDistance < end; ++i) {
+        __builtin_prefetch(out + indices[i + prefetchDistance], 1, 0);
+        out[indices[i]] = in[i];
+    }
+    for (; i < end; ++i)
+        out[indices[i]] = in[i];
+}
+
+template <typename Index>
+inline bool indicesInRange(const Index * const indices,
+                           std::size_t const n,
+                           std::size_t const limit) noexcept
+{
+    for (std::size_t i = 0u; i < n; ++i)
+        if (static_cast<std::size_t>(indices[i]) >= limit)
+            return false;
+    return true;
+}
+
+} /* namespace detail { */
+
+/**
+ * Computes the inverse of the permutation \a perm of \a n elements, i.e.
+ * inv[perm[i]] = i.
+ */
+template <typename Index>
+void inverse_permutation(Index * const inv, const Index * const perm, std::size_t const n) {
+    static_assert(std::is_integral<Index>::value, "Indices must be integers.");
+    assert(detail::indicesInRange(perm, n, n));
+    parallel_for_chunks(n, detail::permutationGrain,
+                        [inv, perm] (std::size_t const begin, std::size_t const end) {
+        std::size_t i = begin;
+        for (; i + detail::prefetchDistance < end; ++i) {
+            __builtin_prefetch(inv + perm[i + detail::prefetchDistance], 1, 0);
+            inv[perm[i]] = static_cast<Index>(i);
+        }
+        for (; i < end; ++i)
+            inv[perm[i]] = static_cast<Index>(i);
+    });
+}
+
+template <typename Index, typename IndexAllocator>
+inline std::vector<Index, IndexAllocator> inverse_permutation(const std::vector<Index, IndexAllocator> & perm) {
+    std::vector<Index, IndexAllocator> inv(perm.size(), Index(), perm.get_allocator());
+    inverse_permutation(inv.data(), perm.data(), perm.size());
+    return inv;
+}
+
+/**
+ * Sets out[i] = in[indices[i]] for i in [0, n), \a out is resized to \a n.
+ */
+template <typename T, typename A1, typename A2, typename Index>
+void gather(ShareVec<T, A1> & out,
+            const ShareVec<T, A2> & in,
+            const Index * const indices,
+            std::size_t const n)
+{
+    static_assert(std::is_integral<Index>::value, "Indices must be integers.");
+    assert(detail::indicesInRange(indices, n, in.size()));
+    assert(static_cast<const void *>(&out) != static_cast<const void *>(&in));
+    using S = typename T::share_type;
+    out.resize_uninitialized(n);
+    S * const o = out.data();
+    const S * const i = in.data();
+    parallel_for_chunks(n, detail::permutationGrain,
+                        [o, i, indices] (std::size_t const begin, std::size_t const end)
+                        { detail::gatherRange(o, i, indices, begin, end); });
+}
+
+/**
+ * Sets out[indices[i]] = in[i] for every element of \a in.
+ * \pre \a out must be large enough and the indices must be distinct.
+ */
+template <typename T, typename A1, typename A2, typename Index>
+void scatter(ShareVec<T, A1> & out,
+             const ShareVec<T, A2> & in,
+             const Index * const indices)
+{
+    static_assert(std::is_integral<Index>::value, "Indices must be integers.");
+    assert(detail::indicesInRange(indices, in.size(), out.size()));
+    assert(static_cast<const void *>(&out) != static_cast<const void *>(&in));
+    using S = typename T::share_type;
+    S * const o = out.data();
+    const S * const i = in.data();
+    parallel_for_chunks(in.size(), detail::permutationGrain,
+                        [o, i, indices] (std::size_t const begin, std::size_t const end)
+                        { detail::scatterRange(o, i, indices, begin, end); });
+}
+
+/**
+ * Sets out[i] = in[perm[i]], \a perm must be a permutation of in.size ()
+ * elements.
+ */
+template <typename T, typename A1, typename A2, typename Index>
+inline void apply_permutation(ShareVec<T, A1> & out,
+                              const ShareVec<T, A2> & in,
+                              const Index * const perm)
+{ gather(out, in, perm, in.size()); }
+
+/** Permutes \a vec in place, vec[i] becomes the old vec[perm[i]]. */
+template <typename T, typename A, typename Index>
+inline void apply_permutation(ShareVec<T, A> & vec, const Index * const perm) {
+    ShareVec<T, A> tmp(vec.size(), no_init, vec.get_allocator());
+    gather(tmp, vec, perm, vec.size());
+    swap(tmp, vec);
+}
+
+template <typename T, typename A1, typename A2, typename Index, typename IndexAllocator>
+inline void gather(ShareVec<T, A1> & out,
+                   const ShareVec<T, A2> & in,
+                   const std::vector<Index, IndexAllocator> & indices)
+{ gather(out, in, indices.data(), indices.size()); }
+
+template <typename T, typename A1, typename A2, typename Index, typename IndexAllocator>
+inline void scatter(ShareVec<T, A1> & out,
+                    const ShareVec<T, A2> & in,
+                    const std::vector<Index, IndexAllocator> & indices)
+{
+    assert(indices.size() == in.size());
+    scatter(out, in, indices.data());
+}
+
+template <typename T, typename A1, typename A2, typename Index, typename IndexAllocator>
+inline void apply_permutation(ShareVec<T, A1> & out,
+                              const ShareVec<T, A2> & in,
+                              const std::vector<Index, IndexAllocator> & perm)
+{
+    assert(perm.size() == in.size());
+    apply_permutation(out, in, perm.data());
+}
+
+template <typename T, typename A, typename Index, typename IndexAllocator>
+inline void apply_permutation(ShareVec<T, A> & vec, const std::vector<Index, IndexAllocator> & perm) {
+    assert(perm.size() == vec.size());
+    apply_permutation(vec, perm.data());
+}
+
+/**
+ * Sets bit i of \a out to bit indices[i] of \a in for i in [0, n). Every
+ * chunk assembles whole blocks of the output.
+ */
+template <typename T, typename Index>
+void gather(BitShareVec<T> & out,
+            const BitShareVec<T> & in,
+            const Index * const indices,
+            std::size_t const n)
+{
+    static_assert(std::is_integral<Index>::value, "Indices must be integers.");
+    assert(detail::indicesInRange(indices, n, in.size()));
+    assert(&out != &in);
+    using B = typename BitShareVec<T>::block_type;
+    constexpr std::size_t bits = BitShareVec<T>::bits_per_block;
+    out.resize_uninitialized(n);
+    B * const o = out.blocks();
+    const B * const i = in.blocks();
+    parallel_for_chunks(out, detail::permutationGrain,
+                        [o, i, indices] (std::size_t const begin, std::size_t const end) {
+        for (std::size_t k = begin; k < end; k += bits) {
+            std::size_t const count = (end - k < bits) ? end - k : bits;
+            B word = 0u;
+            for (std::size_t j = 0u; j < count; ++j) {
+                std::size_t const index = static_cast<std::size_t>(indices[k + j]);
+                word |= ((i[index / bits] >> (index % bits)) & 1u) << j;
+            }
+            o[k / bits] = word;
+        }
+    });
+}
+
+/**
+ * Sets bit indices[i] of \a out to bit i of \a in for every bit of \a in.
+ * If \a indices is a permutation of the bits of \a out the bits are gathered
+ * through the inverse permutation in parallel, otherwise they are written
+ * serially as several indices may hit the same block.
+ * \pre \a out must be large enough and the indices must be distinct.
+ */
+template <typename T, typename Index>
+void scatter(BitShareVec<T> & out,
+             const BitShareVec<T> & in,
+             const Index * const indices)
+{
+    static_assert(std::is_integral<Index>::value, "Indices must be integers.");
+    assert(detail::indicesInRange(indices, in.size(), out.size()));
+    assert(&out != &in);
+    if (in.size() == out.size()) {
+        std::vector<Index> inv(in.size());
+        inverse_permutation(inv.data(), indices, in.size());
+        gather(out, in, inv.data(), inv.size());
+        return;
+    }
+
+    using B = typename BitShareVec<T>::block_type;
+    constexpr std::size_t bits = BitShareVec<T>::bits_per_block;
+    B * const o = out.blocks();
+    const B * const i = in.blocks();
+    for (std::size_t k = 0u; k < in.size(); ++k) {
+        std::size_t const index = static_cast<std::size_t>(indices[k]);
+        B const bit = (i[k / bits] >> (k % bits)) & 1u;
+        o[index / bits] = (o[index / bits] & ~(B(1u) << (index % bits))) | (bit << (index % bits));
+    }
+}
+
+template <typename T, typename Index>
+inline void apply_permutation(BitShareVec<T> & out,
+                              const BitShareVec<T> & in,
+                              const Index * const perm)
+{ gather(out, in, perm, in.size()); }
+
+template <typename T, typename Index>
+inline void apply_permutation(BitShareVec<T> & vec, const Index * const perm) {
+    BitShareVec<T> tmp(vec.size(), no_init);
+    gather(tmp, vec, perm, vec.size());
+    swap(tmp, vec);
+}
+
+template <typename T, typename Index, typename IndexAllocator>
+inline void gather(BitShareVec<T> & out,
+                   const BitShareVec<T> & in,
+                   const std::vector<Index, IndexAllocator> & indices)
+{ gather(out, in, indices.data(), indices.size()); }
+
+template <typename T, typename Index, typename IndexAllocator>
+inline void scatter(BitShareVec<T> & out,
+                    const BitShareVec<T> & in,
+                    const std::vector<Index, IndexAllocator> & indices)
+{
+    assert(indices.size() == in.size());
+    scatter(out, in, indices.data());
+}
+
+template <typename T, typename Index, typename IndexAllocator>
+inline void apply_permutation(BitShareVec<T> & out,
+                              const BitShareVec<T> & in,
+                              const std::vector<Index, IndexAllocator> & perm)
+{
+    assert(perm.size() == in.size());
+    apply_permutation(out, in, perm.data());
+}
+
+template <typename T, typename Index, typename IndexAllocator>
+inline void apply_permutation(BitShareVec<T> & vec, const std::vector<Index, IndexAllocator> & perm) {
+    assert(perm.size() == vec.size());
+    apply_permutation(vec, perm.data());
+}
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_PDKHEADERS_SHAREPERMUTATION_H */
@@ -0,0 +1,495 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_SHARERANDOM_H
+#define SHAREMIND_PDKHEADERS_SHARERANDOM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ParallelChunks.h"
+#include "ShareVecKernels.h"
+#include "ShareVector.h"
+
+
+namespace sharemind {
+namespace detail {
+
+#define SHAREMIND_PDKHEADERS_RANDOM_INLINE inline __attribute__ ((always_inline))
+
+template <typename V>
+SHAREMIND_PDKHEADERS_RANDOM_INLINE
+void chachaQuarterRound(V & a, V & b, V & c, V & d) noexcept {
+    a += b; d ^= a; d = (d << 16) | (d >> 16);
+    c += d; b ^= c; b = (b << 12) | (b >> 20);
+    a += b; d ^= a; d = (d << 8) | (d >> 24);
+    c += d; b ^= c; b = (b << 7) | (b >> 25);
+}
+
+/*
+ * Computes the ChaCha20 blocks with the consecutive counters starting from
+ * counter, one block per lane of V, and stores them to out.
+ */
+template <typename V, std::size_t Lanes>
+SHAREMIND_PDKHEADERS_RANDOM_INLINE
+void chachaLanes(const std::uint32_t * const input,
+                 std::uint64_t const counter,
+                 unsigned char * const out) noexcept
+{
+    V x[16u];
+    V init[16u];
+    for (std::size_t w = 0u; w < 16u; ++w)
+        for (std::size_t l = 0u; l < Lanes; ++l)
+            init[w][l] = input[w];
+    for (std::size_t l = 0u; l < Lanes; ++l) {
+        init[12u][l] = static_cast<std::uint32_t>(counter + l);
+        init[13u][l] = static_cast<std::uint32_t>((counter + l) >> 32u);
+    }
+    for (std::size_t w = 0u; w < 16u; ++w)
+        x[w] = init[w];
+
+    for (unsigned i = 0u; i < 10u; ++i) {
+        chachaQuarterRound(x[0u], x[4u], x[ 8u], x[12u]);
+        chachaQuarterRound(x[1u], x[5u], x[ 9u], x[13u]);
+        chachaQuarterRound(x[2u], x[6u], x[10u], x[14u]);
+        chachaQuarterRound(x[3u], x[7u], x[11u], x[15u]);
+        chachaQuarterRound(x[0u], x[5u], x[10u], x[15u]);
+        chachaQuarterRound(x[1u], x[6u], x[11u], x[12u]);
+        chachaQuarterRound(x[2u], x[7u], x[ 8u], x[13u]);
+        chachaQuarterRound(x[3u], x[4u], x[ 9u], x[14u]);
+    }
+
+    for (std::size_t w = 0u; w < 16u; ++w)
+        x[w] += init[w];
+
+    for (std::size_t l = 0u; l < Lanes; ++l) {
+        std::uint32_t block[16u];
+        for (std::size_t w = 0u; w < 16u; ++w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            block[w] = x[w][l];
+#else
+            block[w] = __builtin_bswap32(x[w][l]);
+#endif
+        }
+        std::memcpy(out + l * 64u, block, 64u);
+    }
+}
+
+/* Writes bytes bytes of the key stream starting from block counter. */
+template <std::size_t Lanes>
+SHAREMIND_PDKHEADERS_RANDOM_INLINE
+void chachaLoop(const std::uint32_t * const input,
+                std::uint64_t counter,
+                unsigned char * out,
+                std::size_t bytes) noexcept
+{
+    typedef std::uint32_t V __attribute__ ((vector_size(Lanes * 4u)));
+    constexpr std::size_t step = Lanes * 64u;
+    for (; bytes >= step; bytes -= step, out += step, counter += Lanes)
+        chachaLanes<V, Lanes>(input, counter, out);
+    if (bytes != 0u) {
+        unsigned char tail[step];
+        chachaLanes<V, Lanes>(input, counter, tail);
+        std::memcpy(out, tail, bytes);
+    }
+}
+
+#define SHAREMIND_PDKHEADERS_RANDOM_VARIANT(name, target, lanes) \
+    SHAREMIND_PDKHEADERS_KERNELS_TARGET(target) \
+    inline void chacha ## name(const std::uint32_t * input, std::uint64_t counter, \
+                               unsigned char * out, std::size_t bytes) \
+    { chachaLoop<lanes>(input, counter, out, bytes); }
+
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+SHAREMIND_PDKHEADERS_RANDOM_VARIANT(Avx2, "avx2", 8u)
+SHAREMIND_PDKHEADERS_RANDOM_VARIANT(Avx512, "avx512f", 16u)
+#endif
+
+inline void chachaGeneric(const std::uint32_t * input, std::uint64_t counter,
+                          unsigned char * out, std::size_t bytes)
+{ chachaLoop<4u>(input, counter, out, bytes); }
+
+#undef SHAREMIND_PDKHEADERS_RANDOM_VARIANT
+#undef SHAREMIND_PDKHEADERS_RANDOM_INLINE
+
+inline void chachaStream(const std::uint32_t * input, std::uint64_t counter,
+                         void * out, std::size_t bytes)
+{
+    using Kernel = void (*)(const std::uint32_t *, std::uint64_t, unsigned char *, std::size_t);
+    static Kernel const kernel = [] () -> Kernel {
+        switch (kernels::selectedIsa()) {
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+        case kernels::Isa::Avx512: return &chachaAvx512;
+        case kernels::Isa::Avx2: return &chachaAvx2;
+#endif
+        default: return &chachaGeneric;
+        }
+    }();
+    kernel(input, counter, static_cast<unsigned char *>(out), bytes);
+}
+
+} /* namespace detail { */
+
+/** \brief A memory region to be filled with randomness. */
+struct RandomTarget {
+    void * data;
+    std::size_t bytes;
+};
+
+/**
+ * \brief ChaCha20 random number generator in counter mode.
+ * Every block of the key stream depends only on the key, the stream number
+ * and the block counter, hence large requests are generated in parallel on
+ * the ChunkThreadPool and the output does not depend on the number of
+ * threads. Every fill starts from a new block, so two generators with the
+ * same seed and stream produce the same output for the same sequence of
+ * requests.
+ */
+class __attribute__ ((visibility("internal"))) ChaCha20Rng {
+
+public: /* Constants: */
+
+    static constexpr std::size_t seedSize = 32u;
+
+    /** Requests of at least this many bytes are generated in parallel. */
+    static constexpr std::size_t parallelThreshold = 256u * 1024u;
+
+    /** Number of bytes generated per parallel chunk, a multiple of 64. */
+    static constexpr std::size_t parallelGrain = 64u * 1024u;
+
+public: /* Methods: */
+
+    /**
+     * \param[in] seed The key of seedSize bytes.
+     * \param[in] stream Selects one of independent streams of the key.
+     */
+    explicit ChaCha20Rng(const void * const seed, std::uint64_t const stream = 0u) noexcept
+    { init(seed, stream); }
+
+    /** Seeds the generator from std::random_device. */
+    ChaCha20Rng() {
+        std::random_device device;
+        std::uint32_t seed[seedSize / 4u];
+        for (std::uint32_t & word : seed)
+            word = device();
+        init(seed, 0u);
+        std::memset(seed, 0, sizeof(seed));
+    }
+
+    ~ChaCha20Rng() noexcept { std::memset(m_input, 0, sizeof(m_input)); }
+
+    /** Fills [begin, end) with random bytes, as used by ShareVec::randomize. */
+    template <typename T>
+    void fillBlock(T * const begin, T * const end)
+    { fillBytes(begin, static_cast<std::size_t>(end - begin) * sizeof(T)); }
+
+    void fillBytes(void * const data, std::size_t const bytes) {
+        RandomTarget const target = { data, bytes };
+        fillMany(&target, 1u);
+    }
+
+    /** Fills all the targets with one parallel job. */
+    void fillMany(const RandomTarget * const targets, std::size_t const numTargets)
+    { fillMany(ChunkThreadPool::global(), targets, numTargets); }
+
+    void fillMany(ChunkThreadPool & pool,
+                  const RandomTarget * const targets,
+                  std::size_t const numTargets)
+    {
+        std::size_t total = 0u;
+        for (std::size_t i = 0u; i < numTargets; ++i)
+            total += targets[i].bytes;
+
+        if (total < parallelThreshold || pool.concurrency() == 1u) {
+            fillSerial(targets, numTargets);
+            return;
+        }
+
+        /* Split the targets into work items with known block counters: */
+        struct Item {
+            unsigned char * data;
+            std::size_t bytes;
+            std::uint64_t counter;
+        };
+        std::vector<Item> items;
+        items.reserve(total / parallelGrain + numTargets);
+        for (std::size_t i = 0u; i < numTargets; ++i) {
+            unsigned char * const data = static_cast<unsigned char *>(targets[i].data);
+            for (std::size_t offset = 0u; offset < targets[i].bytes; offset += parallelGrain) {
+                std::size_t const bytes = (targets[i].bytes - offset < parallelGrain)
+                                        ? targets[i].bytes - offset
+                                        : parallelGrain;
+                Item const item = { data + offset, bytes, m_counter + offset / 64u };
+                items.push_back(item);
+            }
+            m_counter += numBlocks(targets[i].bytes);
+        }
+
+        const std::uint32_t * const input = m_input;
+        pool.run(items.size(), [&items, input] (std::size_t const i) {
+            detail::chachaStream(input, items[i].counter, items[i].data, items[i].bytes);
+        });
+    }
+
+    /** Fills the targets on the calling thread only. */
+    void fillSerial(const RandomTarget * const targets, std::size_t const numTargets) noexcept {
+        for (std::size_t i = 0u; i < numTargets; ++i) {
+            detail::chachaStream(m_input, m_counter, targets[i].data, targets[i].bytes);
+            m_counter += numBlocks(targets[i].bytes);
+        }
+    }
+
+    /** \returns the number of blocks generated so far. */
+    std::uint64_t counter() const noexcept { return m_counter; }
+
+private: /* Methods: */
+
+    void init(const void * const seed, std::uint64_t const stream) noexcept {
+        /* "expand 32-byte k" */
+        m_input[0u] = 0x61707865u;
+        m_input[1u] = 0x3320646eu;
+        m_input[2u] = 0x79622d32u;
+        m_input[3u] = 0x6b206574u;
+        const unsigned char * const key = static_cast<const unsigned char *>(seed);
+        for (std::size_t i = 0u; i < 8u; ++i)
+            m_input[4u + i] = load32(key + 4u * i);
+        m_input[12u] = 0u;
+        m_input[13u] = 0u;
+        m_input[14u] = static_cast<std::uint32_t>(stream);
+        m_input[15u] = static_cast<std::uint32_t>(stream >> 32u);
+    }
+
+    static std::uint32_t load32(const unsigned char * const p) noexcept {
+        return std::uint32_t(p[0u])
+             | (std::uint32_t(p[1u]) << 8u)
+             | (std::uint32_t(p[2u]) << 16u)
+             | (std::uint32_t(p[3u]) << 24u);
+    }
+
+    static std::uint64_t numBlocks(std::size_t const bytes) noexcept
+    { return (bytes + 63u) / 64u; }
+
+private: /* Fields: */
+
+    std::uint32_t m_input[16u];
+    std::uint64_t m_counter = 0u;
+
+}; /* class ChaCha20Rng { */
+
+/**
+ * \brief Buffer of randomness pre-generated by a background thread.
+ * The thread keeps up to capacity bytes generated, e.g. while the node waits
+ * on the network. Requests are served from the buffer and any part that is
+ * not yet available is generated directly on the calling threads. Which part
+ * of the output comes from which source depends on timing, hence the pool is
+ * meant for local randomness and not for streams that parties must be able
+ * to reproduce from a shared seed.
+ */
+class __attribute__ ((visibility("internal"))) RandomnessPool {
+
+public: /* Methods: */
+
+    /**
+     * \param[in] seed The key of ChaCha20Rng::seedSize bytes.
+     * \param[in] capacity Maximum number of bytes kept pre-generated.
+     * \param[in] pageSize Unit of background generation in bytes.
+     */
+    RandomnessPool(const void * const seed,
+                   std::size_t const capacity = 16u * 1024u * 1024u,
+                   std::size_t const pageSize = 256u * 1024u)
+        : m_background(seed, 0u)
+        , m_direct(seed, 1u)
+        , m_pageSize(pageSize)
+    {
+        std::size_t const numPages = pageSize ? (capacity + pageSize - 1u) / pageSize : 0u;
+        m_storage.reserve(numPages);
+        m_free.reserve(numPages);
+        for (std::size_t i = 0u; i < numPages; ++i) {
+            m_storage.emplace_back(new unsigned char[pageSize]);
+            m_free.push_back(m_storage.back().get());
+        }
+        if (numPages != 0u)
+            m_thread = std::thread(&RandomnessPool::generatorMain, this);
+    }
+
+    RandomnessPool(const RandomnessPool &) = delete;
+    RandomnessPool & operator=(const RandomnessPool &) = delete;
+
+    ~RandomnessPool() noexcept {
+        {
+            std::lock_guard<std::mutex> const guard(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        if (m_thread.joinable())
+            m_thread.join();
+        for (const std::unique_ptr<unsigned char[]> & page : m_storage)
+            std::memset(page.get(), 0, m_pageSize);
+    }
+
+    template <typename T>
+    void fillBlock(T * const begin, T * const end)
+    { fillBytes(begin, static_cast<std::size_t>(end - begin) * sizeof(T)); }
+
+    void fillBytes(void * const data, std::size_t bytes) {
+        unsigned char * out = static_cast<unsigned char *>(data);
+        std::lock_guard<std::mutex> const consumerGuard(m_consumerMutex);
+        while (bytes != 0u) {
+            if (!m_current) {
+                std::lock_guard<std::mutex> const guard(m_mutex);
+                if (m_ready.empty())
+                    break;
+                m_current = m_ready.front();
+                m_ready.pop_front();
+                m_currentOffset = 0u;
+            }
+            std::size_t const n = (m_pageSize - m_currentOffset < bytes)
+                                ? m_pageSize - m_currentOffset
+                                : bytes;
+            std::memcpy(out, m_current + m_currentOffset, n);
+            std::memset(m_current + m_currentOffset, 0, n);
+            out += n;
+            bytes -= n;
+            m_currentOffset += n;
+            if (m_currentOffset == m_pageSize) {
+                {
+                    std::lock_guard<std::mutex> const guard(m_mutex);
+                    m_free.push_back(m_current);
+                }
+                m_current = nullptr;
+                m_wake.notify_one();
+            }
+        }
+        m_served += static_cast<std::size_t>(out - static_cast<unsigned char *>(data));
+        if (bytes != 0u) {
+            m_direct.fillBytes(out, bytes);
+            m_generated += bytes;
+        }
+    }
+
+    /** \returns the number of bytes currently available pre-generated. */
+    std::size_t available() const {
+        std::lock_guard<std::mutex> const consumerGuard(m_consumerMutex);
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        return m_ready.size() * m_pageSize
+               + (m_current ? m_pageSize - m_currentOffset : 0u);
+    }
+
+    /** \returns the number of bytes served from the pre-generated buffer. */
+    std::size_t servedBytes() const {
+        std::lock_guard<std::mutex> const consumerGuard(m_consumerMutex);
+        return m_served;
+    }
+
+    /** \returns the number of bytes generated on request. */
+    std::size_t generatedBytes() const {
+        std::lock_guard<std::mutex> const consumerGuard(m_consumerMutex);
+        return m_generated;
+    }
+
+private: /* Methods: */
+
+    void generatorMain() {
+        for (;;) {
+            unsigned char * page;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_stop || !m_free.empty(); });
+                if (m_stop)
+                    return;
+                page = m_free.back();
+                m_free.pop_back();
+            }
+            RandomTarget const target = { page, m_pageSize };
+            m_background.fillSerial(&target, 1u);
+            {
+                std::lock_guard<std::mutex> const guard(m_mutex);
+                m_ready.push_back(page);
+            }
+        }
+    }
+
+private: /* Fields: */
+
+    ChaCha20Rng m_background;
+    ChaCha20Rng m_direct;
+    std::size_t const m_pageSize;
+
+    std::vector<std::unique_ptr<unsigned char[]> > m_storage;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<unsigned char *> m_free;
+    std::deque<unsigned char *> m_ready;
+    bool m_stop = false;
+
+    mutable std::mutex m_consumerMutex;
+    unsigned char * m_current = nullptr;
+    std::size_t m_currentOffset = 0u;
+    std::size_t m_served = 0u;
+    std::size_t m_generated = 0u;
+
+    std::thread m_thread;
+
+}; /* class RandomnessPool { */
+
+namespace detail {
+
+template <typename T, typename Allocator>
+inline RandomTarget randomTarget(ShareVec<T, Allocator> & vec) noexcept {
+    RandomTarget const target = { vec.data(), vec.size() * sizeof(typename T::share_type) };
+    return target;
+}
+
+template <typename T>
+inline RandomTarget randomTarget(BitShareVec<T> & vec) noexcept {
+    RandomTarget const target = { vec.blocks(), vec.num_blocks() * sizeof(typename BitShareVec<T>::block_type) };
+    return target;
+}
+
+template <typename T, typename Allocator>
+inline void finishRandom(ShareVec<T, Allocator> &) noexcept {}
+
+template <typename T>
+inline void finishRandom(BitShareVec<T> & vec) noexcept { vec.clear_unused_bits(); }
+
+} /* namespace detail { */
+
+/**
+ * Randomizes all the given share and bit share vectors with one call to
+ * \a rng.fillMany, i.e. with one parallel job for ChaCha20Rng.
+ */
+template <typename Vec, typename ... Vecs>
+void randomize_all(ChaCha20Rng & rng, Vec & vec, Vecs & ... vecs) {
+    RandomTarget const targets[] = { detail::randomTarget(vec), detail::randomTarget(vecs)... };
+    rng.fillMany(targets, 1u + sizeof...(Vecs));
+    int const finished[] = { (detail::finishRandom(vec), 0), (detail::finishRandom(vecs), 0)... };
+    static_cast<void>(finished);
+}
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_PDKHEADERS_SHARERANDOM_H */
@@ -0,0 +1,466 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_SHAREVECEXPR_H
+#define SHAREMIND_PDKHEADERS_SHAREVECEXPR_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "ShareVecKernels.h"
+#include "ShareVector.h"
+#include "ValueTraits.h"
+
+
+/**
+ * Lazy elementwise expressions over share vectors. Arithmetic and bitwise
+ * operators on ShareVec and BitShareVec operands build expression objects
+ * which are evaluated in a single loop when assigned to a vector:
+ * \code
+ * out = (a + b) * c ^ mask;
+ * \endcode
+ * No temporary vectors are allocated. An expression refers to the storage of
+ * its operands and must be assigned before any operand is resized.
+ * Arithmetic is modulo 2^num_of_bits of the value type. The destination may
+ * be one of the operands.
+ */
+
+namespace sharemind {
+
+#if defined(__clang__)
+#define SHAREMIND_PDKHEADERS_EXPR_VECTORIZE _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define SHAREMIND_PDKHEADERS_EXPR_VECTORIZE _Pragma("GCC ivdep")
+#else
+#define SHAREMIND_PDKHEADERS_EXPR_VECTORIZE
+#endif
+
+/**
+ * Base of all expressions over share vectors of value type Expr::value_traits.
+ */
+template <typename Expr>
+struct __attribute__ ((visibility("internal"))) share_expr {
+    inline const Expr & self() const noexcept { return static_cast<const Expr &>(*this); }
+};
+
+/**
+ * Base of all expressions over the 64-bit blocks of bit share vectors.
+ */
+template <typename Expr>
+struct __attribute__ ((visibility("internal"))) bit_share_expr {
+    inline const Expr & self() const noexcept { return static_cast<const Expr &>(*this); }
+};
+
+template <typename T>
+class __attribute__ ((visibility("internal"))) share_vec_ref_expr
+        : public share_expr<share_vec_ref_expr<T> >
+{
+public: /* Types: */
+
+    using value_traits = T;
+    using value_type = typename T::share_type;
+    static constexpr bool is_scalar = false;
+
+public: /* Methods: */
+
+    inline share_vec_ref_expr(const value_type * const data, std::size_t const size) noexcept
+        : m_data(data), m_size(size) {}
+
+    inline std::size_t size() const noexcept { return m_size; }
+    inline value_type operator[](std::size_t const i) const noexcept { return m_data[i]; }
+
+private: /* Fields: */
+
+    const value_type * m_data;
+    std::size_t m_size;
+
+}; /* class share_vec_ref_expr { */
+
+template <typename T>
+class __attribute__ ((visibility("internal"))) share_scalar_expr
+        : public share_expr<share_scalar_expr<T> >
+{
+public: /* Types: */
+
+    using value_traits = T;
+    using value_type = typename T::share_type;
+    static constexpr bool is_scalar = true;
+
+public: /* Methods: */
+
+    inline explicit share_scalar_expr(const value_type value) noexcept
+        : m_value(value) {}
+
+    inline std::size_t size() const noexcept { return 0u; }
+    inline value_type operator[](std::size_t) const noexcept { return m_value; }
+
+private: /* Fields: */
+
+    value_type m_value;
+
+}; /* class share_scalar_expr { */
+
+template <typename Op, typename L, typename R>
+class __attribute__ ((visibility("internal"))) share_binary_expr
+        : public share_expr<share_binary_expr<Op, L, R> >
+{
+public: /* Types: */
+
+    using value_traits = typename L::value_traits;
+    using value_type = typename L::value_type;
+    static constexpr bool is_scalar = L::is_scalar && R::is_scalar;
+
+public: /* Methods: */
+
+    inline share_binary_expr(const L & lhs, const R & rhs) noexcept
+        : m_lhs(lhs), m_rhs(rhs)
+    {
+        assert((L::is_scalar || R::is_scalar || lhs.size() == rhs.size())
+               && "Operands of different length.");
+    }
+
+    inline std::size_t size() const noexcept
+    { return L::is_scalar ? m_rhs.size() : m_lhs.size(); }
+
+    inline value_type operator[](std::size_t const i) const noexcept {
+        value_type r;
+        Op()(r, m_lhs[i], m_rhs[i]);
+        return r;
+    }
+
+private: /* Fields: */
+
+    L m_lhs;
+    R m_rhs;
+
+}; /* class share_binary_expr { */
+
+template <typename Op, typename E>
+class __attribute__ ((visibility("internal"))) share_unary_expr
+        : public share_expr<share_unary_expr<Op, E> >
+{
+public: /* Types: */
+
+    using value_traits = typename E::value_traits;
+    using value_type = typename E::value_type;
+    static constexpr bool is_scalar = E::is_scalar;
+
+public: /* Methods: */
+
+    inline share_unary_expr(const E & e, const Op op = Op()) noexcept
+        : m_e(e), m_op(op) {}
+
+    inline std::size_t size() const noexcept { return m_e.size(); }
+
+    inline value_type operator[](std::size_t const i) const noexcept {
+        value_type r;
+        m_op(r, m_e[i]);
+        return r;
+    }
+
+private: /* Fields: */
+
+    E m_e;
+    Op m_op;
+
+}; /* class share_unary_expr { */
+
+/* Reduces operands modulo 2^num_of_bits, needed before right shifts. */
+template <typename T>
+struct __attribute__ ((visibility("internal"))) share_ring_reduce {
+    using mask = kernels::detail::ring_mask<typename T::share_type, ValueTraits<T>::num_of_bits>;
+
+    inline typename T::share_type operator()(const typename T::share_type v) const noexcept
+    { return mask::needed ? static_cast<typename T::share_type>(v & mask::value) : v; }
+};
+
+template <typename T>
+struct __attribute__ ((visibility("internal"))) share_shr_op {
+    unsigned count;
+
+    template <typename V>
+    inline void operator()(V & r, const V & a) const noexcept {
+        if (count >= ValueTraits<T>::num_of_bits)
+            r = V(0);
+        else
+            r = static_cast<V>(share_ring_reduce<T>()(a) >> count);
+    }
+};
+
+template <typename T>
+struct __attribute__ ((visibility("internal"))) share_shl_op {
+    unsigned count;
+
+    template <typename V>
+    inline void operator()(V & r, const V & a) const noexcept
+    { r = count >= ValueTraits<T>::num_of_bits ? V(0) : static_cast<V>(a << count); }
+};
+
+/*
+ * Operand traits: a share vector is referenced, an expression is copied and
+ * an arithmetic value is broadcast as a public scalar.
+ */
+
+template <typename X, typename T, typename = void>
+struct __attribute__ ((visibility("internal"))) share_operand { };
+
+template <typename T, typename A>
+struct __attribute__ ((visibility("internal"))) share_operand<ShareVec<T, A>, T> {
+    using type = share_vec_ref_expr<T>;
+    static inline type make(const ShareVec<T, A> & v) noexcept { return type(v.data(), v.size()); }
+};
+
+template <typename E, typename T>
+struct __attribute__ ((visibility("internal"))) share_operand<
+        E, T,
+        typename std::enable_if<std::is_base_of<share_expr<E>, E>::value
+                                && std::is_same<typename E::value_traits, T>::value>::type>
+{
+    using type = E;
+    static inline const E & make(const E & e) noexcept { return e; }
+};
+
+template <typename S, typename T>
+struct __attribute__ ((visibility("internal"))) share_operand<
+        S, T, typename std::enable_if<std::is_arithmetic<S>::value>::type>
+{
+    using type = share_scalar_expr<T>;
+    static inline type make(const S s) noexcept { return type(static_cast<typename T::share_type>(s)); }
+};
+
+/* Value type of an operand that is a vector or an expression. */
+template <typename X, typename = void>
+struct __attribute__ ((visibility("internal"))) share_operand_traits { };
+
+template <typename T, typename A>
+struct __attribute__ ((visibility("internal"))) share_operand_traits<ShareVec<T, A> > {
+    using type = T;
+};
+
+template <typename E>
+struct __attribute__ ((visibility("internal"))) share_operand_traits<
+        E, typename std::enable_if<std::is_base_of<share_expr<E>, E>::value>::type>
+{
+    using type = typename E::value_traits;
+};
+
+/* Value type of a binary operation, at least one side must be a vector. */
+template <typename L, typename R, typename = void>
+struct __attribute__ ((visibility("internal"))) share_binary_traits
+        : share_operand_traits<L> { };
+
+template <typename L, typename R>
+struct __attribute__ ((visibility("internal"))) share_binary_traits<
+        L, R, typename std::enable_if<std::is_arithmetic<L>::value>::type>
+        : share_operand_traits<R> { };
+
+#define SHAREMIND_PDKHEADERS_EXPR_BINARY(op, Op) \
+    template <typename L, typename R, \
+              typename T = typename share_binary_traits<L, R>::type> \
+    inline share_binary_expr<Op, \
+                             typename share_operand<L, T>::type, \
+                             typename share_operand<R, T>::type> \
+    operator op(const L & lhs, const R & rhs) { \
+        return share_binary_expr<Op, \
+                                 typename share_operand<L, T>::type, \
+                                 typename share_operand<R, T>::type>( \
+                share_operand<L, T>::make(lhs), \
+                share_operand<R, T>::make(rhs)); \
+    }
+
+SHAREMIND_PDKHEADERS_EXPR_BINARY(+, kernels::detail::AddOp)
+SHAREMIND_PDKHEADERS_EXPR_BINARY(-, kernels::detail::SubOp)
+SHAREMIND_PDKHEADERS_EXPR_BINARY(*, kernels::detail::MulOp)
+SHAREMIND_PDKHEADERS_EXPR_BINARY(^, kernels::detail::XorOp)
+SHAREMIND_PDKHEADERS_EXPR_BINARY(&, kernels::detail::AndOp)
+SHAREMIND_PDKHEADERS_EXPR_BINARY(|, kernels::detail::OrOp)
+
+#undef SHAREMIND_PDKHEADERS_EXPR_BINARY
+
+template <typename E, typename T = typename share_operand_traits<E>::type>
+inline share_unary_expr<kernels::detail::NegOp, typename share_operand<E, T>::type>
+operator-(const E & e) {
+    return share_unary_expr<kernels::detail::NegOp, typename share_operand<E, T>::type>(
+            share_operand<E, T>::make(e));
+}
+
+template <typename E, typename T = typename share_operand_traits<E>::type>
+inline share_unary_expr<kernels::detail::NotOp, typename share_operand<E, T>::type>
+operator~(const E & e) {
+    return share_unary_expr<kernels::detail::NotOp, typename share_operand<E, T>::type>(
+            share_operand<E, T>::make(e));
+}
+
+template <typename E, typename T = typename share_operand_traits<E>::type>
+inline share_unary_expr<share_shl_op<T>, typename share_operand<E, T>::type>
+operator<<(const E & e, const unsigned count) {
+    return share_unary_expr<share_shl_op<T>, typename share_operand<E, T>::type>(
+            share_operand<E, T>::make(e), share_shl_op<T>{count});
+}
+
+template <typename E, typename T = typename share_operand_traits<E>::type>
+inline share_unary_expr<share_shr_op<T>, typename share_operand<E, T>::type>
+operator>>(const E & e, const unsigned count) {
+    return share_unary_expr<share_shr_op<T>, typename share_operand<E, T>::type>(
+            share_operand<E, T>::make(e), share_shr_op<T>{count});
+}
+
+/**
+ * Evaluates \a expr into \a out in a single pass.
+ */
+template <typename T, typename A, typename Expr>
+void evaluate_share_expr(ShareVec<T, A> & out, const Expr & expr) {
+    static_assert(!Expr::is_scalar, "Expression has no vector operands.");
+    static_assert(std::is_same<typename Expr::value_type, typename T::share_type>::value,
+                  "Expression and output vector have different share types.");
+    std::size_t const n = expr.size();
+    out.resize_uninitialized(n);
+    typename T::share_type * const o = out.data();
+    share_ring_reduce<T> const reduce = share_ring_reduce<T>();
+    SHAREMIND_PDKHEADERS_EXPR_VECTORIZE
+    for (std::size_t i = 0u; i < n; ++i)
+        o[i] = reduce(expr[i]);
+}
+
+/*
+ * Expressions over bit share vectors, evaluated 64 bits at a time.
+ */
+
+class __attribute__ ((visibility("internal"))) bit_share_vec_ref_expr
+        : public bit_share_expr<bit_share_vec_ref_expr>
+{
+public: /* Methods: */
+
+    inline bit_share_vec_ref_expr(const std::uint64_t * const blocks, std::size_t const size) noexcept
+        : m_blocks(blocks), m_size(size) {}
+
+    inline std::size_t size() const noexcept { return m_size; }
+    inline std::uint64_t block(std::size_t const i) const noexcept { return m_blocks[i]; }
+
+private: /* Fields: */
+
+    const std::uint64_t * m_blocks;
+    std::size_t m_size;
+
+}; /* class bit_share_vec_ref_expr { */
+
+template <typename Op, typename L, typename R>
+class __attribute__ ((visibility("internal"))) bit_share_binary_expr
+        : public bit_share_expr<bit_share_binary_expr<Op, L, R> >
+{
+public: /* Methods: */
+
+    inline bit_share_binary_expr(const L & lhs, const R & rhs) noexcept
+        : m_lhs(lhs), m_rhs(rhs)
+    { assert(lhs.size() == rhs.size() && "Operands of different length."); }
+
+    inline std::size_t size() const noexcept { return m_lhs.size(); }
+
+    inline std::uint64_t block(std::size_t const i) const noexcept {
+        std::uint64_t r;
+        Op()(r, m_lhs.block(i), m_rhs.block(i));
+        return r;
+    }
+
+private: /* Fields: */
+
+    L m_lhs;
+    R m_rhs;
+
+}; /* class bit_share_binary_expr { */
+
+template <typename E>
+class __attribute__ ((visibility("internal"))) bit_share_not_expr
+        : public bit_share_expr<bit_share_not_expr<E> >
+{
+public: /* Methods: */
+
+    inline explicit bit_share_not_expr(const E & e) noexcept : m_e(e) {}
+
+    inline std::size_t size() const noexcept { return m_e.size(); }
+    inline std::uint64_t block(std::size_t const i) const noexcept { return ~m_e.block(i); }
+
+private: /* Fields: */
+
+    E m_e;
+
+}; /* class bit_share_not_expr { */
+
+template <typename X, typename = void>
+struct __attribute__ ((visibility("internal"))) bit_share_operand { };
+
+template <typename B>
+struct __attribute__ ((visibility("internal"))) bit_share_operand<BitShareVec<B> > {
+    using type = bit_share_vec_ref_expr;
+    static inline type make(const BitShareVec<B> & v) noexcept { return type(v.blocks(), v.size()); }
+};
+
+template <typename E>
+struct __attribute__ ((visibility("internal"))) bit_share_operand<
+        E, typename std::enable_if<std::is_base_of<bit_share_expr<E>, E>::value>::type>
+{
+    using type = E;
+    static inline const E & make(const E & e) noexcept { return e; }
+};
+
+#define SHAREMIND_PDKHEADERS_EXPR_BIT_BINARY(op, Op) \
+    template <typename L, typename R> \
+    inline bit_share_binary_expr<Op, \
+                                 typename bit_share_operand<L>::type, \
+                                 typename bit_share_operand<R>::type> \
+    operator op(const L & lhs, const R & rhs) { \
+        return bit_share_binary_expr<Op, \
+                                     typename bit_share_operand<L>::type, \
+                                     typename bit_share_operand<R>::type>( \
+                bit_share_operand<L>::make(lhs), \
+                bit_share_operand<R>::make(rhs)); \
+    }
+
+SHAREMIND_PDKHEADERS_EXPR_BIT_BINARY(^, kernels::detail::XorOp)
+SHAREMIND_PDKHEADERS_EXPR_BIT_BINARY(&, kernels::detail::AndOp)
+SHAREMIND_PDKHEADERS_EXPR_BIT_BINARY(|, kernels::detail::OrOp)
+
+#undef SHAREMIND_PDKHEADERS_EXPR_BIT_BINARY
+
+template <typename E>
+inline bit_share_not_expr<typename bit_share_operand<E>::type> operator~(const E & e) {
+    return bit_share_not_expr<typename bit_share_operand<E>::type>(
+            bit_share_operand<E>::make(e));
+}
+
+/**
+ * Evaluates \a expr into \a out in a single pass over the blocks.
+ */
+template <typename B, typename Expr>
+void evaluate_bit_share_expr(BitShareVec<B> & out, const Expr & expr) {
+    out.resize_uninitialized(expr.size());
+    std::uint64_t * const o = out.blocks();
+    std::size_t const n = out.num_blocks();
+    SHAREMIND_PDKHEADERS_EXPR_VECTORIZE
+    for (std::size_t i = 0u; i < n; ++i)
+        o[i] = expr.block(i);
+    out.clear_unused_bits();
+}
+
+#undef SHAREMIND_PDKHEADERS_EXPR_VECTORIZE
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_SHAREVECEXPR_H */
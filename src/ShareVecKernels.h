@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_SHAREVECKERNELS_H
+#define SHAREMIND_PDKHEADERS_SHAREVECKERNELS_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "ShareVector.h"
+#include "ValueTraits.h"
+
+
+/**
+ * Elementwise local operations over share vectors. The kernels compute
+ * modulo 2^num_of_bits of the value type and are dispatched at run time to
+ * SSE2, AVX2 or AVX-512 code depending on the capabilities of the CPU.
+ */
+
+namespace sharemind {
+namespace kernels {
+
+/** Instruction set used by the kernels. */
+enum class Isa { Generic, Sse2, Avx2, Avx512 };
+
+namespace detail {
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHAREMIND_PDKHEADERS_KERNELS_X86 1
+#define SHAREMIND_PDKHEADERS_KERNELS_TARGET(t) __attribute__ ((target(t)))
+#else
+#define SHAREMIND_PDKHEADERS_KERNELS_TARGET(t)
+#endif
+#define SHAREMIND_PDKHEADERS_KERNELS_INLINE inline __attribute__ ((always_inline))
+
+inline Isa detectIsa() noexcept {
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return Isa::Avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return Isa::Avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return Isa::Sse2;
+#endif
+    return Isa::Generic;
+}
+
+template <typename L, std::size_t Bytes>
+struct simd_type { typedef L type __attribute__ ((vector_size(Bytes))); };
+
+/* Ring mask of values with the given number of bits. */
+template <typename L, std::size_t Bits>
+struct ring_mask {
+    static constexpr bool needed = Bits < sizeof(L) * 8u;
+    static constexpr L value = needed ? L((L(1) << (needed ? Bits : 0u)) - 1u) : L(~L(0));
+};
+
+struct AddOp { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a, const V & b) const { r = a + b; } };
+struct SubOp { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a, const V & b) const { r = a - b; } };
+struct MulOp { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a, const V & b) const { r = a * b; } };
+struct XorOp { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a, const V & b) const { r = a ^ b; } };
+struct AndOp { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a, const V & b) const { r = a & b; } };
+struct OrOp  { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a, const V & b) const { r = a | b; } };
+struct NegOp { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a) const { r = V() - a; } };
+struct NotOp { template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a) const { r = ~a; } };
+
+struct ShlOp {
+    unsigned count;
+    template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a) const { r = a << count; }
+};
+
+struct ShrOp {
+    unsigned count;
+    template <typename V> SHAREMIND_PDKHEADERS_KERNELS_INLINE void operator()(V & r, const V & a) const { r = a >> count; }
+};
+
+template <typename V, typename L, bool Masked, typename Op>
+SHAREMIND_PDKHEADERS_KERNELS_INLINE
+void binaryLoop(L * out, const L * a, const L * b, std::size_t n, L mask, Op op) {
+    constexpr std::size_t width = sizeof(V) / sizeof(L);
+    std::size_t i = 0u;
+    for (; i + width <= n; i += width) {
+        V x, y, r;
+        std::memcpy(&x, a + i, sizeof(V));
+        std::memcpy(&y, b + i, sizeof(V));
+        op(r, x, y);
+        if (Masked)
+            r &= mask;
+        std::memcpy(out + i, &r, sizeof(V));
+    }
+    for (; i < n; ++i) {
+        L r;
+        op(r, a[i], b[i]);
+        out[i] = Masked ? L(r & mask) : r;
+    }
+}
+
+template <typename V, typename L, bool Masked, typename Op>
+SHAREMIND_PDKHEADERS_KERNELS_INLINE
+void unaryLoop(L * out, const L * a, std::size_t n, L mask, Op op) {
+    constexpr std::size_t width = sizeof(V) / sizeof(L);
+    std::size_t i = 0u;
+    for (; i + width <= n; i += width) {
+        V x, r;
+        std::memcpy(&x, a + i, sizeof(V));
+        op(r, x);
+        if (Masked)
+            r &= mask;
+        std::memcpy(out + i, &r, sizeof(V));
+    }
+    for (; i < n; ++i) {
+        L r;
+        op(r, a[i]);
+        out[i] = Masked ? L(r & mask) : r;
+    }
+}
+
+#define SHAREMIND_PDKHEADERS_KERNELS_VARIANT(name, target, bytes) \
+    template <typename L, bool Masked, typename Op> \
+    SHAREMIND_PDKHEADERS_KERNELS_TARGET(target) \
+    void binary ## name(L * out, const L * a, const L * b, std::size_t n, L mask, Op op) \
+    { binaryLoop<typename simd_type<L, bytes>::type, L, Masked>(out, a, b, n, mask, op); } \
+    template <typename L, bool Masked, typename Op> \
+    SHAREMIND_PDKHEADERS_KERNELS_TARGET(target) \
+    void unary ## name(L * out, const L * a, std::size_t n, L mask, Op op) \
+    { unaryLoop<typename simd_type<L, bytes>::type, L, Masked>(out, a, n, mask, op); }
+
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+SHAREMIND_PDKHEADERS_KERNELS_VARIANT(Sse2, "sse2", 16u)
+SHAREMIND_PDKHEADERS_KERNELS_VARIANT(Avx2, "avx2", 32u)
+SHAREMIND_PDKHEADERS_KERNELS_VARIANT(Avx512, "avx512f,avx512bw", 64u)
+#endif
+
+template <typename L, bool Masked, typename Op>
+void binaryGeneric(L * out, const L * a, const L * b, std::size_t n, L mask, Op op)
+{ binaryLoop<typename simd_type<L, 16u>::type, L, Masked>(out, a, b, n, mask, op); }
+
+template <typename L, bool Masked, typename Op>
+void unaryGeneric(L * out, const L * a, std::size_t n, L mask, Op op)
+{ unaryLoop<typename simd_type<L, 16u>::type, L, Masked>(out, a, n, mask, op); }
+
+#undef SHAREMIND_PDKHEADERS_KERNELS_VARIANT
+
+template <typename L, bool Masked, typename Op>
+void binary(L * out, const L * a, const L * b, std::size_t n, L mask, Op op) {
+    using Kernel = void (*)(L *, const L *, const L *, std::size_t, L, Op);
+    static Kernel const kernel = [] () -> Kernel {
+        switch (detectIsa()) {
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+        case Isa::Avx512: return &binaryAvx512<L, Masked, Op>;
+        case Isa::Avx2: return &binaryAvx2<L, Masked, Op>;
+        case Isa::Sse2: return &binarySse2<L, Masked, Op>;
+#endif
+        default: return &binaryGeneric<L, Masked, Op>;
+        }
+    }();
+    kernel(out, a, b, n, mask, op);
+}
+
+template <typename L, bool Masked, typename Op>
+void unary(L * out, const L * a, std::size_t n, L mask, Op op) {
+    using Kernel = void (*)(L *, const L *, std::size_t, L, Op);
+    static Kernel const kernel = [] () -> Kernel {
+        switch (detectIsa()) {
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+        case Isa::Avx512: return &unaryAvx512<L, Masked, Op>;
+        case Isa::Avx2: return &unaryAvx2<L, Masked, Op>;
+        case Isa::Sse2: return &unarySse2<L, Masked, Op>;
+#endif
+        default: return &unaryGeneric<L, Masked, Op>;
+        }
+    }();
+    kernel(out, a, n, mask, op);
+}
+
+#undef SHAREMIND_PDKHEADERS_KERNELS_INLINE
+
+/* Dispatches a ring operation over the shares of value type T. */
+template <typename T, typename Op>
+inline void binaryShares(typename T::share_type * out,
+                         const typename T::share_type * a,
+                         const typename T::share_type * b,
+                         std::size_t n,
+                         Op op = Op())
+{
+    using L = typename T::share_type;
+    using M = ring_mask<L, ValueTraits<T>::num_of_bits>;
+    binary<L, M::needed>(out, a, b, n, M::value, op);
+}
+
+template <typename T, typename Op>
+inline void unaryShares(typename T::share_type * out,
+                        const typename T::share_type * a,
+                        std::size_t n,
+                        Op op = Op())
+{
+    using L = typename T::share_type;
+    using M = ring_mask<L, ValueTraits<T>::num_of_bits>;
+    unary<L, M::needed>(out, a, n, M::value, op);
+}
+
+template <typename T, typename A1, typename A2, typename A3, typename Op>
+inline void binaryVec(ShareVec<T, A1> & out,
+                      const ShareVec<T, A2> & a,
+                      const ShareVec<T, A3> & b,
+                      Op op)
+{
+    assert(a.size() == b.size() && "Vectors of different length.");
+    out.resize_uninitialized(a.size());
+    binaryShares<T>(out.data(), a.data(), b.data(), a.size(), op);
+}
+
+template <typename T, typename A1, typename A2, typename Op>
+inline void unaryVec(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, Op op) {
+    out.resize_uninitialized(a.size());
+    unaryShares<T>(out.data(), a.data(), a.size(), op);
+}
+
+template <typename T, typename Op>
+inline void binaryBits(BitShareVec<T> & out,
+                       const BitShareVec<T> & a,
+                       const BitShareVec<T> & b,
+                       Op op)
+{
+    assert(a.size() == b.size() && "Vectors of different length.");
+    out.resize_uninitialized(a.size());
+    binary<std::uint64_t, false>(out.blocks(), a.blocks(), b.blocks(),
+                                 a.num_blocks(), ~std::uint64_t(0u), op);
+}
+
+} /* namespace detail { */
+
+/** \returns the instruction set selected for this CPU. */
+inline Isa selectedIsa() noexcept {
+    static Isa const isa = detail::detectIsa();
+    return isa;
+}
+
+/*
+ * Ring operations over raw share arrays of value type T. The output may
+ * alias either input.
+ */
+
+template <typename T> inline void add(typename T::share_type * out, const typename T::share_type * a, const typename T::share_type * b, std::size_t n)
+{ detail::binaryShares<T, detail::AddOp>(out, a, b, n); }
+template <typename T> inline void sub(typename T::share_type * out, const typename T::share_type * a, const typename T::share_type * b, std::size_t n)
+{ detail::binaryShares<T, detail::SubOp>(out, a, b, n); }
+template <typename T> inline void mul(typename T::share_type * out, const typename T::share_type * a, const typename T::share_type * b, std::size_t n)
+{ detail::binaryShares<T, detail::MulOp>(out, a, b, n); }
+template <typename T> inline void bitXor(typename T::share_type * out, const typename T::share_type * a, const typename T::share_type * b, std::size_t n)
+{ detail::binaryShares<T, detail::XorOp>(out, a, b, n); }
+template <typename T> inline void bitAnd(typename T::share_type * out, const typename T::share_type * a, const typename T::share_type * b, std::size_t n)
+{ detail::binaryShares<T, detail::AndOp>(out, a, b, n); }
+template <typename T> inline void bitOr(typename T::share_type * out, const typename T::share_type * a, const typename T::share_type * b, std::size_t n)
+{ detail::binaryShares<T, detail::OrOp>(out, a, b, n); }
+template <typename T> inline void negate(typename T::share_type * out, const typename T::share_type * a, std::size_t n)
+{ detail::unaryShares<T, detail::NegOp>(out, a, n); }
+template <typename T> inline void bitNot(typename T::share_type * out, const typename T::share_type * a, std::size_t n)
+{ detail::unaryShares<T, detail::NotOp>(out, a, n); }
+
+template <typename T>
+inline void shiftLeft(typename T::share_type * out, const typename T::share_type * a, std::size_t n, unsigned count) {
+    if (count >= ValueTraits<T>::num_of_bits)
+        std::fill(out, out + n, typename T::share_type(0u));
+    else
+        detail::unaryShares<T>(out, a, n, detail::ShlOp{count});
+}
+
+template <typename T>
+inline void shiftRight(typename T::share_type * out, const typename T::share_type * a, std::size_t n, unsigned count) {
+    if (count >= ValueTraits<T>::num_of_bits)
+        std::fill(out, out + n, typename T::share_type(0u));
+    else
+        detail::unaryShares<T>(out, a, n, detail::ShrOp{count});
+}
+
+/*
+ * Ring operations over share vectors. The output is resized to the length
+ * of the inputs, which must be equal, and may be one of the inputs.
+ */
+
+template <typename T, typename A1, typename A2, typename A3>
+inline void add(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, const ShareVec<T, A3> & b)
+{ detail::binaryVec(out, a, b, detail::AddOp()); }
+template <typename T, typename A1, typename A2, typename A3>
+inline void sub(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, const ShareVec<T, A3> & b)
+{ detail::binaryVec(out, a, b, detail::SubOp()); }
+template <typename T, typename A1, typename A2, typename A3>
+inline void mul(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, const ShareVec<T, A3> & b)
+{ detail::binaryVec(out, a, b, detail::MulOp()); }
+template <typename T, typename A1, typename A2, typename A3>
+inline void bitXor(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, const ShareVec<T, A3> & b)
+{ detail::binaryVec(out, a, b, detail::XorOp()); }
+template <typename T, typename A1, typename A2, typename A3>
+inline void bitAnd(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, const ShareVec<T, A3> & b)
+{ detail::binaryVec(out, a, b, detail::AndOp()); }
+template <typename T, typename A1, typename A2, typename A3>
+inline void bitOr(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, const ShareVec<T, A3> & b)
+{ detail::binaryVec(out, a, b, detail::OrOp()); }
+template <typename T, typename A1, typename A2>
+inline void negate(ShareVec<T, A1> & out, const ShareVec<T, A2> & a)
+{ detail::unaryVec(out, a, detail::NegOp()); }
+template <typename T, typename A1, typename A2>
+inline void bitNot(ShareVec<T, A1> & out, const ShareVec<T, A2> & a)
+{ detail::unaryVec(out, a, detail::NotOp()); }
+
+template <typename T, typename A1, typename A2>
+inline void shiftLeft(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, unsigned count) {
+    out.resize_uninitialized(a.size());
+    shiftLeft<T>(out.data(), a.data(), a.size(), count);
+}
+
+template <typename T, typename A1, typename A2>
+inline void shiftRight(ShareVec<T, A1> & out, const ShareVec<T, A2> & a, unsigned count) {
+    out.resize_uninitialized(a.size());
+    shiftRight<T>(out.data(), a.data(), a.size(), count);
+}
+
+/*
+ * Bitwise operations over bit share vectors, processed 64 bits at a time.
+ * Addition and subtraction of bits are XOR, multiplication is AND.
+ */
+
+template <typename T>
+inline void bitXor(BitShareVec<T> & out, const BitShareVec<T> & a, const BitShareVec<T> & b)
+{ detail::binaryBits(out, a, b, detail::XorOp()); }
+template <typename T>
+inline void bitAnd(BitShareVec<T> & out, const BitShareVec<T> & a, const BitShareVec<T> & b)
+{ detail::binaryBits(out, a, b, detail::AndOp()); }
+template <typename T>
+inline void bitOr(BitShareVec<T> & out, const BitShareVec<T> & a, const BitShareVec<T> & b)
+{ detail::binaryBits(out, a, b, detail::OrOp()); }
+template <typename T>
+inline void add(BitShareVec<T> & out, const BitShareVec<T> & a, const BitShareVec<T> & b)
+{ bitXor(out, a, b); }
+template <typename T>
+inline void sub(BitShareVec<T> & out, const BitShareVec<T> & a, const BitShareVec<T> & b)
+{ bitXor(out, a, b); }
+template <typename T>
+inline void mul(BitShareVec<T> & out, const BitShareVec<T> & a, const BitShareVec<T> & b)
+{ bitAnd(out, a, b); }
+
+template <typename T>
+inline void bitNot(BitShareVec<T> & out, const BitShareVec<T> & a) {
+    out.resize_uninitialized(a.size());
+    detail::unary<std::uint64_t, false>(out.blocks(), a.blocks(), a.num_blocks(),
+                                        ~std::uint64_t(0u), detail::NotOp());
+    out.clear_unused_bits();
+}
+
+} /* namespace kernels { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_PDKHEADERS_SHAREVECKERNELS_H */
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_SHAREVECVIEW_H
+#define SHAREMIND_PDKHEADERS_SHAREVECVIEW_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include "ShareVector.h"
+#include "StridedIterator.h"
+
+
+namespace sharemind {
+
+/**
+ * Base class of non-owning views over a range of shares. The view refers to
+ * \a size elements starting at \a data that are \a stride elements apart.
+ * The viewed storage must outlive the view and must not be reallocated.
+ */
+template <typename T, typename ValueType>
+class __attribute__ ((visibility("internal"))) ShareVecViewBase {
+
+public: /* Types: */
+
+    using value_traits = T;
+    using value_type = typename T::share_type;
+    using pointer = ValueType *;
+    using reference = ValueType &;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using iterator = strided_iterator<ValueType>;
+
+protected: /* Constants: */
+
+    /* Number of elements buffered when (de)serializing strided views. */
+    static constexpr size_type bufferSize = 256u;
+
+public: /* Methods: */
+
+    inline ShareVecViewBase() noexcept
+        : m_data(nullptr)
+        , m_size(0u)
+        , m_stride(1)
+    { }
+
+    inline ShareVecViewBase(pointer const data,
+                            size_type const size,
+                            difference_type const stride = 1) noexcept
+        : m_data(data)
+        , m_size(size)
+        , m_stride(stride)
+    { assert(stride != 0 && "Zero stride."); }
+
+    static constexpr typename T::value_category value_category() {
+        return typename T::value_category();
+    }
+
+    inline pointer data() const noexcept { return m_data; }
+    inline size_type size() const noexcept { return m_size; }
+    inline bool empty() const noexcept { return m_size == 0u; }
+    inline difference_type stride() const noexcept { return m_stride; }
+    inline bool is_contiguous() const noexcept { return m_stride == 1; }
+
+    inline iterator begin() const noexcept { return iterator(m_data, m_stride); }
+    inline iterator end() const noexcept { return begin() + static_cast<difference_type>(m_size); }
+
+    inline reference operator[](size_type i) const noexcept {
+        assert(i < size() && "operator[]: Index out of bounds.");
+        return m_data[static_cast<difference_type>(i) * m_stride];
+    }
+
+    template <typename OutMessage>
+    void serialize(OutMessage & msg) const {
+        if (is_contiguous()) {
+            msg.writeArray(m_data, m_size);
+            return;
+        }
+
+        value_type buffer[bufferSize];
+        for (size_type i = 0u; i < m_size; i += bufferSize) {
+            size_type const n = std::min(bufferSize, m_size - i);
+            std::copy(begin() + difference_type(i),
+                      begin() + difference_type(i + n),
+                      buffer);
+            msg.writeArray(buffer, n);
+        }
+    }
+
+protected: /* Methods: */
+
+    template <typename Pointer>
+    static inline Pointer offsetPointer(Pointer const data,
+                                        size_type const vecSize,
+                                        size_type const offset,
+                                        size_type const length,
+                                        difference_type const stride,
+                                        difference_type const parentStride = 1) noexcept
+    {
+        assert(stride > 0 && "Views over vectors must have a positive stride.");
+        assert((length == 0u
+                || offset + (length - 1u) * size_type(stride) < vecSize)
+               && "View out of bounds.");
+        (void) vecSize; (void) length; (void) stride;
+        return data + static_cast<difference_type>(offset) * parentStride;
+    }
+
+protected: /* Fields: */
+
+    pointer m_data;
+    size_type m_size;
+    difference_type m_stride;
+
+}; /* class ShareVecViewBase { */
+
+template <typename T, typename ValueType>
+constexpr typename ShareVecViewBase<T, ValueType>::size_type
+ShareVecViewBase<T, ValueType>::bufferSize;
+
+/**
+ * \brief Non-owning mutable view over (a slice of) a share vector.
+ * A ShareVec converts implicitly to a view, hence protocols may declare
+ * \code
+ * bool invoke (ConstShareVecView<T> a, ConstShareVecView<T> b, ShareVecView<T> c);
+ * \endcode
+ * and be invoked by MetaSyscalls with whole vectors, and by other protocols
+ * with slices, without copying any shares.
+ */
+template <typename T>
+class __attribute__ ((visibility("internal"))) ShareVecView
+        : public ShareVecViewBase<T, typename T::share_type>
+{
+
+private: /* Types: */
+
+    using Base = ShareVecViewBase<T, typename T::share_type>;
+
+public: /* Types: */
+
+    using typename Base::value_type;
+    using typename Base::pointer;
+    using typename Base::size_type;
+    using typename Base::difference_type;
+
+public: /* Methods: */
+
+    inline ShareVecView() noexcept {}
+
+    inline ShareVecView(pointer const data,
+                        size_type const size,
+                        difference_type const stride = 1) noexcept
+        : Base(data, size, stride)
+    { }
+
+    template <typename Allocator>
+    inline ShareVecView(ShareVec<T, Allocator> & vec) noexcept
+        : Base(vec.data(), vec.size())
+    { }
+
+    template <typename Allocator>
+    inline ShareVecView(ShareVec<T, Allocator> & vec,
+                        size_type const offset,
+                        size_type const length,
+                        difference_type const stride = 1) noexcept
+        : Base(Base::offsetPointer(vec.data(), vec.size(), offset, length, stride),
+               length,
+               stride)
+    { }
+
+    /** \returns a view of \a length elements starting from \a offset. */
+    inline ShareVecView subview(size_type const offset,
+                                size_type const length,
+                                difference_type const stride = 1) const noexcept
+    {
+        return ShareVecView(Base::offsetPointer(this->m_data, this->m_size, offset, length, stride, this->m_stride),
+                            length,
+                            this->m_stride * stride);
+    }
+
+    template <typename Rng>
+    void randomize(Rng & rng) const {
+        if (this->empty())
+            return;
+
+        if (this->is_contiguous()) {
+            rng.fillBlock(this->m_data, this->m_data + this->m_size);
+            return;
+        }
+
+        value_type buffer[Base::bufferSize];
+        for (size_type i = 0u; i < this->m_size; i += Base::bufferSize) {
+            size_type const n = std::min(Base::bufferSize, this->m_size - i);
+            rng.fillBlock(buffer, buffer + n);
+            std::copy(buffer, buffer + n, this->begin() + difference_type(i));
+        }
+    }
+
+    template <typename InMessage>
+    bool deserialize(InMessage & msg) const {
+        if (this->is_contiguous())
+            return msg.readArray(this->m_data, this->m_size);
+
+        value_type buffer[Base::bufferSize];
+        for (size_type i = 0u; i < this->m_size; i += Base::bufferSize) {
+            size_type const n = std::min(Base::bufferSize, this->m_size - i);
+            if (!msg.readArray(buffer, n))
+                return false;
+            std::copy(buffer, buffer + n, this->begin() + difference_type(i));
+        }
+
+        return true;
+    }
+
+}; /* class ShareVecView { */
+
+/**
+ * \brief Non-owning immutable view over (a slice of) a share vector.
+ * \see ShareVecView
+ */
+template <typename T>
+class __attribute__ ((visibility("internal"))) ConstShareVecView
+        : public ShareVecViewBase<T, const typename T::share_type>
+{
+
+private: /* Types: */
+
+    using Base = ShareVecViewBase<T, const typename T::share_type>;
+
+public: /* Types: */
+
+    using typename Base::value_type;
+    using typename Base::pointer;
+    using typename Base::size_type;
+    using typename Base::difference_type;
+
+public: /* Methods: */
+
+    inline ConstShareVecView() noexcept {}
+
+    inline ConstShareVecView(pointer const data,
+                             size_type const size,
+                             difference_type const stride = 1) noexcept
+        : Base(data, size, stride)
+    { }
+
+    inline ConstShareVecView(const ShareVecView<T> & view) noexcept
+        : Base(view.data(), view.size(), view.stride())
+    { }
+
+    template <typename Allocator>
+    inline ConstShareVecView(const ShareVec<T, Allocator> & vec) noexcept
+        : Base(vec.data(), vec.size())
+    { }
+
+    template <typename Allocator>
+    inline ConstShareVecView(const ShareVec<T, Allocator> & vec,
+                             size_type const offset,
+                             size_type const length,
+                             difference_type const stride = 1) noexcept
+        : Base(Base::offsetPointer(vec.data(), vec.size(), offset, length, stride),
+               length,
+               stride)
+    { }
+
+    /** \returns a view of \a length elements starting from \a offset. */
+    inline ConstShareVecView subview(size_type const offset,
+                                     size_type const length,
+                                     difference_type const stride = 1) const noexcept
+    {
+        return ConstShareVecView(Base::offsetPointer(this->m_data, this->m_size, offset, length, stride, this->m_stride),
+                                 length,
+                                 this->m_stride * stride);
+    }
+
+}; /* class ConstShareVecView { */
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_SHAREVECVIEW_H */
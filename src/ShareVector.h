@@ -20,20 +20,41 @@
 #ifndef SHAREMIND_PDKHEADERS_SHAREVEC_H
 #define SHAREMIND_PDKHEADERS_SHAREVEC_H
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <iterator>
+#include <memory>
 #include <sharemind/BitVector.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "ValueTraits.h"
 
 
 namespace sharemind {
 
-template <typename T> class ShareVec;
+template <typename T,
+          typename Allocator = typename share_allocator_of<T>::type>
+class ShareVec;
+
+/* Expression templates, see ShareVecExpr.h: */
+template <typename Expr> struct share_expr;
+template <typename Expr> struct bit_share_expr;
 
 struct __attribute__ ((visibility("internal"))) ShareVecBase {
 public: /* Types: */
     virtual ~ShareVecBase () {}
+
+    /** \returns the number of bytes of storage allocated for the shares. */
+    virtual std::size_t allocated_bytes () const noexcept { return 0u; }
+
+    /** Removes all elements but keeps the allocated storage. */
+    virtual void clear () noexcept {}
+
+    /** Removes all elements and frees the allocated storage. */
+    virtual void clear_and_release () noexcept {}
 };
 
 template <typename Iter, class DerivedIter>
@@ -113,26 +134,39 @@ struct share_const_iterator: share_iterator_base<typename C::impl_t::const_itera
     inline share_const_iterator() {}
     inline explicit share_const_iterator(const inner_iterator_type & copy) : Base(copy) {}
     inline explicit share_const_iterator(const inner_const_iterator_type & copy) : Base(copy) {}
-    inline share_const_iterator(const share_iterator<T> & copy) : Base(copy.m_it) {}
+    inline share_const_iterator(const share_iterator<T, C> & copy) : Base(copy.m_it) {}
 
 }; /* struct share_iterator { */
 
+template <typename Iter> class iterator_chain;
+
+/**
+ * Segment of an iterator_chain.
+ */
 template <typename Iter>
 struct iterator_chain_item {
+    using difference_type = typename std::iterator_traits<Iter>::difference_type;
+
     Iter begin;
     Iter end;
-    iterator_chain_item<Iter> * next;
-    iterator_chain_item<Iter> * prev;
+    difference_type offset; /**< Number of elements in preceding segments. */
 }; /* struct iterator_chain_item { */
 
+/**
+ * Random access iterator over the concatenation of the segments of an
+ * iterator_chain. The iterator tracks its position in the whole chain and
+ * caches the segment it is in, hence stepping is O(1) and random jumps are
+ * O(log segments).
+ */
 template <typename Iter>
-class chained_iterator: std::iterator_traits<Iter> {
+class chained_iterator {
 public: /* Types: */
 
     using inner_iterator_type = Iter;
     using container_type = typename inner_iterator_type::container_type;
 
     using Base = std::iterator_traits<Iter>;
+    using iterator_category = std::random_access_iterator_tag;
     using value_type = typename Base::value_type;
     using pointer = typename Base::pointer;
     using reference = typename Base::reference;
@@ -141,162 +175,220 @@ public: /* Types: */
 public: /* Methods: */
 
     inline chained_iterator()
-        : m_chain(nullptr) {}
-
-    inline chained_iterator(const chained_iterator<Iter> & copy)
-        : m_it(copy.m_it)
-        , m_chain(copy.m_chain) {}
-
-    inline chained_iterator<Iter> & operator=(const chained_iterator<Iter> & rhs) {
-        m_it = rhs.m_it;
-        m_chain = rhs.m_chain;
+        : m_chain(nullptr)
+        , m_segment(0u)
+        , m_pos(0) {}
+
+    inline chained_iterator(const iterator_chain<Iter> * const chain,
+                            const difference_type pos)
+        : m_chain(chain)
+        , m_segment(chain->segmentOf(pos))
+        , m_pos(pos) {}
+
+    inline chained_iterator<Iter> & operator++() { ++m_pos; afterIncrease(); return *this; }
+    inline chained_iterator<Iter> operator++(int) { chained_iterator<Iter> r(*this); ++(*this); return r; }
+    inline chained_iterator<Iter> & operator--() { --m_pos; afterDecrease(); return *this; }
+    inline chained_iterator<Iter> operator--(int) { chained_iterator<Iter> r(*this); --(*this); return r; }
+
+    inline chained_iterator<Iter> & operator+=(const difference_type v) { m_pos += v; m_segment = m_chain->segmentOf(m_pos); return *this; }
+    inline chained_iterator<Iter> & operator-=(const difference_type v) { return *this += -v; }
+    inline chained_iterator<Iter> operator+(const difference_type v) const { chained_iterator<Iter> r(*this); return r += v; }
+    inline chained_iterator<Iter> operator-(const difference_type v) const { chained_iterator<Iter> r(*this); return r -= v; }
+    inline difference_type operator-(const chained_iterator<Iter> & rhs) const { return m_pos - rhs.m_pos; }
+
+    inline bool operator==(const chained_iterator<Iter> & rhs) const { return m_chain == rhs.m_chain && m_pos == rhs.m_pos; }
+    inline bool operator!=(const chained_iterator<Iter> & rhs) const { return !(*this == rhs); }
+    inline bool operator<=(const chained_iterator<Iter> & rhs) const { return m_pos <= rhs.m_pos; }
+    inline bool operator>=(const chained_iterator<Iter> & rhs) const { return m_pos >= rhs.m_pos; }
+    inline bool operator< (const chained_iterator<Iter> & rhs) const { return m_pos <  rhs.m_pos; }
+    inline bool operator> (const chained_iterator<Iter> & rhs) const { return m_pos >  rhs.m_pos; }
+
+    inline pointer operator->() const { return getInner().operator->(); }
+    inline reference operator*() const { return *getInner(); }
+    inline reference operator[](const difference_type v) const { return *(*this + v); }
+
+    inline inner_iterator_type getInner() const {
+        const iterator_chain_item<Iter> & item = m_chain->m_segments[m_segment];
+        return item.begin + (m_pos - item.offset);
     }
 
-    inline chained_iterator(const inner_iterator_type pos,
-                            const iterator_chain_item<Iter> * const chain)
-        : m_it(pos)
-        , m_chain(chain) {}
-
-    inline chained_iterator<Iter> & operator++() { increaseInner(); return *this; }
-    inline chained_iterator<Iter> operator++(int) { chained_iterator<Iter> r(*this); increaseInner(); return r; }
-    inline chained_iterator<Iter> & operator--() { decreaseInner(); return *this; }
-    inline chained_iterator<Iter> operator--(int) { chained_iterator<Iter> r(*this); decreaseInner(); return r; }
-
-    inline bool operator==(const chained_iterator<Iter> & rhs) const { return m_chain == rhs.m_chain && m_it == rhs.m_it; }
-    inline bool operator!=(const chained_iterator<Iter> & rhs) const { return m_chain != rhs.m_chain || m_it != rhs.m_it; }
-
-    inline pointer operator->() const { return m_it.operator->(); }
-    inline reference operator*() const { return m_it.operator*(); }
-
-    inline const inner_iterator_type & getInner() const { return m_it; }
-
 private: /* Methods: */
 
-    inline void increaseInner() {
-        ++m_it;
-        if (m_chain && m_it == m_chain->end && m_chain->next) {
-            m_chain = m_chain->next;
-            m_it = m_chain->begin;
-        }
+    inline void afterIncrease() {
+        const iterator_chain_item<Iter> & item = m_chain->m_segments[m_segment];
+        if (m_pos - item.offset == item.end - item.begin
+            && m_segment + 1u < m_chain->m_segments.size())
+            m_segment = m_chain->segmentOf(m_pos);
     }
 
-    inline void decreaseInner() {
-        if (m_chain && m_it == m_chain->begin && m_chain->prev) {
-            m_chain = m_chain->prev;
-            m_it = m_chain->end;
-        }
-        --m_it;
+    inline void afterDecrease() {
+        if (m_pos < m_chain->m_segments[m_segment].offset)
+            m_segment = m_chain->segmentOf(m_pos);
     }
 
 private: /* Fields: */
 
-    inner_iterator_type m_it;
-    const iterator_chain_item<Iter> * m_chain;
+    const iterator_chain<Iter> * m_chain;
+    std::size_t m_segment;
+    difference_type m_pos;
 
-}; /* struct chained_iterator { */
+}; /* class chained_iterator { */
 
+/**
+ * \brief Concatenation of contiguous iterator ranges.
+ * The segments are kept in a flat table, so building a chain costs one
+ * amortized allocation and whole segments can be copied or serialized in
+ * bulk. The chained ranges must stay valid while the chain is in use.
+ */
 template <typename Iter>
 class iterator_chain {
 
+    friend class chained_iterator<Iter>;
+
+public: /* Types: */
+
+    using iterator = chained_iterator<Iter>;
+    using const_iterator = chained_iterator<Iter>;
+    using value_type = typename std::iterator_traits<Iter>::value_type;
+    using difference_type = typename std::iterator_traits<Iter>::difference_type;
+    using size_type = std::size_t;
+
 public: /* Methods: */
 
     inline iterator_chain()
-        : m_begin(nullptr)
-        , m_end(nullptr) {}
+        : m_size(0) {}
 
-    inline iterator_chain(const iterator_chain<Iter> & copy) {
-        assignInner(copy);
-    }
+    inline void reserve(const size_type numSegments) { m_segments.reserve(numSegments); }
 
-    inline ~iterator_chain() {
-        destroyInner(m_begin);
+    inline chained_iterator<Iter> begin() const {
+        if (m_segments.empty())
+            return chained_iterator<Iter>();
+        return chained_iterator<Iter>(this, 0);
     }
 
-    iterator_chain<Iter> & operator=(const iterator_chain<Iter> & rhs) {
-        iterator_chain_item<Iter> * oldBegin = m_begin;
-        iterator_chain_item<Iter> * oldEnd = m_end;
-        try {
-            assignInner(rhs);
-        } catch (...) {
-            m_begin = oldBegin;
-            m_end = oldEnd;
-            throw;
-        }
+    inline chained_iterator<Iter> end() const {
+        if (m_segments.empty())
+            return chained_iterator<Iter>();
+        return chained_iterator<Iter>(this, m_size);
     }
 
-    chained_iterator<Iter> begin() {
-        if (m_begin)
-            return chained_iterator<Iter>(m_begin->begin, m_begin);
-        return chained_iterator<Iter>();
+    inline size_type size() const { return static_cast<size_type>(m_size); }
+    inline bool empty() const { return m_size == 0; }
+    inline size_type num_segments() const { return m_segments.size(); }
+    inline const iterator_chain_item<Iter> & segment(const size_type i) const { return m_segments[i]; }
+
+    void push_back(const Iter begin, const Iter end) {
+        assert(begin <= end);
+        m_segments.push_back(iterator_chain_item<Iter>{begin, end, m_size});
+        m_size += end - begin;
     }
 
-    chained_iterator<Iter> end() {
-        if (m_end)
-            return chained_iterator<Iter>(m_end->end, m_end);
-        return chained_iterator<Iter>();
+    /** Calls \a f (first, last) with raw pointers for every non-empty segment. */
+    template <typename F>
+    void for_each_segment(F f) const {
+        for (const iterator_chain_item<Iter> & item : m_segments)
+            if (item.begin != item.end)
+                f(&*item.begin, &*item.begin + (item.end - item.begin));
     }
 
-    void push_back(const Iter begin, const Iter end) {
-        iterator_chain_item<Iter> ** op;
-        if (m_end) {
-            assert(m_begin);
-            op = &(m_end->next);
-        } else {
-            assert(!m_begin);
-            op = &m_begin;
-        }
-        (*op) = new iterator_chain_item<Iter>;
-        (*op)->begin = begin;
-        (*op)->end = end;
-        (*op)->prev = m_end;
-        (*op)->next = nullptr;
-        m_end = (*op);
+    /** Copies all elements to \a out one segment at a time. */
+    template <typename OutputIterator>
+    OutputIterator copy(OutputIterator out) const {
+        for_each_segment([&out](const value_type * first, const value_type * last) {
+            out = std::copy(first, last, out);
+        });
+        return out;
     }
 
-private: /* Methods: */
+    /** Writes all elements to the message one segment at a time. */
+    template <typename OutMessage>
+    void serialize(OutMessage & msg) const {
+        for_each_segment([&msg](const value_type * first, const value_type * last) {
+            msg.writeArray(first, static_cast<size_type>(last - first));
+        });
+    }
 
-    inline void assignInner(const iterator_chain<Iter> & v) {
-        if (v.m_begin) {
-            assert(v.m_end);
-            assert(!v.m_begin->prev);
-            iterator_chain_item<Iter> ** op = &m_begin;
-            try {
-                iterator_chain_item<Iter> ** ip = &v.m_begin;
-                for (;;) {
-                    // Exceptions in this method are only generated by this memory allocation:
-                    (*op) = new iterator_chain_item<Iter>(**ip);
-                    ip = &((*ip)->next);
-                    if (!*ip) {
-                        (*op)->next = nullptr;
-                        break;
-                    }
-                    op = &((*op)->next);
-                }
-                m_end = (*op);
-            } catch (...) {
-                destroyInner(*op);
-                throw;
-            }
-        } else {
-            assert(!v.m_end);
-            m_begin = m_end = nullptr;
-        }
+    /**
+     * Adds all segments to the message by reference.
+     * \see ShareVec::serialize_zero_copy
+     */
+    template <typename OutMessage>
+    void serialize_zero_copy(OutMessage & msg) const {
+        for_each_segment([&msg](const value_type * first, const value_type * last) {
+            msg.writeArrayRef(first, static_cast<size_type>(last - first));
+        });
     }
 
-    static inline void destroyInner(iterator_chain_item<Iter> * chainBegin) {
-        while (chainBegin) {
-            iterator_chain_item<Iter> * const i = chainBegin;
-            chainBegin = chainBegin->next;
-            delete i;
+private: /* Methods: */
+
+    /* \returns the index of the last segment starting at or before pos. */
+    inline size_type segmentOf(const difference_type pos) const {
+        assert(!m_segments.empty());
+        size_type lo = 0u;
+        size_type hi = m_segments.size();
+        while (hi - lo > 1u) {
+            size_type const mid = lo + (hi - lo) / 2u;
+            if (m_segments[mid].offset <= pos)
+                lo = mid;
+            else
+                hi = mid;
         }
+        return lo;
     }
 
 private: /* Fields: */
 
-    iterator_chain_item<Iter> * m_begin;
-    iterator_chain_item<Iter> * m_end;
+    std::vector<iterator_chain_item<Iter> > m_segments;
+    difference_type m_size;
 
-};
+}; /* class iterator_chain { */
+
+/**
+ * \brief Tag for constructing and resizing share vectors without
+ * initializing the new elements.
+ * Use only when every element is overwritten before it is read, for example
+ * by randomize(), deserialize() or a protocol writing its output.
+ */
+struct __attribute__ ((visibility("internal"))) no_init_t { };
+constexpr no_init_t no_init {};
+
+/**
+ * Allocator adaptor turning value-initialization into default-initialization,
+ * i.e. a no-op for the integral share types.
+ */
+template <typename Allocator>
+class __attribute__ ((visibility("internal"))) default_init_allocator : public Allocator {
+
+private: /* Types: */
+
+    using traits = std::allocator_traits<Allocator>;
+
+public: /* Types: */
+
+    template <typename U>
+    struct rebind {
+        using other = default_init_allocator<typename traits::template rebind_alloc<U> >;
+    };
+
+public: /* Methods: */
+
+    default_init_allocator() = default;
+
+    default_init_allocator(const Allocator & alloc) noexcept
+        : Allocator(alloc)
+    { }
+
+    template <typename U>
+    void construct(U * p) noexcept(std::is_nothrow_default_constructible<U>::value)
+    { ::new (static_cast<void *>(p)) U; }
+
+    template <typename U, typename ... Args>
+    void construct(U * p, Args && ... args) {
+        traits::construct(static_cast<Allocator &>(*this), p,
+                          std::forward<Args>(args)...);
+    }
+
+}; /* class default_init_allocator { */
 
 template <typename Iter >
 struct share_iterator_unwrap {
@@ -315,25 +407,36 @@ struct share_iterator_unwrap<share_const_iterator<T, C> > {
 
 /**
  * Flat vector of shares.
+ * \tparam Allocator Allocator of the share storage, see ShareArenaAllocator
+ *                   for allocating protocol temporaries from a PDPI arena and
+ *                   AlignedShareAllocator for SIMD aligned storage.
  */
-template <typename T>
+template <typename T, typename Allocator>
 class __attribute__ ((visibility("internal"))) ShareVec : public ShareVecBase {
 public: /* Types: */
 
     using value_traits = T;
     using value_type = typename T::share_type;
-    using impl_t = typename std::vector<value_type>;
+    using allocator_type = Allocator;
+    using impl_t = typename std::vector<value_type, default_init_allocator<allocator_type> >;
     using reference = typename impl_t::reference;
     using const_reference = typename impl_t::const_reference;
     using size_type = typename impl_t::size_type;
 
-    using iterator = share_iterator<T, ShareVec<T> >;
-    using const_iterator = share_const_iterator<T, ShareVec<T> >;
+    using iterator = share_iterator<T, ShareVec>;
+    using const_iterator = share_const_iterator<T, ShareVec>;
+
+    static_assert(std::is_same<typename allocator_type::value_type, value_type>::value,
+                  "Allocator must allocate values of the share type.");
 
 public: /* Methods: */
 
     inline ShareVec () {}
 
+    explicit inline ShareVec (const allocator_type & alloc)
+        : m_vector (alloc)
+    { }
+
     ShareVec(const ShareVec &) = delete;
     ShareVec& operator=(const ShareVec&) = delete;
 
@@ -350,19 +453,33 @@ public: /* Methods: */
         x.m_vector.swap(y.m_vector);
     }
 
-    explicit inline ShareVec (size_type size, const value_type& defaultValue = value_type {})
-        : m_vector (size, defaultValue)
+    explicit inline ShareVec (size_type size,
+                              const value_type& defaultValue = value_type {},
+                              const allocator_type & alloc = allocator_type ())
+        : m_vector (size, defaultValue, alloc)
     { }
 
+    /**
+     * Constructs a vector of \a size elements that are left uninitialized.
+     * \see no_init_t
+     */
+    inline ShareVec (size_type size, no_init_t,
+                     const allocator_type & alloc = allocator_type ())
+        : m_vector (alloc)
+    { m_vector.resize (size); }
+
     template <typename InputIterator>
-    ShareVec (InputIterator begin, InputIterator end)
-        : m_vector (begin, end)
+    ShareVec (InputIterator begin, InputIterator end,
+              const allocator_type & alloc = allocator_type ())
+        : m_vector (begin, end, alloc)
     { }
 
     static constexpr typename T::value_category value_category () {
         return typename T::value_category ();
     }
 
+    inline allocator_type get_allocator () const { return m_vector.get_allocator (); }
+
     inline value_type * data() { return m_vector.data(); }
     inline const value_type * data() const { return m_vector.data(); }
     inline const value_type * cdata() const { return m_vector.data(); }
@@ -373,8 +490,24 @@ public: /* Methods: */
     inline const_iterator cend() const { return const_iterator(m_vector.end()); }
     inline const_iterator begin() const { return cbegin(); }
     inline const_iterator end() const { return cend(); }
-    inline void resize (size_type sz) { m_vector.resize (sz); }
+    inline void resize (size_type sz) { m_vector.resize (sz, value_type ()); }
     inline bool empty () const { return m_vector.empty (); }
+    inline size_type capacity () const { return m_vector.capacity (); }
+    inline void reserve (size_type n) { m_vector.reserve (n); }
+    inline void clear () noexcept override { m_vector.clear (); }
+
+    std::size_t allocated_bytes () const noexcept override
+    { return m_vector.capacity () * sizeof (value_type); }
+
+    /** \returns the storage of a vector of \a n elements. */
+    static std::size_t bytes_for (size_type n) noexcept
+    { return n * sizeof (value_type); }
+
+    /**
+     * Resizes the vector leaving any new elements uninitialized.
+     * \see no_init_t
+     */
+    inline void resize_uninitialized (size_type sz) { m_vector.resize (sz); }
 
     inline const_reference operator [] (size_type i) const {
         assert (i < size () && "operator[]: Index out of bounds.");
@@ -386,8 +519,8 @@ public: /* Methods: */
         return m_vector[i];
     }
 
-    inline void clear_and_release () {
-        impl_t ().swap (m_vector);
+    inline void clear_and_release () noexcept override {
+        impl_t (m_vector.get_allocator ()).swap (m_vector);
     }
 
     template <typename InputIterator>
@@ -407,8 +540,9 @@ public: /* Methods: */
         m_vector.push_back(val);
     }
 
-    inline void assign (const ShareVec& vec) {
-        assign (vec.begin (), vec.end ());
+    template <typename OtherAllocator>
+    inline void assign (const ShareVec<T, OtherAllocator>& vec) {
+        m_vector.assign (vec.cdata (), vec.cdata () + vec.size ());
     }
 
     inline void assign (const size_type n, const value_type& val) {
@@ -430,6 +564,37 @@ public: /* Methods: */
     void serialize(OutMessage & msg) const
     { msg.writeArray(begin_ptr(), size()); }
 
+    /**
+     * Adds the shares to the message by reference, they are copied only by
+     * the network when the message is sent.
+     * \pre The vector must not be modified, resized or destroyed before the
+     *      message has been sent.
+     */
+    template <typename OutMessage>
+    void serialize_zero_copy(OutMessage & msg) const
+    { msg.writeArrayRef(begin_ptr(), size()); }
+
+    /** Reads the shares [begin, end) from the message. */
+    template <typename InMessage>
+    bool deserialize_range(InMessage & msg, const size_type begin, const size_type end) {
+        assert(begin <= end && end <= size());
+        return msg.readArray(begin_ptr() + begin, end - begin);
+    }
+
+    /** Writes the shares [begin, end) to the message. */
+    template <typename OutMessage>
+    void serialize_range(OutMessage & msg, const size_type begin, const size_type end) const {
+        assert(begin <= end && end <= size());
+        msg.writeArray(begin_ptr() + begin, end - begin);
+    }
+
+    /** \see serialize_zero_copy */
+    template <typename OutMessage>
+    void serialize_range_zero_copy(OutMessage & msg, const size_type begin, const size_type end) const {
+        assert(begin <= end && end <= size());
+        msg.writeArrayRef(begin_ptr() + begin, end - begin);
+    }
+
     void setBit (size_type i, bool value) {
         static_assert(T::num_of_bits != 0, "Vector with 0-bit elements.");
         const size_type block_index = i / T::num_of_bits;
@@ -450,6 +615,17 @@ public: /* Methods: */
         return (m_vector[block_index] & (value_type (1) << bit_index)) != 0;
     }
 
+    /**
+     * Evaluates an elementwise expression over share vectors in a single
+     * pass, resizing this vector to the length of the operands.
+     * \see ShareVecExpr.h
+     */
+    template <typename Expr>
+    inline ShareVec & operator = (const share_expr<Expr> & expr) {
+        evaluate_share_expr (*this, static_cast<const Expr &>(expr));
+        return *this;
+    }
+
     friend inline bool operator == (const ShareVec& x, const ShareVec& y)
     { return x.m_vector == y.m_vector; }
 
@@ -480,6 +656,9 @@ public: /* Types: */
     using reference = impl_t::reference;
     using const_reference = impl_t::const_reference;
     using size_type = impl_t::size_type;
+    using block_type = uint64_t;
+
+    static constexpr size_type bits_per_block = sizeof(block_type) * 8u;
 
 public: /* Methods: */
 
@@ -505,6 +684,14 @@ public: /* Methods: */
         : m_vector (size, defaultValue)
     { }
 
+    /**
+     * Provided for generic code, the bits of a BitShareVec are always
+     * initialized as BitVec does not support uninitialized storage.
+     */
+    inline BitShareVec (size_type size, no_init_t)
+        : m_vector (size)
+    { }
+
     static constexpr typename BitShareType::value_category value_category () {
         return typename BitShareType::value_category ();
     }
@@ -512,8 +699,28 @@ public: /* Methods: */
     inline void* data() { return m_vector.data(); }
     inline const void* data() const { return m_vector.data(); }
 
+    /** \returns the storage blocks, bit i is bit i % 64 of block i / 64. */
+    inline block_type * blocks() { return static_cast<block_type *>(data()); }
+    inline const block_type * blocks() const { return static_cast<const block_type *>(data()); }
+    inline size_type num_blocks() const { return (size() + bits_per_block - 1u) / bits_per_block; }
+
+    /** Zeroes the bits of the last block that are past the end of the vector. */
+    inline void clear_unused_bits() {
+        if (const size_type used = size() % bits_per_block)
+            blocks()[num_blocks() - 1u] &= (block_type(1u) << used) - 1u;
+    }
+
     inline size_type size() const { return m_vector.size (); }
     inline void resize (size_type sz) { m_vector.resize (sz); }
+    inline void clear () noexcept override { m_vector.resize (0u); }
+
+    std::size_t allocated_bytes () const noexcept override
+    { return num_blocks () * sizeof (block_type); }
+
+    /** \returns the storage of a vector of \a n elements. */
+    static std::size_t bytes_for (size_type n) noexcept
+    { return (n / bits_per_block + (n % bits_per_block != 0u)) * sizeof (block_type); }
+    inline void resize_uninitialized (size_type sz) { m_vector.resize (sz); }
     inline bool empty () const { return m_vector.empty (); }
     inline void assign (const BitShareVec& vec) { m_vector.assign (vec.m_vector); }
     inline void assign (const size_type n, const value_type& val) { m_vector.assign (n, val); }
@@ -533,7 +740,7 @@ public: /* Methods: */
         m_vector.assign (begin, end);
     }
 
-    inline void clear_and_release () {
+    inline void clear_and_release () noexcept override {
         m_vector.clear_and_release ();
     }
 
@@ -547,6 +754,91 @@ public: /* Methods: */
     BitShareVec& operator &= (const BitShareVec& other) { m_vector &= other.m_vector; return *this; }
     BitShareVec& operator ^= (const BitShareVec& other) { m_vector ^= other.m_vector; return *this; }
 
+    /*
+     * The following operations work on whole blocks, the loops are simple
+     * enough for the compiler to vectorize.
+     */
+
+    BitShareVec& operator |= (const BitShareVec& other) {
+        assert (size () == other.size ());
+        block_type * const out = blocks ();
+        const block_type * const in = other.blocks ();
+        for (size_type i = 0u, n = num_blocks (); i < n; ++ i)
+            out[i] |= in[i];
+        return *this;
+    }
+
+    /** Sets every bit i to mask[i] ? a[i] : b[i]. */
+    BitShareVec& select (const BitShareVec& mask, const BitShareVec& a, const BitShareVec& b) {
+        assert (mask.size () == a.size () && a.size () == b.size ());
+        resize_uninitialized (mask.size ());
+        block_type * const out = blocks ();
+        const block_type * const m = mask.blocks ();
+        const block_type * const x = a.blocks ();
+        const block_type * const y = b.blocks ();
+        for (size_type i = 0u, n = num_blocks (); i < n; ++ i)
+            out[i] = y[i] ^ (m[i] & (x[i] ^ y[i]));
+        return *this;
+    }
+
+    /** Moves every bit i to index i + n, the lowest n bits become zero. */
+    BitShareVec& shift_left (const size_type n) {
+        clear_unused_bits ();
+        shiftBlocksUp (blocks (), blocks (), num_blocks (), n);
+        clear_unused_bits ();
+        return *this;
+    }
+
+    /** Moves every bit i to index i - n, the highest n bits become zero. */
+    BitShareVec& shift_right (const size_type n) {
+        clear_unused_bits ();
+        shiftBlocksDown (blocks (), blocks (), num_blocks (), n);
+        return *this;
+    }
+
+    /** Moves every bit i to index (i + n) % size (). */
+    BitShareVec& rotate_left (size_type n) {
+        if (empty () || (n %= size ()) == 0u)
+            return *this;
+        clear_unused_bits ();
+        const size_type nb = num_blocks ();
+        std::vector<block_type> wrapped (nb);
+        shiftBlocksDown (wrapped.data (), blocks (), nb, size () - n);
+        shiftBlocksUp (blocks (), blocks (), nb, n);
+        block_type * const out = blocks ();
+        for (size_type i = 0u; i < nb; ++ i)
+            out[i] |= wrapped[i];
+        clear_unused_bits ();
+        return *this;
+    }
+
+    /** Moves every bit i to index (i + size () - n % size ()) % size (). */
+    BitShareVec& rotate_right (const size_type n) {
+        return empty () ? *this : rotate_left (size () - n % size ());
+    }
+
+    /** \returns the number of set bits. */
+    size_type popcount () const {
+        const size_type nb = num_blocks ();
+        if (nb == 0u)
+            return 0u;
+        const block_type * const in = blocks ();
+        size_type r = 0u;
+        for (size_type i = 0u; i + 1u < nb; ++ i)
+            r += static_cast<size_type>(__builtin_popcountll (in[i]));
+        block_type last = in[nb - 1u];
+        if (const size_type used = size () % bits_per_block)
+            last &= (block_type(1u) << used) - 1u;
+        return r + static_cast<size_type>(__builtin_popcountll (last));
+    }
+
+    /** \see ShareVecExpr.h */
+    template <typename Expr>
+    inline BitShareVec & operator = (const bit_share_expr<Expr> & expr) {
+        evaluate_bit_share_expr (*this, static_cast<const Expr &>(expr));
+        return *this;
+    }
+
     friend inline bool operator == (const BitShareVec& x, const BitShareVec& y)
     { return x.m_vector == y.m_vector; }
 
@@ -555,6 +847,42 @@ public: /* Methods: */
 
     BitShareVec& flip () { m_vector.flip (); return *this; }
 
+private: /* Methods: */
+
+    /* dst[i + n] = src[i] over nb blocks, dst may be equal to src. */
+    static void shiftBlocksUp (block_type * const dst, const block_type * const src,
+                               const size_type nb, const size_type n)
+    {
+        const size_type words = n / bits_per_block;
+        const unsigned bits = static_cast<unsigned>(n % bits_per_block);
+        for (size_type i = nb; i -- > 0u; ) {
+            block_type r = 0u;
+            if (i >= words) {
+                r = src[i - words] << bits;
+                if (bits != 0u && i > words)
+                    r |= src[i - words - 1u] >> (bits_per_block - bits);
+            }
+            dst[i] = r;
+        }
+    }
+
+    /* dst[i] = src[i + n] over nb blocks, dst may be equal to src. */
+    static void shiftBlocksDown (block_type * const dst, const block_type * const src,
+                                 const size_type nb, const size_type n)
+    {
+        const size_type words = n / bits_per_block;
+        const unsigned bits = static_cast<unsigned>(n % bits_per_block);
+        for (size_type i = 0u; i < nb; ++ i) {
+            block_type r = 0u;
+            if (i + words < nb) {
+                r = src[i + words] >> bits;
+                if (bits != 0u && i + words + 1u < nb)
+                    r |= src[i + words + 1u] << (bits_per_block - bits);
+            }
+            dst[i] = r;
+        }
+    }
+
 protected: /* Fields: */
 
     impl_t m_vector;
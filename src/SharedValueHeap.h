@@ -20,8 +20,18 @@
 #ifndef SHAREMIND_PDKHEADERS_SHAREDVALUEHEAP_H
 #define SHAREMIND_PDKHEADERS_SHAREDVALUEHEAP_H
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <map>
+#include <new>
+#include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
+#include "HeapSnapshot.h"
+#include "ParallelChunks.h"
+#include "ShareArena.h"
 #include "ShareVector.h"
 #include "ValueTraits.h"
 
@@ -31,12 +41,118 @@ namespace sharemind {
 /**
  * \brief Heap of share vectors.
  * This class tracks in a type safe manner all of the allocated share vectors.
+ *
+ * The vectors are stored in a generational slot map. A vector inserted with
+ * insert_handle() is referred to by a compact handle encoding its slot index
+ * and the generation of the slot, which is validated and type checked with a
+ * single array lookup and becomes invalid once the vector is erased. Handles
+ * are tagged with the lowest bit set, so they never collide with pointers.
+ * Vectors inserted with insert() are referred to by their address as before,
+ * such handles are looked up in an additional hash map, which reserve() can
+ * presize. On targets with pointers narrower than 64 bits there is no room
+ * for tagged handles and all handles are addresses.
+ *
+ * Like before, handles are checked and erased by the heap_type_id of the
+ * vector only, whereas get() requires the exact ShareVec type including its
+ * allocator, as it returns a typed pointer.
+ *
+ * If enabled with set_recycle_limits(), erased vectors are kept, with their
+ * storage, in bounded per type pools and are handed out again by allocate()
+ * for the same type. Recycling is disabled by default.
+ *
+ * The vectors of a whole scope can be allocated, inserted and erased at once
+ * with allocate_many(), insert_many() and erase_many(), which check the quota
+ * once and free the erased vectors after all of their slots are released.
+ *
+ * Vectors created with allocate_in_arena() live, together with their
+ * storage, in an arena owned by the heap. They are never recycled and are
+ * not visited when the heap is destroyed, the arena is released at once.
+ * A value type opts all of its vectors allocated with allocate_many(), and
+ * hence with the new_vec_many syscall, into the arena by defining
+ * \code
+ * using share_allocator = ShareArenaAllocator<share_type>;
+ * \endcode
+ * ShareVec<T> is then the type of the arena vectors, so MetaSyscalls resolve
+ * them like any other vector.
+ *
+ * Every stored vector is tagged with the HeapAllocationSite active when it
+ * was inserted. snapshot() summarizes the live vectors by heap_type_id, size
+ * and site, and optionally the allocations sampled since profiling was
+ * enabled with set_profile_sampling().
  */
 class __attribute__ ((visibility("internal"))) SharedValueHeap {
 
 private: /* Types: */
 
-    using impl_t = std::unordered_map<ShareVecBase *, uint8_t>;
+    /* Identifies the exact ShareVec type by its address. */
+    struct VecType {
+        std::size_t objectBytes;
+        bool statelessAllocator; /**< Vectors may be deleted concurrently. */
+    };
+
+    struct Slot {
+        ShareVecBase * vec; /**< The stored vector or null if the slot is free. */
+        const VecType * vecType;
+        uint32_t generation;
+        uint32_t nextFree;
+        uint8_t heapTypeId;
+        bool inArena; /**< The vector object lives in m_arena. */
+        std::size_t bytes; /**< Storage accounted for the vector. */
+        const char * site; /**< HeapAllocationSite of the insertion. */
+    };
+
+    using legacy_t = std::unordered_map<ShareVecBase *, uint32_t>;
+
+    /* Whether a pointer can hold the slot index and generation of a tagged handle: */
+    static constexpr bool taggedHandles = sizeof (uintptr_t) >= sizeof (uint64_t);
+
+    static constexpr uint32_t noSlot = UINT32_MAX;
+    static constexpr uint32_t maxGeneration = UINT32_MAX >> 1u;
+
+    /* Erased storage from which the vectors are deleted in parallel. */
+    static constexpr std::size_t parallelDeleteBytes = 16u * 1024u * 1024u;
+
+public: /* Types: */
+
+    /** \brief Bounds of the pool of erased vectors of a type. */
+    struct RecycleLimits {
+        std::size_t maxVectors; /**< Zero disables recycling. */
+        std::size_t maxBytes; /**< Storage kept in all vectors of the pool. */
+    };
+
+    struct RecycleStats {
+        uint64_t hits = 0u; /**< Allocations served from the pool. */
+        uint64_t misses = 0u; /**< Allocations of new vectors. */
+        uint64_t recycled = 0u; /**< Erased vectors put to the pool. */
+        uint64_t dropped = 0u; /**< Erased vectors deleted as the pool was full. */
+        std::size_t pooledVectors = 0u;
+        std::size_t pooledBytes = 0u;
+    };
+
+    /** \brief Share storage held by live (inserted) vectors. */
+    struct MemoryUsage {
+        std::size_t currentBytes = 0u;
+        std::size_t peakBytes = 0u;
+        std::size_t liveVectors = 0u;
+        uint64_t allocations = 0u; /**< Number of vectors inserted. */
+        uint64_t deallocations = 0u; /**< Number of vectors erased. */
+    };
+
+    /**
+     * \brief Limits on the share storage of the heap, counting both live and
+     * pooled vectors.
+     * Pooled vectors are freed when the soft limit is exceeded. Inserting,
+     * allocating or growing vectors past the hard limit fails with
+     * std::bad_alloc, which syscalls report as
+     * SHAREMIND_MODULE_API_0x1_OUT_OF_MEMORY.
+     * \note The heap does not see vectors grow inside protocols, growth is
+     *       enforced after the fact by update_usage(). Callers that know the
+     *       size of an output beforehand can fail early with check_usage().
+     */
+    struct MemoryQuota {
+        std::size_t softBytes;
+        std::size_t hardBytes;
+    };
 
 public: /* Methods: */
 
@@ -45,12 +161,190 @@ public: /* Methods: */
     SharedValueHeap & operator=(const SharedValueHeap &) = delete;
 
     /**
-     * Frees all stored share vectors.
+     * Frees all stored and pooled share vectors. Vectors in the arena are
+     * released with the arena, the others are deleted in parallel if they
+     * hold much storage and their allocator is stateless. The slots are not
+     * visited if all stored vectors are in the arena, and with tagged
+     * handles the address handle map only holds vectors stored by insert().
      */
     ~SharedValueHeap () {
-        for (impl_t::iterator i = m_pointers.begin (), e = m_pointers.end (); i != e; ++ i) {
-            delete i->first;
+        std::vector<ShareVecBase *> concurrent;
+        std::size_t concurrentBytes = 0u;
+        const auto dispose = [&concurrent, &concurrentBytes] (ShareVecBase * const vec,
+                                                              const VecType * const vecType) noexcept
+        {
+            if (vecType->statelessAllocator) {
+                try {
+                    concurrent.push_back (vec);
+                    concurrentBytes += vec->allocated_bytes ();
+                    return;
+                } catch (...) {
+                    /* Delete it serially. */
+                }
+            }
+            delete vec;
+        };
+
+        if (m_size > m_arenaVectors)
+            for (const Slot & slot : m_slots)
+                if (slot.vec && ! slot.inArena)
+                    dispose (slot.vec, slot.vecType);
+
+        for (RecyclePool & pool : m_pools)
+            for (ShareVecBase * const vec : pool.vectors)
+                dispose (vec, pool.vecType);
+
+        deleteVectors (concurrent, concurrentBytes >= parallelDeleteBytes);
+        /* The arena vectors are not destroyed, their storage is in the arena too: */
+        m_arena.release_abandoned ();
+    }
+
+    /**
+     * Allocates a share vector of \a size value initialized elements, reusing
+     * an erased vector of the same type if one is pooled. The vector is not
+     * stored in the heap until it is inserted.
+     */
+    template <typename T, typename Allocator = typename share_allocator_of<T>::type>
+    ShareVec<T, Allocator> * allocate (const std::size_t size = 0u) {
+        ShareVec<T, Allocator> * const vec = allocate<T, Allocator> (size, no_init);
+        std::fill (vec->begin (), vec->end (), typename ValueTraits<T>::share_type ());
+        return vec;
+    }
+
+    /**
+     * Allocates a share vector of \a size value initialized elements in the
+     * arena of the heap and stores it. The vector is a ShareVec<T,
+     * ShareArenaAllocator<share_type> >, which is the type to look it up with
+     * get().
+     * \returns the handle of the vector.
+     * \throws std::bad_alloc If allocation fails or the hard quota would be
+     *         exceeded.
+     */
+    template <typename T>
+    void * allocate_in_arena (const std::size_t size) {
+        using S = typename ValueTraits<T>::share_type;
+        using Vec = ShareVec<T, ShareArenaAllocator<S> >;
+        if (size > SIZE_MAX / sizeof (S))
+            throw std::bad_alloc ();
+        ensureQuota (size * sizeof (S));
+
+        void * const mem = m_arena.allocate (sizeof (Vec));
+        Vec * vec;
+        try {
+            vec = new (mem) Vec (size, S (), ShareArenaAllocator<S> (m_arena));
+        } catch (...) {
+            m_arena.deallocate (mem, sizeof (Vec));
+            throw;
+        }
+
+        uint32_t index;
+        try {
+            index = reserveHandleSlot (vec);
+        } catch (...) {
+            destroyInArena (vec, vecTypeTag<Vec> ());
+            throw;
+        }
+
+        fillSlot<T, ShareArenaAllocator<S> > (index, vec);
+        m_slots[index].inArena = true;
+        ++ m_arenaVectors;
+        return handleOf (index);
+    }
+
+    /**
+     * \see allocate, the elements are left uninitialized.
+     * \warning A recycled vector still holds the shares of the vector it was
+     *          erased as, the caller must overwrite all elements.
+     */
+    template <typename T, typename Allocator = typename share_allocator_of<T>::type>
+    ShareVec<T, Allocator> * allocate (const std::size_t size, no_init_t) {
+        using Vec = ShareVec<T, Allocator>;
+        if (size > SIZE_MAX / sizeof (typename ValueTraits<T>::share_type))
+            throw std::bad_alloc ();
+        ensureQuota (size * sizeof (typename ValueTraits<T>::share_type));
+        RecyclePool & pool = recyclePool (vecTypeTag<Vec> (), ValueTraits<T>::heap_type_id);
+        if (pool.vectors.empty ()) {
+            ++ pool.stats.misses;
+            return new Vec (size, no_init);
+        }
+
+        /* Prefer the most recently erased vector with enough capacity: */
+        std::size_t k = pool.vectors.size () - 1u;
+        for (std::size_t i = pool.vectors.size (); i -- > 0u; ) {
+            if (static_cast<Vec *>(pool.vectors[i])->capacity () >= size) {
+                k = i;
+                break;
+            }
+        }
+
+        Vec * const vec = static_cast<Vec *>(pool.vectors[k]);
+        pool.vectors[k] = pool.vectors.back ();
+        pool.vectors.pop_back ();
+        pool.stats.pooledBytes -= vec->allocated_bytes ();
+        m_pooledBytes -= vec->allocated_bytes ();
+        -- pool.stats.pooledVectors;
+        ++ pool.stats.hits;
+
+        try {
+            vec->resize_uninitialized (size);
+        } catch (...) {
+            delete vec;
+            throw;
+        }
+
+        return vec;
+    }
+
+    /** Sets the pool limits of types that have no limits of their own. */
+    void set_recycle_limits (const RecycleLimits & limits) {
+        m_defaultLimits = limits;
+        for (RecyclePool & pool : m_pools)
+            if (! pool.ownLimits)
+                applyLimits (pool, limits);
+    }
+
+    /** Sets the pool limits of all types with the given heap_type_id. */
+    void set_recycle_limits (const uint8_t heapTypeId, const RecycleLimits & limits) {
+        m_typeLimits[heapTypeId] = limits;
+        for (RecyclePool & pool : m_pools) {
+            if (pool.heapTypeId == heapTypeId) {
+                pool.ownLimits = true;
+                applyLimits (pool, limits);
+            }
+        }
+    }
+
+    /** \returns the pool counters summed over types with the given heap_type_id. */
+    RecycleStats recycle_stats (const uint8_t heapTypeId) const {
+        RecycleStats r;
+        for (const RecyclePool & pool : m_pools) {
+            if (pool.heapTypeId == heapTypeId) {
+                r.hits += pool.stats.hits;
+                r.misses += pool.stats.misses;
+                r.recycled += pool.stats.recycled;
+                r.dropped += pool.stats.dropped;
+                r.pooledVectors += pool.stats.pooledVectors;
+                r.pooledBytes += pool.stats.pooledBytes;
+            }
+        }
+        return r;
+    }
+
+    template <typename T>
+    RecycleStats recycle_stats () const {
+        return recycle_stats (ValueTraits<T>::heap_type_id);
+    }
+
+    /** Deletes all pooled vectors. */
+    void trim_recycled () noexcept {
+        for (RecyclePool & pool : m_pools) {
+            for (ShareVecBase * const vec : pool.vectors)
+                delete vec;
+            pool.vectors.clear ();
+            pool.stats.pooledVectors = 0u;
+            pool.stats.pooledBytes = 0u;
         }
+        m_pooledBytes = 0u;
     }
 
     /**
@@ -58,33 +352,190 @@ public: /* Methods: */
      * \param[in] vec Vector to be inserted into the heap.
      * \retval true If vector was inserted into the heap successfully, and it wasn't stored in the heap before.
      * \retval false If vec was null pointer, or if the vector was already stored in the heap.
+     * \throws std::bad_alloc If the hard quota would be exceeded, the vector is not stored then.
+     */
+    template <typename T, typename Allocator>
+    bool insert (ShareVec<T, Allocator>* vec) {
+        if (! vec)
+            return false;
+
+        const std::pair<legacy_t::iterator, bool> r =
+                m_legacy.insert (std::make_pair (static_cast<ShareVecBase *>(vec), uint32_t (noSlot)));
+        if (! r.second)
+            return false;
+
+        uint32_t index;
+        try {
+            ensureQuota (vec->allocated_bytes ());
+            index = reserveSlot ();
+        } catch (...) {
+            m_legacy.erase (r.first);
+            throw;
+        }
+
+        r.first->second = index;
+        fillSlot<T, Allocator> (index, vec);
+        return true;
+    }
+
+    /**
+     * Reserves room for \a n stored vectors in total, so that storing them
+     * does not grow or rehash the tables of the heap.
+     */
+    void reserve (const std::size_t n) {
+        m_slots.reserve (std::min (n, std::size_t (noSlot)));
+        m_legacy.reserve (n);
+    }
+
+    /**
+     * Inserts a share vector of type T into the heap.
+     * \param[in] vec Vector to be inserted into the heap, must not be stored in the heap already.
+     * \returns the handle of the vector or null if vec was null pointer.
+     * \throws std::bad_alloc If the hard quota would be exceeded, the vector is not stored then.
+     */
+    template <typename T, typename Allocator>
+    void * insert_handle (ShareVec<T, Allocator>* vec) {
+        if (! vec)
+            return nullptr;
+
+        ensureQuota (vec->allocated_bytes ());
+        const uint32_t index = reserveHandleSlot (vec);
+        fillSlot<T, Allocator> (index, vec);
+        return handleOf (index);
+    }
+
+    /**
+     * Inserts \a n share vectors of type T into the heap and writes their
+     * handles to \a hndls. Null vectors get null handles.
+     * \throws std::bad_alloc If the hard quota would be exceeded by all of the
+     *         vectors together, none of the vectors is stored then.
+     */
+    template <typename T, typename Allocator>
+    void insert_many (ShareVec<T, Allocator> * const * vecs, const std::size_t n, void ** hndls) {
+        std::size_t bytes = 0u;
+        for (std::size_t i = 0u; i < n; ++ i)
+            if (vecs[i])
+                bytes += vecs[i]->allocated_bytes ();
+
+        ensureQuota (bytes);
+        if (n > std::size_t (noSlot) - m_slots.size ())
+            throw std::bad_alloc ();
+        /* Keep geometric growth, reserveSlot() must not throw below: */
+        if (m_slots.capacity () - m_slots.size () < n)
+            m_slots.reserve (std::max (m_slots.size () + n, 2u * m_slots.capacity ()));
+
+        if (! taggedHandles) {
+            /* Register all addresses first, so that nothing throws below: */
+            std::size_t i = 0u;
+            try {
+                for (; i < n; ++ i)
+                    if (vecs[i])
+                        m_legacy.insert (std::make_pair (static_cast<ShareVecBase *>(vecs[i]), uint32_t (noSlot)));
+            } catch (...) {
+                while (i -- > 0u)
+                    if (vecs[i])
+                        m_legacy.erase (vecs[i]);
+                throw;
+            }
+        }
+
+        for (std::size_t i = 0u; i < n; ++ i) {
+            if (! vecs[i]) {
+                hndls[i] = nullptr;
+                continue;
+            }
+
+            const uint32_t index = reserveSlot ();
+            if (! taggedHandles)
+                m_legacy.find (vecs[i])->second = index;
+            fillSlot<T, Allocator> (index, vecs[i]);
+            hndls[i] = handleOf (index);
+        }
+    }
+
+    /**
+     * Allocates \a n share vectors of \a size value initialized elements,
+     * inserts them into the heap and writes their handles to \a hndls.
+     * The vectors are allocated one after another like with allocate(), only
+     * their insertion is done in one pass. If \a Allocator is
+     * ShareArenaAllocator<share_type> the vectors are allocated with
+     * allocate_in_arena() instead.
+     * \throws std::bad_alloc If allocation fails or the hard quota would be
+     *         exceeded, none of the vectors is stored then.
+     */
+    template <typename T, typename Allocator = typename share_allocator_of<T>::type>
+    void allocate_many (void ** hndls, const std::size_t n, const std::size_t size) {
+        using S = typename ValueTraits<T>::share_type;
+        allocateMany<T, Allocator> (hndls, n, size,
+                                    std::is_same<Allocator, ShareArenaAllocator<S> > ());
+    }
+
+    /**
+     * Erases share vectors of given type from the heap. Vectors that are not
+     * recycled are deleted after all of the handles are released, in parallel
+     * if they hold much storage and their allocator is stateless.
+     * \param[in] hndls Handles to share vectors, as accepted by erase_handle().
+     * \param[in] n The number of handles.
+     * \returns the number of erased vectors. Handles that are not stored in the
+     *          heap, or are stored with incorrect type, are skipped.
      */
     template <typename T>
-    bool insert (ShareVec<T>* vec) {
-        uint8_t heap_type_id = ValueTraits<T>::heap_type_id;
-        if (vec)
-            return m_pointers.insert (std::make_pair (static_cast<ShareVecBase *>(vec), heap_type_id)).second;
-        return false;
+    std::size_t erase_many (void * const * hndls, const std::size_t n) {
+        std::vector<ShareVecBase *> garbage;
+        garbage.reserve (n);
+
+        std::size_t erased = 0u;
+        std::size_t garbageBytes = 0u;
+        bool stateless = true;
+        for (std::size_t i = 0u; i < n; ++ i) {
+            const uint32_t index = findTyped<T> (hndls[i]);
+            if (index == noSlot)
+                continue;
+
+            ++ erased;
+            const VecType * const vecType = m_slots[index].vecType;
+            if (! isTagged (hndls[i]))
+                m_legacy.erase (static_cast<ShareVecBase *>(hndls[i]));
+            if (ShareVecBase * const vec = detachSlot (index)) {
+                garbageBytes += vec->allocated_bytes ();
+                garbage.push_back (vec);
+                stateless = stateless && vecType->statelessAllocator;
+            }
+        }
+
+        /* Deallocation through a stateful allocator, e.g. an arena, is not thread-safe. */
+        deleteVectors (garbage, stateless && garbageBytes >= parallelDeleteBytes);
+        return erased;
     }
 
     /**
      * Erases a share vector of given type from the heap.
      * \param[in] vec The vector to be erased.
      * \retval true If vector was successfully freed from the heap.
-     * \retval false If the vector was not stored, or was stored with incorrect type.
+     * \retval false If the vector was not stored with insert(), or was stored with incorrect type.
+     */
+    template <typename T, typename Allocator>
+    bool erase (ShareVec<T, Allocator>* vec) {
+        return eraseLegacy<T> (vec);
+    }
+
+    /**
+     * Erases a share vector of given type from the heap.
+     * \param[in] hndl A handle to a share vector.
+     * \retval true If vector was successfully freed from the heap.
+     * \retval false If the handle is not stored in the heap, or is stored with incorrect type.
      */
     template <typename T>
-    bool erase (ShareVec<T>* vec) {
-        impl_t::iterator i = m_pointers.find (vec);
-        if (i != m_pointers.end ()) {
-            if (i->second == ValueTraits<T>::heap_type_id) {
-                delete i->first;
-                m_pointers.erase (i);
-                return true;
-            }
-        }
+    bool erase_handle (void* hndl) {
+        if (! isTagged (hndl))
+            return eraseLegacy<T> (static_cast<ShareVecBase *>(hndl));
 
-        return false;
+        const uint32_t index = findTyped<T> (hndl);
+        if (index == noSlot)
+            return false;
+
+        freeSlot (index);
+        return true;
     }
 
     /**
@@ -92,20 +543,531 @@ public: /* Methods: */
      * \param[in] hndl A handle to a share vector.
      * \retval true If the \a hndl was stored in the heap with type \a T.
      * \retval false If the handle is not stored in the heap, or is stored with incorrect type.
+     * \note Only the heap_type_id of T is compared, the vector may have any
+     *       allocator, see check_exact().
      */
     template <typename T>
     bool check (void* hndl) const {
-        impl_t::const_iterator i = m_pointers.find (static_cast<ShareVecBase*>(hndl));
-        if (i != m_pointers.end ()) {
-            return (i->second == ValueTraits<T>::heap_type_id);
+        return findTyped<T> (hndl) != noSlot;
+    }
+
+    /**
+     * Checks if given handle is stored in the heap as a ShareVec<T, Allocator>.
+     * Unlike check(), vectors of type T with another allocator are rejected,
+     * PDPIs whose isValidHandle<T> is used by MetaSyscalls to cast handles to
+     * ShareVec<T> can implement it with this.
+     */
+    template <typename T, typename Allocator = typename share_allocator_of<T>::type>
+    bool check_exact (void* hndl) const {
+        return get<T, Allocator> (hndl) != nullptr;
+    }
+
+    /**
+     * Resolves a handle returned by insert_handle() or the address of a
+     * vector stored with insert().
+     * \param[in] hndl A handle to a share vector.
+     * \returns the vector or null if the handle is not stored in the heap, or is stored with incorrect type.
+     */
+    template <typename T, typename Allocator = typename share_allocator_of<T>::type>
+    ShareVec<T, Allocator> * get (void* hndl) const {
+        const uint32_t index = findLive (hndl);
+        return index == noSlot || m_slots[index].vecType != vecTypeTag<ShareVec<T, Allocator> > ()
+               ? nullptr
+               : static_cast<ShareVec<T, Allocator> *>(m_slots[index].vec);
+    }
+
+    /** \returns the number of stored vectors. */
+    std::size_t size () const { return m_size; }
+
+    /** \returns the usage of all live vectors. */
+    const MemoryUsage & memory_usage () const noexcept { return m_usage; }
+
+    /** \returns the usage of live vectors with the given heap_type_id. */
+    const MemoryUsage & memory_usage (const uint8_t heapTypeId) const noexcept
+    { return m_typeUsage[heapTypeId]; }
+
+    template <typename T>
+    const MemoryUsage & memory_usage () const noexcept
+    { return memory_usage (ValueTraits<T>::heap_type_id); }
+
+    /** \returns the storage held by pooled vectors. */
+    std::size_t pooled_bytes () const noexcept { return m_pooledBytes; }
+
+    const MemoryQuota & memory_quota () const noexcept { return m_quota; }
+
+    void set_memory_quota (const MemoryQuota & quota) {
+        m_quota = quota;
+        if (over_soft_quota ())
+            trim_recycled ();
+    }
+
+    bool over_soft_quota () const noexcept
+    { return m_usage.currentBytes + pooled_bytes () > m_quota.softBytes; }
+
+    /**
+     * Checks before a stored vector is resized that its storage may grow to
+     * \a bytes bytes within the hard quota. Nothing is reserved, the growth
+     * is accounted by update_usage() once it happens.
+     * \param[in] hndl A handle to a share vector.
+     * \retval false If the handle is not stored in the heap.
+     * \throws std::bad_alloc If the grown vector would exceed the hard quota.
+     */
+    bool check_usage (void* hndl, const std::size_t bytes) {
+        const uint32_t index = findLive (hndl);
+        if (index == noSlot)
+            return false;
+
+        if (bytes > m_slots[index].bytes)
+            ensureQuota (bytes - m_slots[index].bytes);
+        return true;
+    }
+
+    /**
+     * Updates the accounted storage of a stored vector, which may have been
+     * resized since it was inserted.
+     * \param[in] hndl A handle to a share vector.
+     * \retval false If the handle is not stored in the heap.
+     * \throws std::bad_alloc If the vector has grown past the hard quota. The
+     *         storage of the vector is freed then, leaving it empty, so that
+     *         the heap stays within the quota.
+     */
+    bool update_usage (void* hndl) {
+        const uint32_t index = findLive (hndl);
+        if (index == noSlot)
+            return false;
+
+        Slot & slot = m_slots[index];
+        const std::size_t bytes = slot.vec->allocated_bytes ();
+        if (bytes <= slot.bytes) {
+            subBytes (slot.heapTypeId, slot.bytes - bytes);
+            slot.bytes = bytes;
+            return true;
+        }
+
+        const std::size_t grown = bytes - slot.bytes;
+        try {
+            ensureQuota (grown);
+        } catch (const std::bad_alloc &) {
+            slot.vec->clear_and_release ();
+            const std::size_t left = slot.vec->allocated_bytes ();
+            subBytes (slot.heapTypeId, slot.bytes - std::min (slot.bytes, left));
+            slot.bytes = std::min (slot.bytes, left);
+            throw;
+        }
+
+        addBytes (slot.heapTypeId, grown);
+        slot.bytes = bytes;
+        /* Only growth within the quota is an allocation of the site: */
+        sampleAllocation (slot.heapTypeId, grown);
+        return true;
+    }
+
+    /**
+     * Enables the sampling allocation profiler, which attributes one sample
+     * per \a bytesPerSample bytes stored or grown to the active
+     * HeapAllocationSite. Zero disables profiling, samples are kept until
+     * clear_profile().
+     */
+    void set_profile_sampling (const std::size_t bytesPerSample) noexcept {
+        m_sampleBytes = bytesPerSample;
+        m_sampleCountdown = bytesPerSample;
+    }
+
+    void clear_profile () noexcept { m_profile.clear (); }
+
+    /** \returns a summary of the live and pooled vectors and the profile. */
+    HeapSnapshot snapshot () const {
+        HeapSnapshot r;
+        r.currentBytes = m_usage.currentBytes;
+        r.peakBytes = m_usage.peakBytes;
+        r.pooledBytes = pooled_bytes ();
+        r.liveVectors = m_usage.liveVectors;
+        for (const Slot & slot : m_slots) {
+            if (! slot.vec)
+                continue;
+
+            HeapSnapshot::TypeStats & type = r.types[slot.heapTypeId];
+            ++ type.liveVectors;
+            type.bytes += slot.bytes;
+            const std::size_t bucket = HeapSnapshot::sizeBucket (slot.bytes);
+            if (type.sizeHistogram.size () <= bucket)
+                type.sizeHistogram.resize (bucket + 1u);
+            ++ type.sizeHistogram[bucket];
+            HeapSnapshot::SiteStats & site = type.sites[slot.site ? slot.site : HeapSnapshot::unknownSite ()];
+            ++ site.vectors;
+            site.bytes += slot.bytes;
+        }
+
+        for (const RecyclePool & pool : m_pools) {
+            if (pool.vectors.empty ())
+                continue;
+            HeapSnapshot::TypeStats & type = r.types[pool.heapTypeId];
+            type.pooledVectors += pool.stats.pooledVectors;
+            type.pooledBytes += pool.stats.pooledBytes;
+        }
+
+        r.sampleBytes = m_sampleBytes;
+        r.profile = m_profile;
+        return r;
+    }
+
+private: /* Types: */
+
+    struct RecyclePool {
+        const VecType * vecType;
+        uint8_t heapTypeId;
+        bool ownLimits;
+        RecycleLimits limits;
+        RecycleStats stats;
+        std::vector<ShareVecBase *> vectors;
+    };
+
+private: /* Methods: */
+
+    template <typename T, typename Allocator>
+    void allocateMany (void ** hndls, const std::size_t n, const std::size_t size, std::true_type) {
+        std::size_t i = 0u;
+        try {
+            for (; i < n; ++ i)
+                hndls[i] = allocate_in_arena<T> (size);
+        } catch (...) {
+            while (i > 0u)
+                erase_handle<T> (hndls[-- i]);
+            throw;
+        }
+    }
+
+    template <typename T, typename Allocator>
+    void allocateMany (void ** hndls, const std::size_t n, const std::size_t size, std::false_type) {
+        using Vec = ShareVec<T, Allocator>;
+        std::vector<Vec *> vecs;
+        vecs.reserve (n);
+        try {
+            for (std::size_t i = 0u; i < n; ++ i)
+                vecs.push_back (allocate<T, Allocator> (size));
+            insert_many (vecs.data (), n, hndls);
+        } catch (...) {
+            for (Vec * const vec : vecs)
+                delete vec;
+            throw;
+        }
+    }
+
+    /* Vectors of the same value type with different storage are different types. */
+    template <typename Vec>
+    static const VecType * vecTypeTag () noexcept {
+        static const VecType tag = { sizeof (Vec), std::is_empty<typename Vec::allocator_type>::value };
+        return &tag;
+    }
+
+    static bool isTagged (const void * hndl) noexcept {
+        return taggedHandles && (reinterpret_cast<uintptr_t>(hndl) & 1u) != 0u;
+    }
+
+    static void * encode (const uint32_t index, const uint32_t generation) noexcept {
+        return reinterpret_cast<void *>(static_cast<uintptr_t>(((uint64_t (generation) << 32u | index) << 1u) | 1u));
+    }
+
+    /* \returns the handle of a filled slot. */
+    void * handleOf (const uint32_t index) const noexcept {
+        return taggedHandles
+               ? encode (index, m_slots[index].generation)
+               : static_cast<void *>(m_slots[index].vec);
+    }
+
+    /* Reserves a slot for \a vec and, without tagged handles, registers its address. */
+    uint32_t reserveHandleSlot (ShareVecBase * const vec) {
+        const uint32_t index = reserveSlot ();
+        if (! taggedHandles) {
+            try {
+                m_legacy.insert (std::make_pair (vec, index));
+            } catch (...) {
+                releaseSlot (index);
+                throw;
+            }
+        }
+        return index;
+    }
+
+    /* \returns the slot of a stored vector of any type, or noSlot. */
+    uint32_t findLive (const void * hndl) const {
+        if (! isTagged (hndl)) {
+            legacy_t::const_iterator i = m_legacy.find (static_cast<ShareVecBase *>(const_cast<void *>(hndl)));
+            return i == m_legacy.end () ? noSlot : i->second;
+        }
+
+        const uint64_t value = uint64_t (reinterpret_cast<uintptr_t>(hndl)) >> 1u;
+        const uint32_t index = static_cast<uint32_t>(value);
+        if (index >= m_slots.size ())
+            return noSlot;
+
+        const Slot & slot = m_slots[index];
+        if (slot.generation != static_cast<uint32_t>(value >> 32u) || ! slot.vec)
+            return noSlot;
+
+        return index;
+    }
+
+    /* \returns the slot of a stored vector with the heap_type_id of T, or noSlot. */
+    template <typename T>
+    uint32_t findTyped (const void * hndl) const {
+        const uint32_t index = findLive (hndl);
+        return index != noSlot && m_slots[index].heapTypeId == ValueTraits<T>::heap_type_id
+               ? index
+               : noSlot;
+    }
+
+    template <typename T>
+    bool eraseLegacy (ShareVecBase * vec) {
+        legacy_t::iterator i = m_legacy.find (vec);
+        if (i != m_legacy.end ()) {
+            if (m_slots[i->second].heapTypeId == ValueTraits<T>::heap_type_id) {
+                const uint32_t index = i->second;
+                m_legacy.erase (i);
+                freeSlot (index);
+                return true;
+            }
         }
 
         return false;
     }
 
+    uint32_t reserveSlot () {
+        if (m_freeHead != noSlot)
+            return m_freeHead;
+
+        if (m_slots.size () >= noSlot)
+            throw std::bad_alloc ();
+
+        const Slot slot = { nullptr, nullptr, 0u, noSlot, 0u, false, 0u, nullptr };
+        m_slots.push_back (slot);
+        return static_cast<uint32_t>(m_slots.size () - 1u);
+    }
+
+    /* Undoes reserveSlot() before the slot was filled. */
+    void releaseSlot (const uint32_t index) noexcept {
+        if (index + 1u == m_slots.size () && m_freeHead != index)
+            m_slots.pop_back ();
+    }
+
+    template <typename T, typename Allocator>
+    void fillSlot (const uint32_t index, ShareVec<T, Allocator>* vec) noexcept {
+        Slot & slot = m_slots[index];
+        if (index == m_freeHead)
+            m_freeHead = slot.nextFree;
+        slot.vec = vec;
+        slot.vecType = vecTypeTag<ShareVec<T, Allocator> > ();
+        slot.heapTypeId = ValueTraits<T>::heap_type_id;
+        slot.inArena = false;
+        slot.nextFree = noSlot;
+        slot.bytes = vec->allocated_bytes ();
+        slot.site = HeapAllocationSite::active ();
+        ++ m_size;
+        ++ m_usage.allocations;
+        ++ m_usage.liveVectors;
+        ++ m_typeUsage[slot.heapTypeId].allocations;
+        ++ m_typeUsage[slot.heapTypeId].liveVectors;
+        addBytes (slot.heapTypeId, slot.bytes);
+        sampleAllocation (slot.heapTypeId, slot.bytes);
+    }
+
+    /* Records a sample per m_sampleBytes bytes allocated. */
+    void sampleAllocation (const uint8_t heapTypeId, const std::size_t bytes) noexcept {
+        if (m_sampleBytes == 0u)
+            return;
+
+        if (bytes < m_sampleCountdown) {
+            m_sampleCountdown -= bytes;
+            return;
+        }
+
+        const std::size_t past = bytes - m_sampleCountdown;
+        const uint64_t samples = 1u + past / m_sampleBytes;
+        m_sampleCountdown = m_sampleBytes - past % m_sampleBytes;
+        const char * const site = HeapAllocationSite::active ();
+        try {
+            HeapSnapshot::ProfileStats & stats =
+                    m_profile[std::make_pair (std::string (site ? site : HeapSnapshot::unknownSite ()),
+                                              unsigned (heapTypeId))];
+            stats.samples += samples;
+            stats.bytes += samples * m_sampleBytes;
+        } catch (...) {
+            /* Losing a sample is harmless. */
+        }
+    }
+
+    void addBytes (const uint8_t heapTypeId, const std::size_t bytes) noexcept {
+        MemoryUsage & type = m_typeUsage[heapTypeId];
+        type.currentBytes += bytes;
+        type.peakBytes = std::max (type.peakBytes, type.currentBytes);
+        m_usage.currentBytes += bytes;
+        m_usage.peakBytes = std::max (m_usage.peakBytes, m_usage.currentBytes);
+        if (over_soft_quota ())
+            trim_recycled ();
+    }
+
+    void subBytes (const uint8_t heapTypeId, const std::size_t bytes) noexcept {
+        m_typeUsage[heapTypeId].currentBytes -= bytes;
+        m_usage.currentBytes -= bytes;
+    }
+
+    /* Throws if additional bytes would not fit the hard quota even after freeing the pools. */
+    void ensureQuota (const std::size_t bytes) {
+        if (bytes <= m_quota.hardBytes - std::min (m_quota.hardBytes, m_usage.currentBytes + pooled_bytes ()))
+            return;
+
+        trim_recycled ();
+        if (bytes > m_quota.hardBytes - std::min (m_quota.hardBytes, m_usage.currentBytes))
+            throw std::bad_alloc ();
+    }
+
+    RecyclePool & recyclePool (const VecType * const vecType, const uint8_t heapTypeId) {
+        for (RecyclePool & pool : m_pools)
+            if (pool.vecType == vecType)
+                return pool;
+
+        RecyclePool pool;
+        pool.vecType = vecType;
+        pool.heapTypeId = heapTypeId;
+        const std::map<uint8_t, RecycleLimits>::const_iterator it = m_typeLimits.find (heapTypeId);
+        pool.ownLimits = it != m_typeLimits.end ();
+        pool.limits = pool.ownLimits ? it->second : m_defaultLimits;
+        m_pools.push_back (std::move (pool));
+        return m_pools.back ();
+    }
+
+    void applyLimits (RecyclePool & pool, const RecycleLimits & limits) noexcept {
+        pool.limits = limits;
+        while (! pool.vectors.empty ()
+               && (pool.vectors.size () > limits.maxVectors
+                   || pool.stats.pooledBytes > limits.maxBytes))
+        {
+            ShareVecBase * const vec = pool.vectors.front ();
+            pool.vectors.erase (pool.vectors.begin ());
+            pool.stats.pooledBytes -= vec->allocated_bytes ();
+            m_pooledBytes -= vec->allocated_bytes ();
+            -- pool.stats.pooledVectors;
+            delete vec;
+        }
+    }
+
+    /* Puts an erased vector to the pool of its type, returns it if it must be deleted instead. */
+    ShareVecBase * recycle (ShareVecBase * const vec, const VecType * const vecType, const uint8_t heapTypeId) noexcept {
+        RecyclePool * pool = nullptr;
+        try {
+            pool = &recyclePool (vecType, heapTypeId);
+        } catch (...) {
+            return vec;
+        }
+
+        vec->clear ();
+        const std::size_t bytes = vec->allocated_bytes ();
+        if (pool->vectors.size () >= pool->limits.maxVectors
+            || bytes > pool->limits.maxBytes - std::min (pool->limits.maxBytes, pool->stats.pooledBytes))
+        {
+            ++ pool->stats.dropped;
+            return vec;
+        }
+
+        try {
+            pool->vectors.push_back (vec);
+        } catch (...) {
+            ++ pool->stats.dropped;
+            return vec;
+        }
+
+        ++ pool->stats.recycled;
+        ++ pool->stats.pooledVectors;
+        pool->stats.pooledBytes += bytes;
+        m_pooledBytes += bytes;
+        return nullptr;
+    }
+
+    void destroyInArena (ShareVecBase * const vec, const VecType * const vecType) noexcept {
+        vec->~ShareVecBase ();
+        m_arena.deallocate (vec, vecType->objectBytes);
+    }
+
+    /*
+     * Invalidates all handles to the slot and recycles its vector, or
+     * destroys it if it lives in the arena.
+     * \returns the vector if it was not recycled and must be deleted.
+     */
+    ShareVecBase * detachSlot (const uint32_t index) noexcept {
+        Slot & slot = m_slots[index];
+        subBytes (slot.heapTypeId, slot.bytes);
+        -- m_usage.liveVectors;
+        ++ m_usage.deallocations;
+        -- m_typeUsage[slot.heapTypeId].liveVectors;
+        ++ m_typeUsage[slot.heapTypeId].deallocations;
+        ShareVecBase * garbage = nullptr;
+        if (slot.inArena) {
+            destroyInArena (slot.vec, slot.vecType);
+            slot.inArena = false;
+            -- m_arenaVectors;
+        } else {
+            garbage = recycle (slot.vec, slot.vecType, slot.heapTypeId);
+        }
+        if (over_soft_quota ())
+            trim_recycled ();
+        slot.vec = nullptr;
+        slot.vecType = nullptr;
+        -- m_size;
+        /* Slots whose generation is exhausted are never reused: */
+        if (++ slot.generation <= maxGeneration) {
+            slot.nextFree = m_freeHead;
+            m_freeHead = index;
+        }
+        return garbage;
+    }
+
+    void freeSlot (const uint32_t index) noexcept {
+        delete detachSlot (index);
+    }
+
+    /* Deletes the vectors, on the ChunkThreadPool if \a parallel is set. */
+    static void deleteVectors (std::vector<ShareVecBase *> & vecs, const bool parallel) noexcept {
+        ShareVecBase ** const v = vecs.data ();
+        if (parallel && vecs.size () > 1u) {
+            try {
+                parallel_for_chunks (vecs.size (), 1u, [v] (std::size_t const begin, std::size_t const end) {
+                    for (std::size_t i = begin; i < end; ++ i) {
+                        delete v[i];
+                        v[i] = nullptr;
+                    }
+                });
+            } catch (...) {
+                /* Delete the rest serially. */
+            }
+        }
+
+        for (ShareVecBase * const vec : vecs)
+            delete vec;
+        vecs.clear ();
+    }
+
 private: /* Fields: */
 
-    impl_t m_pointers;
+    std::vector<Slot> m_slots;
+    uint32_t m_freeHead = noSlot;
+    std::size_t m_size = 0u;
+    legacy_t m_legacy;
+
+    ShareArena m_arena;
+    std::size_t m_arenaVectors = 0u;
+
+    std::vector<RecyclePool> m_pools;
+    std::size_t m_pooledBytes = 0u; /**< Sum of the pooledBytes of all pools. */
+    RecycleLimits m_defaultLimits { 0u, 0u };
+    std::map<uint8_t, RecycleLimits> m_typeLimits;
+
+    MemoryUsage m_usage;
+    std::vector<MemoryUsage> m_typeUsage = std::vector<MemoryUsage> (UINT8_MAX + 1u);
+    MemoryQuota m_quota { SIZE_MAX, SIZE_MAX };
+
+    std::size_t m_sampleBytes = 0u;
+    std::size_t m_sampleCountdown = 0u;
+    HeapSnapshot::Profile m_profile;
 
 }; /* class SharedValueHeap { */
 
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_STRIDEDITERATOR_H
+#define SHAREMIND_PDKHEADERS_STRIDEDITERATOR_H
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+
+namespace sharemind {
+
+/**
+ * Random access iterator over every \a stride-th element. The position is
+ * kept as an element index, so the end iterator of a strided range never forms
+ * a pointer past the end of the underlying array.
+ */
+template <typename ValueType>
+class __attribute__ ((visibility("internal"))) strided_iterator {
+
+    template <typename V> friend class strided_iterator;
+
+public: /* Types: */
+
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename std::remove_const<ValueType>::type;
+    using pointer = ValueType *;
+    using reference = ValueType &;
+    using difference_type = std::ptrdiff_t;
+
+public: /* Methods: */
+
+    inline strided_iterator() noexcept : m_base(nullptr), m_index(0), m_stride(1) {}
+    inline strided_iterator(pointer const ptr, difference_type const stride) noexcept
+        : m_base(ptr), m_index(0), m_stride(stride) {}
+
+    template <typename V>
+    inline strided_iterator(const strided_iterator<V> & copy) noexcept
+        : m_base(copy.m_base), m_index(copy.m_index), m_stride(copy.m_stride) {}
+
+    inline difference_type stride() const noexcept { return m_stride; }
+
+    inline strided_iterator & operator+=(const difference_type v) noexcept { m_index += v; return *this; }
+    inline strided_iterator & operator-=(const difference_type v) noexcept { m_index -= v; return *this; }
+    inline strided_iterator & operator++() noexcept { ++m_index; return *this; }
+    inline strided_iterator operator++(int) noexcept { strided_iterator r(*this); ++m_index; return r; }
+    inline strided_iterator & operator--() noexcept { --m_index; return *this; }
+    inline strided_iterator operator--(int) noexcept { strided_iterator r(*this); --m_index; return r; }
+
+    inline strided_iterator operator+(const difference_type v) const noexcept { strided_iterator r(*this); r.m_index += v; return r; }
+    inline strided_iterator operator-(const difference_type v) const noexcept { strided_iterator r(*this); r.m_index -= v; return r; }
+    inline difference_type operator-(const strided_iterator & rhs) const noexcept { return m_index - rhs.m_index; }
+
+    inline bool operator==(const strided_iterator & rhs) const noexcept { return m_index == rhs.m_index; }
+    inline bool operator!=(const strided_iterator & rhs) const noexcept { return m_index != rhs.m_index; }
+    inline bool operator<=(const strided_iterator & rhs) const noexcept { return m_index <= rhs.m_index; }
+    inline bool operator>=(const strided_iterator & rhs) const noexcept { return m_index >= rhs.m_index; }
+    inline bool operator< (const strided_iterator & rhs) const noexcept { return m_index <  rhs.m_index; }
+    inline bool operator> (const strided_iterator & rhs) const noexcept { return m_index >  rhs.m_index; }
+
+    inline pointer operator->() const noexcept { return m_base + m_index * m_stride; }
+    inline reference operator*() const noexcept { return m_base[m_index * m_stride]; }
+    inline reference operator[](const difference_type v) const noexcept { return m_base[(m_index + v) * m_stride]; }
+
+private: /* Fields: */
+
+    pointer m_base;
+    difference_type m_index;
+    difference_type m_stride;
+
+}; /* class strided_iterator { */
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_STRIDEDITERATOR_H */
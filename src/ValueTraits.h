@@ -22,11 +22,30 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <type_traits>
 
 
 namespace sharemind {
 
+/**
+ * \brief Allocator of the share storage of the given value type.
+ * This is \a ValueType::share_allocator if the value type defines one, and
+ * std::allocator of the share type otherwise.
+ */
+template <typename ValueType, typename = void>
+struct __attribute__ ((visibility("internal"))) share_allocator_of {
+    using type = std::allocator<typename ValueType::share_type>;
+};
+
+template <typename ValueType>
+struct __attribute__ ((visibility("internal"))) share_allocator_of<
+        ValueType,
+        typename std::conditional<true, void, typename ValueType::share_allocator>::type>
+{
+    using type = typename ValueType::share_allocator;
+};
+
 /*
  * Hierarchy of types.
  */
@@ -68,6 +87,16 @@ struct __attribute__ ((visibility("internal"))) ValueTraits {
      */
     using public_type = typename ValueType::public_type;
 
+    /**
+     * \brief Allocator of the share storage.
+     * A value type can select the storage of all its share vectors, e.g. SIMD
+     * aligned storage, by defining \a share_allocator:
+     * \code
+     * using share_allocator = AlignedShareAllocator<share_type>;
+     * \endcode
+     */
+    using share_allocator = typename share_allocator_of<ValueType>::type;
+
     /**
      * \brief Type identifier.
      * This value is used by the heap to track types.
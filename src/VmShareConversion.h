@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_VMSHARECONVERSION_H
+#define SHAREMIND_PDKHEADERS_VMSHARECONVERSION_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "ParallelChunks.h"
+#include "ShareVecKernels.h"
+#include "ShareVecView.h"
+#include "ShareVector.h"
+#include "ValueTraits.h"
+#include "VmVector.h"
+
+
+/**
+ * Bulk conversion between public VM data and share vectors. classify()
+ * converts public values to shares (e.g. the share of a party that holds
+ * the public value and whose peers hold zero), reduced modulo
+ * 2^num_of_bits, and declassify() converts reconstructed shares to public
+ * values. Widening and narrowing between public_type and share_type is
+ * vectorized with the instruction set of kernels::selectedIsa(), booleans
+ * are packed to and unpacked from BitShareVec blocks 64 at a time.
+ *
+ * If the public and share types have the same representation the VM memory
+ * can be viewed as shares without copying, see share_view_of().
+ */
+
+namespace sharemind {
+namespace kernels {
+namespace detail {
+
+/* Elements converted per parallel chunk. */
+constexpr std::size_t conversionGrain = 65536u;
+
+/* Booleans are converted through their byte representation. */
+template <typename T> struct vm_raw { using type = T; };
+template <> struct vm_raw<bool> { using type = std::uint8_t; };
+template <> struct vm_raw<const bool> { using type = const std::uint8_t; };
+
+template <std::size_t Bytes, typename D, typename S, bool Masked>
+inline __attribute__ ((always_inline))
+void convertLoop(D * out, const S * in, std::size_t n, D mask) {
+    constexpr std::size_t lanes = Bytes / (sizeof(D) > sizeof(S) ? sizeof(D) : sizeof(S));
+    using VS = typename simd_type<S, lanes * sizeof(S)>::type;
+    using VD = typename simd_type<D, lanes * sizeof(D)>::type;
+    std::size_t i = 0u;
+    for (; i + lanes <= n; i += lanes) {
+        VS x;
+        std::memcpy(&x, in + i, sizeof(VS));
+        VD r = __builtin_convertvector(x, VD);
+        if (Masked)
+            r &= mask;
+        std::memcpy(out + i, &r, sizeof(VD));
+    }
+    for (; i < n; ++i)
+        out[i] = Masked ? D(D(in[i]) & mask) : D(in[i]);
+}
+
+#define SHAREMIND_PDKHEADERS_CONVERT_VARIANT(name, target, bytes) \
+    template <typename D, typename S, bool Masked> \
+    SHAREMIND_PDKHEADERS_KERNELS_TARGET(target) \
+    void convert ## name(D * out, const S * in, std::size_t n, D mask) \
+    { convertLoop<bytes, D, S, Masked>(out, in, n, mask); }
+
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+SHAREMIND_PDKHEADERS_CONVERT_VARIANT(Sse2, "sse2", 16u)
+SHAREMIND_PDKHEADERS_CONVERT_VARIANT(Avx2, "avx2", 32u)
+SHAREMIND_PDKHEADERS_CONVERT_VARIANT(Avx512, "avx512f,avx512bw", 64u)
+#endif
+
+#undef SHAREMIND_PDKHEADERS_CONVERT_VARIANT
+
+template <typename D, typename S, bool Masked>
+void convertGeneric(D * out, const S * in, std::size_t n, D mask)
+{ convertLoop<16u, D, S, Masked>(out, in, n, mask); }
+
+/* Sets out[i] = D(in[i]), masked with \a mask if Masked is set. */
+template <typename D, typename S, bool Masked>
+void convert(D * out, const S * in, std::size_t n, D mask) {
+    if (!Masked && sizeof(D) == sizeof(S)) {
+        std::memcpy(out, in, n * sizeof(D));
+        return;
+    }
+
+    using Kernel = void (*)(D *, const S *, std::size_t, D);
+    static Kernel const kernel = [] () -> Kernel {
+        switch (selectedIsa()) {
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+        case Isa::Avx512: return &convertAvx512<D, S, Masked>;
+        case Isa::Avx2: return &convertAvx2<D, S, Masked>;
+        case Isa::Sse2: return &convertSse2<D, S, Masked>;
+#endif
+        default: return &convertGeneric<D, S, Masked>;
+        }
+    }();
+    kernel(out, in, n, mask);
+}
+
+/* Packs \a n bytes, each 0 or 1, into bits starting from bit 0 of out[0]. */
+inline void packBits(std::uint64_t * out, const std::uint8_t * in, std::size_t n) noexcept {
+    std::size_t i = 0u;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 64u <= n; i += 64u) {
+        std::uint64_t word = 0u;
+        for (std::size_t j = 0u; j < 8u; ++j) {
+            std::uint64_t bytes;
+            std::memcpy(&bytes, in + i + 8u * j, sizeof(bytes));
+            word |= ((bytes * UINT64_C(0x0102040810204080)) >> 56u) << (8u * j);
+        }
+        out[i / 64u] = word;
+    }
+#endif
+    if (i < n) {
+        std::uint64_t word = 0u;
+        for (std::size_t j = 0u; i + j < n; ++j)
+            word |= std::uint64_t(in[i + j] & 1u) << j;
+        out[i / 64u] = word;
+    }
+}
+
+/* Unpacks \a n bits starting from bit 0 of in[0] to bytes of 0 or 1. */
+inline void unpackBits(std::uint8_t * out, const std::uint64_t * in, std::size_t n) noexcept {
+    std::size_t i = 0u;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 64u <= n; i += 64u) {
+        std::uint64_t const word = in[i / 64u];
+        for (std::size_t j = 0u; j < 8u; ++j) {
+            /* Byte k keeps bit k of the spread byte, then becomes 0 or 1: */
+            std::uint64_t const spread = (((word >> (8u * j)) & 0xffu) * UINT64_C(0x0101010101010101))
+                                         & UINT64_C(0x8040201008040201);
+            std::uint64_t const bytes = ((spread + UINT64_C(0x7f7f7f7f7f7f7f7f)) >> 7u)
+                                        & UINT64_C(0x0101010101010101);
+            std::memcpy(out + i + 8u * j, &bytes, sizeof(bytes));
+        }
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = static_cast<std::uint8_t>((in[i / 64u] >> (i % 64u)) & 1u);
+}
+
+} /* namespace detail { */
+} /* namespace kernels { */
+
+/**
+ * Whether the VM representation of values of type T can be used as shares
+ * without conversion: the public and share types are integers of the same
+ * width, differing at most in signedness, and the ring covers all bits.
+ */
+template <typename T>
+struct __attribute__ ((visibility("internal"))) vm_layout_matches
+    : std::integral_constant<
+            bool,
+            std::is_integral<typename ValueTraits<T>::public_type>::value
+            && !std::is_same<typename ValueTraits<T>::public_type, bool>::value
+            && std::is_integral<typename ValueTraits<T>::share_type>::value
+            && sizeof(typename ValueTraits<T>::public_type) == sizeof(typename ValueTraits<T>::share_type)
+            && ValueTraits<T>::num_of_bits == 8u * sizeof(typename ValueTraits<T>::share_type)>
+{ };
+
+/**
+ * \returns a view of the VM memory as shares, valid as long as the VM
+ *          reference is.
+ */
+template <typename T>
+inline typename std::enable_if<vm_layout_matches<T>::value, ConstShareVecView<T> >::type
+share_view_of(const ImmutableVmVec<T> & in) noexcept {
+    return ConstShareVecView<T>(reinterpret_cast<const typename T::share_type *>(in.begin()), in.size());
+}
+
+/** \see share_view_of, shares written to the view become public values. */
+template <typename T>
+inline typename std::enable_if<vm_layout_matches<T>::value, ShareVecView<T> >::type
+share_view_of(MutableVmVec<T> & out) noexcept {
+    return ShareVecView<T>(reinterpret_cast<typename T::share_type *>(out.begin()), out.size());
+}
+
+/**
+ * Sets out[i] to in[i] reduced modulo 2^num_of_bits.
+ * \pre The public and share types are integers or booleans.
+ * \pre The view has the size of \a in.
+ */
+template <typename T>
+void classify(const ShareVecView<T> & out, const ImmutableVmVec<T> & in) {
+    assert(out.size() == in.size());
+    using S = typename ValueTraits<T>::share_type;
+    using P = typename kernels::detail::vm_raw<const typename ValueTraits<T>::public_type>::type;
+    using M = kernels::detail::ring_mask<S, ValueTraits<T>::num_of_bits>;
+    static_assert(std::is_integral<S>::value && std::is_integral<P>::value,
+                  "Only integers and booleans are classified, the kernels "
+                  "copy the bits of values of equal width.");
+    P * const src = reinterpret_cast<P *>(in.begin());
+    if (!out.is_contiguous()) {
+        for (std::size_t i = 0u; i < in.size(); ++i)
+            out[i] = M::needed ? S(S(src[i]) & M::value) : S(src[i]);
+        return;
+    }
+
+    S * const dst = out.data();
+    parallel_for_chunks(in.size(), kernels::detail::conversionGrain,
+                        [dst, src] (std::size_t const begin, std::size_t const end) {
+        kernels::detail::convert<S, typename std::remove_const<P>::type, M::needed>(
+                    dst + begin, src + begin, end - begin, M::value);
+    });
+}
+
+/** \see classify, \a out is resized to the size of \a in. */
+template <typename T, typename Allocator>
+inline void classify(ShareVec<T, Allocator> & out, const ImmutableVmVec<T> & in) {
+    out.resize_uninitialized(in.size());
+    classify(ShareVecView<T>(out), in);
+}
+
+/**
+ * Sets out[i] to the public value of share in[i], which must be reduced.
+ * \pre The public and share types are integers or booleans.
+ * \pre \a out has the size of \a in.
+ */
+template <typename T>
+void declassify(MutableVmVec<T> & out, const ConstShareVecView<T> & in) {
+    assert(out.size() == in.size());
+    using S = typename ValueTraits<T>::share_type;
+    using P = typename kernels::detail::vm_raw<typename ValueTraits<T>::public_type>::type;
+    static_assert(std::is_integral<S>::value && std::is_integral<P>::value,
+                  "Only integers and booleans are declassified, the kernels "
+                  "copy the bits of values of equal width.");
+    P * const dst = reinterpret_cast<P *>(out.begin());
+    if (!in.is_contiguous()) {
+        for (std::size_t i = 0u; i < in.size(); ++i)
+            dst[i] = P(in[i]);
+        return;
+    }
+
+    const S * const src = in.data();
+    parallel_for_chunks(in.size(), kernels::detail::conversionGrain,
+                        [dst, src] (std::size_t const begin, std::size_t const end) {
+        kernels::detail::convert<P, S, false>(dst + begin, src + begin, end - begin, P());
+    });
+}
+
+template <typename T, typename Allocator>
+inline void declassify(MutableVmVec<T> & out, const ShareVec<T, Allocator> & in)
+{ declassify(out, ConstShareVecView<T>(in)); }
+
+/**
+ * Packs public booleans to the bits of \a out, which is resized to the size
+ * of \a in.
+ */
+template <typename T>
+void classify(BitShareVec<T> & out, const ImmutableVmVec<T> & in) {
+    static_assert(std::is_same<typename ValueTraits<T>::public_type, bool>::value,
+                  "Bit vectors are classified from booleans.");
+    out.resize_uninitialized(in.size());
+    std::uint64_t * const dst = out.blocks();
+    const std::uint8_t * const src = reinterpret_cast<const std::uint8_t *>(in.begin());
+    parallel_for_chunks(out, kernels::detail::conversionGrain,
+                        [dst, src] (std::size_t const begin, std::size_t const end)
+                        { kernels::detail::packBits(dst + begin / 64u, src + begin, end - begin); });
+}
+
+/**
+ * Unpacks the bits of \a in to public booleans.
+ * \pre \a out has the size of \a in.
+ */
+template <typename T>
+void declassify(MutableVmVec<T> & out, const BitShareVec<T> & in) {
+    static_assert(std::is_same<typename ValueTraits<T>::public_type, bool>::value,
+                  "Bit vectors are declassified to booleans.");
+    assert(out.size() == in.size());
+    std::uint8_t * const dst = reinterpret_cast<std::uint8_t *>(out.begin());
+    const std::uint64_t * const src = in.blocks();
+    parallel_for_chunks(in.size(), kernels::detail::conversionGrain,
+                        [dst, src] (std::size_t const begin, std::size_t const end)
+                        { kernels::detail::unpackBits(dst + begin, src + begin / 64u, end - begin); });
+}
+
+} /* namespace sharemind */
+
+#endif /* SHAREMIND_PDKHEADERS_VMSHARECONVERSION_H */
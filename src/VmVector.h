@@ -20,10 +20,14 @@
 #ifndef SHAREMIND_PDKHEADERS_VMVECTOR_H
 #define SHAREMIND_PDKHEADERS_VMVECTOR_H
 
+#include <algorithm>
+#include <cassert>
 #include <cstddef>
+#include <iterator>
 #include <sharemind/AssertReturn.h>
 #include <sharemind/module-apis/api_0x1.h>
 #include <vector>
+#include "StridedIterator.h"
 #include "ValueTraits.h"
 
 namespace sharemind {
@@ -64,6 +68,46 @@ public: /* Methods: */
     void const * data() const noexcept
     { return static_cast<void const *>(m_begin); }
 
+    template <typename OutMessage>
+    void serialize(OutMessage & msg) const
+    { msg.writeArray(m_begin, m_size); }
+
+    /**
+     * Adds the values to the message by reference.
+     * \pre The message must be sent before the syscall returns.
+     */
+    template <typename OutMessage>
+    void serialize_zero_copy(OutMessage & msg) const
+    { msg.writeArrayRef(m_begin, m_size); }
+
+protected: /* Methods: */
+
+    /* Views are allowed to be empty, unlike VM references. */
+    VmVecBase(T * const begin, std::size_t const size, bool) noexcept
+        : m_begin(begin)
+        , m_size(size)
+    { }
+
+    T * subspanBegin(std::size_t const offset, std::size_t const length) const noexcept {
+        assert(offset <= m_size && length <= m_size - offset && "Subspan out of bounds.");
+        (void) length;
+        return m_begin + offset;
+    }
+
+    T * stridedBegin(std::size_t const offset,
+                     std::size_t const length,
+                     std::ptrdiff_t const stride) const noexcept
+    {
+        assert(stride > 0 && "Strides must be positive.");
+        assert((length == 0u
+                ? offset <= m_size
+                : offset < m_size
+                  && length - 1u <= (m_size - 1u - offset) / std::size_t(stride))
+               && "View out of bounds.");
+        (void) length; (void) stride;
+        return m_begin + offset;
+    }
+
 protected: /* Fields: */
 
     T * m_begin;
@@ -71,6 +115,167 @@ protected: /* Fields: */
 
 }; /* class VmVecBase { */
 
+/**
+ * \brief Non-owning view over every \a stride-th element of VM data of value
+ * type T. \a ValueType is the public type, const qualified if immutable.
+ */
+template <typename T, typename ValueType>
+class __attribute__ ((visibility("internal"))) VmVecStridedView {
+
+public: /* Types: */
+
+    using value_type = ValueType;
+    using iterator = strided_iterator<ValueType>;
+    using difference_type = std::ptrdiff_t;
+
+private: /* Constants: */
+
+    /* Number of elements buffered when serializing. */
+    static constexpr std::size_t bufferSize = 256u;
+
+public: /* Methods: */
+
+    VmVecStridedView(ValueType * const data,
+                     std::size_t const size,
+                     difference_type const stride) noexcept
+        : m_data(data)
+        , m_size(size)
+        , m_stride(stride)
+    { assert(stride > 0 && "Strides must be positive."); }
+
+    static constexpr typename T::value_category value_category () {
+        return typename T::value_category ();
+    }
+
+    std::size_t size() const noexcept { return m_size; }
+    bool empty() const noexcept { return m_size == 0u; }
+    difference_type stride() const noexcept { return m_stride; }
+
+    iterator begin() const noexcept { return iterator(m_data, m_stride); }
+    iterator end() const noexcept { return begin() + static_cast<difference_type>(m_size); }
+
+    ValueType & operator[](std::size_t const i) const noexcept {
+        assert(i < m_size && "operator[]: Index out of bounds.");
+        return m_data[static_cast<difference_type>(i) * m_stride];
+    }
+
+    template <typename OutMessage>
+    void serialize(OutMessage & msg) const {
+        typename std::remove_const<ValueType>::type buffer[bufferSize];
+        for (std::size_t i = 0u; i < m_size; i += bufferSize) {
+            std::size_t const n = std::min(bufferSize, m_size - i);
+            std::copy(begin() + difference_type(i), begin() + difference_type(i + n), buffer);
+            msg.writeArray(buffer, n);
+        }
+    }
+
+    template <typename InMessage>
+    bool deserialize(InMessage & msg) const {
+        static_assert(!std::is_const<ValueType>::value, "Immutable view.");
+        ValueType buffer[bufferSize];
+        for (std::size_t i = 0u; i < m_size; i += bufferSize) {
+            std::size_t const n = std::min(bufferSize, m_size - i);
+            if (!msg.readArray(buffer, n))
+                return false;
+            std::copy(buffer, buffer + n, begin() + difference_type(i));
+        }
+        return true;
+    }
+
+private: /* Fields: */
+
+    ValueType * m_data;
+    std::size_t m_size;
+    difference_type m_stride;
+
+}; /* class VmVecStridedView { */
+
+template <typename T, typename ValueType>
+constexpr std::size_t VmVecStridedView<T, ValueType>::bufferSize;
+
+/**
+ * \brief Range of consecutive subspans of at most \a chunkSize elements of a
+ * MutableVmVec or ImmutableVmVec, the last one may be shorter.
+ * \code
+ * for (ImmutableVmVec<T> chunk : in.chunks (transferChunkSize<T> ()))
+ *     chunk.serialize (msg);
+ * \endcode
+ */
+template <typename Vec>
+class __attribute__ ((visibility("internal"))) VmVecChunks {
+
+public: /* Types: */
+
+    class iterator {
+
+    public: /* Types: */
+
+        /* Dereferencing yields a subspan by value, not a reference: */
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Vec;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Vec *;
+        using reference = Vec;
+
+    public: /* Methods: */
+
+        iterator(const Vec & vec, std::size_t const chunkSize, std::size_t const offset) noexcept
+            : m_vec(vec)
+            , m_chunkSize(chunkSize)
+            , m_offset(offset)
+        { }
+
+        Vec operator*() const noexcept
+        { return m_vec.subspan(m_offset, std::min(m_chunkSize, m_vec.size() - m_offset)); }
+
+        /** \returns the offset of the current chunk in the whole vector. */
+        std::size_t offset() const noexcept { return m_offset; }
+
+        iterator & operator++() noexcept {
+            m_offset += std::min(m_chunkSize, m_vec.size() - m_offset);
+            return *this;
+        }
+
+        iterator operator++(int) noexcept { iterator r(*this); ++(*this); return r; }
+
+        bool operator==(const iterator & rhs) const noexcept { return m_offset == rhs.m_offset; }
+        bool operator!=(const iterator & rhs) const noexcept { return m_offset != rhs.m_offset; }
+
+    private: /* Fields: */
+
+        mutable Vec m_vec;
+        std::size_t m_chunkSize;
+        std::size_t m_offset;
+
+    }; /* class iterator { */
+
+public: /* Methods: */
+
+    VmVecChunks(const Vec & vec, std::size_t const chunkSize) noexcept
+        : m_vec(vec)
+        , m_chunkSize(chunkSize)
+    { assert(chunkSize > 0u && "Zero chunk size."); }
+
+    /** \returns the number of chunks. */
+    std::size_t size() const noexcept
+    { return (m_vec.size() + m_chunkSize - 1u) / m_chunkSize; }
+
+    bool empty() const noexcept { return m_vec.empty(); }
+
+    iterator begin() const noexcept { return iterator(m_vec, m_chunkSize, 0u); }
+    iterator end() const noexcept { return iterator(m_vec, m_chunkSize, m_vec.size()); }
+
+    /** \returns chunk \a k. */
+    Vec operator[](std::size_t const k) const noexcept
+    { return *iterator(m_vec, m_chunkSize, k * m_chunkSize); }
+
+private: /* Fields: */
+
+    Vec m_vec;
+    std::size_t m_chunkSize;
+
+}; /* class VmVecChunks { */
+
 /**
  * Mutable vector of VM data, can be constructed from VM references.
  */
@@ -105,6 +310,24 @@ public: /* Methods: */
     iterator end () { return this->m_begin + this->m_size; }
     value_type& operator [] (size_t i) { return *(this->m_begin + i); }
 
+    /** \returns the \a length elements starting from \a offset. */
+    MutableVmVec subspan (size_t offset, size_t length) {
+        return MutableVmVec (this->subspanBegin (offset, length), length);
+    }
+
+    /** \returns consecutive subspans of at most \a chunkSize elements. */
+    VmVecChunks<MutableVmVec> chunks (size_t chunkSize) {
+        return VmVecChunks<MutableVmVec> (*this, chunkSize);
+    }
+
+    /** \returns every \a stride-th of \a length elements starting from \a offset. */
+    VmVecStridedView<T, value_type> strided (size_t offset, size_t length, std::ptrdiff_t stride) {
+        return VmVecStridedView<T, value_type> (this->stridedBegin (offset, length, stride), length, stride);
+    }
+
+    template <typename InMessage>
+    bool deserialize (InMessage& msg) { return msg.readArray (this->m_begin, this->m_size); }
+
     static constexpr typename T::value_category value_category () {
         return typename T::value_category ();
     }
@@ -114,6 +337,14 @@ public: /* Methods: */
     using Base::operator [];
     using Base::begin;
     using Base::end;
+    using Base::serialize;
+    using Base::serialize_zero_copy;
+
+private: /* Methods: */
+
+    MutableVmVec (value_type* begin, size_t size)
+        : Base (begin, size, true)
+    { }
 
 }; /* class MutableVmVec { */
 
@@ -148,12 +379,35 @@ public: /* Methods: */
         return typename T::value_category ();
     }
 
+    /** \returns the \a length elements starting from \a offset. */
+    ImmutableVmVec subspan (size_t offset, size_t length) const {
+        return ImmutableVmVec (this->subspanBegin (offset, length), length);
+    }
+
+    /** \returns consecutive subspans of at most \a chunkSize elements. */
+    VmVecChunks<ImmutableVmVec> chunks (size_t chunkSize) const {
+        return VmVecChunks<ImmutableVmVec> (*this, chunkSize);
+    }
+
+    /** \returns every \a stride-th of \a length elements starting from \a offset. */
+    VmVecStridedView<T, value_type> strided (size_t offset, size_t length, std::ptrdiff_t stride) const {
+        return VmVecStridedView<T, value_type> (this->stridedBegin (offset, length, stride), length, stride);
+    }
+
     using Base::data;
     using Base::empty;
     using Base::size;
     using Base::operator [];
     using Base::begin;
     using Base::end;
+    using Base::serialize;
+    using Base::serialize_zero_copy;
+
+private: /* Methods: */
+
+    ImmutableVmVec (value_type* begin, size_t size)
+        : Base (begin, size, true)
+    { }
 
 }; /* class ImmutableVmVec { */
 
@@ -44,6 +44,8 @@ struct SharemindPdpiNetworkFacility_;
 typedef struct SharemindPdpiNetworkFacility_ SharemindPdpiNetworkFacility;
 struct SharemindPdNetworkFacility_;
 typedef struct SharemindPdNetworkFacility_ SharemindPdNetworkFacility;
+struct SharemindNodeGatherFacility_;
+typedef struct SharemindNodeGatherFacility_ SharemindNodeGatherFacility;
 
 
 struct SharemindNodeConfiguration_ {
@@ -160,6 +162,45 @@ struct SharemindNode_ {
 
 }; /* struct SharemindNode_ { */
 
+/** Name of the PDPI facility of type SharemindNodeGatherFacility. */
+#define SHAREMIND_NODE_GATHER_FACILITY_NAME "NodeGatherSend"
+
+/** Version of SharemindNodeGatherFacility described by this header. */
+#define SHAREMIND_NODE_GATHER_FACILITY_VERSION 1u
+
+/**
+  \brief Optional gathering sends of the nodes of a network.
+  Networks supporting gathering sends provide this object as the PDPI facility
+  named SHAREMIND_NODE_GATHER_FACILITY_NAME, other miners do not provide the
+  facility at all. Later versions only append fields, which may be accessed
+  only if both size and version say they are present.
+*/
+struct SharemindNodeGatherFacility_ {
+
+    /** sizeof(SharemindNodeGatherFacility) as compiled into the miner. */
+    size_t size;
+
+    /** Version of the facility, at least 1. */
+    unsigned version;
+
+    /**
+      \brief Sends a message given as a sequence of segments without first
+             copying them into a contiguous buffer.
+      \param[in] facility pointer to this facility.
+      \param[in] node the destination node.
+      \param[in] segments The segments of the message in order, must be valid.
+      \param[in] numSegments The number of segments.
+      \note The segments need only stay valid until this function returns.
+      \returns an error code, if any.
+    */
+    SharemindNetworkError (* const send_message_v)(
+            const SharemindNodeGatherFacility * facility,
+            SharemindNode * node,
+            const SharemindMessage * segments,
+            size_t numSegments);
+
+}; /* struct SharemindNodeGatherFacility_ { */
+
 struct SharemindNetworkConfiguration_ {
     /**
       \param[in] configuration pointer to this object.
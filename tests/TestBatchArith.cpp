@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "MetaSyscalls.h"
+#include "SharedValueHeap.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+#include "TestSyscalls.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+using Vec = ShareVec<UInt32Type>;
+/* Sizes of the inputs of all protocol invocations, in order: */
+std::vector<std::size_t> invocations;
+
+struct AddProtocol {
+    template <typename Pdpi>
+    explicit AddProtocol(Pdpi &) noexcept {}
+
+    bool invoke(const Vec & a, const Vec & b, Vec & out) {
+        invocations.push_back(a.size());
+        out.resize(a.size());
+        for (std::size_t i = 0u; i < a.size(); ++i)
+            out[i] = a[i] + b[i];
+        return true;
+    }
+};
+
+struct NegProtocol {
+    template <typename Pdpi>
+    explicit NegProtocol(Pdpi &) noexcept {}
+
+    bool invoke(const Vec & in, Vec & out) {
+        invocations.push_back(in.size());
+        out.resize(in.size());
+        for (std::size_t i = 0u; i < in.size(); ++i)
+            out[i] = 0u - in[i];
+        return true;
+    }
+};
+
+enum Opcode : std::uint64_t { Add = 0u, Neg = 1u };
+
+/* Resolves handles with SharedValueHeap::get and enforces its quota. */
+struct HeapPdpi {
+    bool isComputingNode() const noexcept { return true; }
+    SharedValueHeap & sharedValueHeap() noexcept { return heap; }
+    void checkHandleUsage(void * const handle, std::size_t const bytes) { heap.check_usage(handle, bytes); }
+    void updateHandleUsage(void * const handle) { heap.update_usage(handle); }
+    SharedValueHeap heap;
+};
+
+using Instruction = MetaSyscalls<HeapPdpi, 0u>::BatchInstruction;
+
+SharemindModuleApi0x1Error run(HeapPdpi & pdpi, std::vector<Instruction> const & program) {
+    TestSyscallContext context(pdpi);
+    SharemindCodeBlock args[1];
+    args[0].uint64[0] = 0u;
+    SharemindModuleApi0x1CReference const crefs[] = {
+        { program.data(), program.size() * sizeof(Instruction) },
+        { nullptr, 0u }
+    };
+    invocations.clear();
+    return MetaSyscalls<HeapPdpi, 0u>::batch_arith_vec<UInt32Type, AddProtocol, NegProtocol>(
+                args, 1u, nullptr, crefs, nullptr, context.get());
+}
+
+void * insert(HeapPdpi & pdpi, std::size_t const size, std::uint32_t const value)
+{ return pdpi.heap.insert_handle(new Vec(size, value)); }
+
+bool equals(HeapPdpi & pdpi, void * const handle, std::size_t const size, std::uint32_t const value) {
+    Vec const * const vec = pdpi.heap.get<UInt32Type>(handle);
+    if (!vec || vec->size() != size)
+        return false;
+    for (std::size_t i = 0u; i < size; ++i)
+        if ((*vec)[i] != value)
+            return false;
+    return true;
+}
+
+void testMerging() {
+    HeapPdpi pdpi;
+    void * const a = insert(pdpi, 3u, 1u);
+    void * const b = insert(pdpi, 5u, 2u);
+    void * const c = insert(pdpi, 0u, 0u);
+    void * const d = insert(pdpi, 0u, 0u);
+    void * const e = insert(pdpi, 0u, 0u);
+
+    /* Independent instructions with the same opcode are run at once: */
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Add, c, a, a }, { Add, d, b, b }, { Neg, e, a, nullptr } })
+                         == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 8u, 3u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 3u, 2u) && equals(pdpi, d, 5u, 4u));
+    SHAREMIND_TEST_CHECK(equals(pdpi, e, 3u, 0u - 1u));
+
+    /* Instructions are not reordered to merge ones with the same opcode: */
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Neg, c, a, nullptr }, { Add, d, b, b }, { Neg, e, b, nullptr } })
+                         == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 3u, 5u, 5u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 3u, 0u - 1u) && equals(pdpi, e, 5u, 0u - 2u));
+
+    /* Binary instructions with inputs of different sizes are run alone: */
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Add, c, a, b }, { Add, d, b, b } }) == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 3u, 5u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 3u, 3u));
+
+    /* Large vectors are not merged: */
+    void * const big = insert(pdpi, 40000u, 1u);
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Neg, c, big, nullptr }, { Neg, d, big, nullptr }, { Neg, e, a, nullptr } })
+                         == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 40000u, 40003u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 40000u, 0u - 1u) && equals(pdpi, d, 40000u, 0u - 1u));
+    SHAREMIND_TEST_CHECK(equals(pdpi, e, 3u, 0u - 1u));
+}
+
+void testDependencies() {
+    HeapPdpi pdpi;
+    void * const a = insert(pdpi, 4u, 1u);
+    void * const b = insert(pdpi, 4u, 2u);
+    void * const c = insert(pdpi, 0u, 0u);
+    void * const d = insert(pdpi, 0u, 0u);
+
+    /* An instruction reading an earlier output sees its result: */
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Add, c, a, b }, { Add, d, c, b } }) == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 4u, 4u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 4u, 3u) && equals(pdpi, d, 4u, 5u));
+
+    /* An instruction overwriting an earlier input or output runs after it: */
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Add, c, a, b }, { Add, a, b, b } }) == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 4u, 4u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 4u, 3u) && equals(pdpi, a, 4u, 4u));
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Neg, c, a, nullptr }, { Neg, c, b, nullptr } }) == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 4u, 4u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 4u, 0u - 2u));
+
+    /* Instructions only sharing inputs are merged: */
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Add, c, a, b }, { Add, d, a, b } }) == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((invocations == std::vector<std::size_t>{ 8u }));
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 4u, 6u) && equals(pdpi, d, 4u, 6u));
+}
+
+void testErrors() {
+    HeapPdpi pdpi;
+    void * const a = insert(pdpi, 1000u, 1u);
+    void * const b = insert(pdpi, 1000u, 2u);
+    void * const c = insert(pdpi, 0u, 0u);
+
+    /* Nothing is run if an opcode or a handle is invalid: */
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Add, c, a, b }, { 2u, c, a, b } }) == SHAREMIND_MODULE_API_0x1_INVALID_CALL);
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Add, c, a, b }, { Add, c, a, nullptr } })
+                         == SHAREMIND_MODULE_API_0x1_GENERAL_ERROR);
+    SHAREMIND_TEST_CHECK(invocations.empty() && equals(pdpi, c, 0u, 0u));
+
+    /* The quota is checked before the protocol of a group is run: */
+    pdpi.heap.set_memory_quota({ 10000u, 10000u });
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Neg, c, a, nullptr } }) == SHAREMIND_MODULE_API_0x1_OUT_OF_MEMORY);
+    SHAREMIND_TEST_CHECK(invocations.empty() && equals(pdpi, c, 0u, 0u));
+    pdpi.heap.set_memory_quota({ 12000u, 12000u });
+    SHAREMIND_TEST_CHECK(run(pdpi, { { Neg, c, a, nullptr } }) == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK(equals(pdpi, c, 1000u, 0u - 1u));
+    SHAREMIND_TEST_CHECK(pdpi.heap.memory_usage().currentBytes == 12000u);
+}
+
+} /* namespace { */
+
+int main() {
+    testMerging();
+    testDependencies();
+    testErrors();
+    return testResult();
+}
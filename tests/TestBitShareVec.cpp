@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+using Bits = std::vector<bool>;
+
+/* Sizes around the 64-bit blocks: */
+const std::size_t testSizes[] = { 0u, 1u, 63u, 64u, 65u, 127u, 128u, 129u, 200u };
+
+Bits testBits(std::size_t const n, std::uint64_t const seed) {
+    Bits r(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        r[i] = (testValue(seed + i) & 1u) != 0u;
+    return r;
+}
+
+void load(BitShareVec<BoolType> & vec, const Bits & bits) {
+    vec.resize(bits.size());
+    for (std::size_t i = 0u; i < bits.size(); ++i)
+        vec[i] = bits[i];
+}
+
+bool equals(const BitShareVec<BoolType> & vec, const Bits & bits) {
+    if (vec.size() != bits.size())
+        return false;
+    for (std::size_t i = 0u; i < bits.size(); ++i)
+        if (bool(vec[i]) != bits[i])
+            return false;
+    return true;
+}
+
+/* Shift and rotate counts within, at and across block boundaries: */
+std::vector<std::size_t> testCounts(std::size_t const n) {
+    std::vector<std::size_t> r = { 0u, 1u, 7u, 63u, 64u, 65u, 128u, 130u };
+    r.push_back(n);
+    r.push_back(n + 1u);
+    if (n > 1u)
+        r.push_back(n - 1u);
+    return r;
+}
+
+void testShifts() {
+    for (std::size_t const n : testSizes) {
+        Bits const x = testBits(n, n);
+        for (std::size_t const k : testCounts(n)) {
+            Bits left(n), right(n), rotl(n), rotr(n);
+            for (std::size_t i = 0u; i < n; ++i) {
+                left[i] = i >= k && x[i - k];
+                right[i] = i + k < n && x[i + k];
+                rotl[(i + k) % n] = x[i];
+                rotr[(i + n - k % n) % n] = x[i];
+            }
+
+            BitShareVec<BoolType> v;
+            load(v, x);
+            v.shift_left(k);
+            SHAREMIND_TEST_CHECK(equals(v, left));
+            SHAREMIND_TEST_CHECK(v.popcount() == std::size_t(std::count(left.begin(), left.end(), true)));
+            load(v, x);
+            v.shift_right(k);
+            SHAREMIND_TEST_CHECK(equals(v, right));
+            load(v, x);
+            v.rotate_left(k);
+            SHAREMIND_TEST_CHECK(equals(v, rotl));
+            load(v, x);
+            v.rotate_right(k);
+            SHAREMIND_TEST_CHECK(equals(v, rotr));
+        }
+    }
+}
+
+void testUnusedBits() {
+    for (std::size_t const n : { 1u, 65u, 100u }) {
+        /* Stale bits past the end must not be shifted or counted in: */
+        BitShareVec<BoolType> v(n + 20u);
+        for (std::size_t i = 0u; i < v.size(); ++i)
+            v[i] = true;
+        v.resize(n);
+        SHAREMIND_TEST_CHECK(v.popcount() == n);
+        v.shift_right(1u);
+        SHAREMIND_TEST_CHECK(!v[n - 1u] && v.popcount() == n - 1u);
+        v.rotate_left(1u);
+        SHAREMIND_TEST_CHECK(!v[0u] && v.popcount() == n - 1u);
+    }
+}
+
+void testBlockOps() {
+    for (std::size_t const n : testSizes) {
+        Bits const m = testBits(n, 1u);
+        Bits const a = testBits(n, 1000u);
+        Bits const b = testBits(n, 2000u);
+        Bits sel(n), disj(n);
+        for (std::size_t i = 0u; i < n; ++i) {
+            sel[i] = m[i] ? a[i] : b[i];
+            disj[i] = a[i] || b[i];
+        }
+
+        BitShareVec<BoolType> vm, va, vb, r;
+        load(vm, m);
+        load(va, a);
+        load(vb, b);
+        r.select(vm, va, vb);
+        SHAREMIND_TEST_CHECK(equals(r, sel));
+        va |= vb;
+        SHAREMIND_TEST_CHECK(equals(va, disj));
+        SHAREMIND_TEST_CHECK(va.popcount() == std::size_t(std::count(disj.begin(), disj.end(), true)));
+    }
+}
+
+} /* namespace { */
+
+int main() {
+    testShifts();
+    testUnusedBits();
+    testBlockOps();
+    return testResult();
+}
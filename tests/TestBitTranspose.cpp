@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include "BitTranspose.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+const std::size_t testSizes[] = { 0u, 1u, 7u, 63u, 64u, 65u, 127u, 128u, 1000u };
+
+void testTranspose64x64() {
+    for (std::uint64_t seed = 0u; seed < 4u; ++seed) {
+        std::uint64_t rows[64], original[64];
+        for (std::size_t r = 0u; r < 64u; ++r)
+            rows[r] = original[r] = testValue(seed * 64u + r);
+        transpose64x64(rows);
+        for (std::size_t r = 0u; r < 64u; ++r)
+            for (std::size_t c = 0u; c < 64u; ++c)
+                SHAREMIND_TEST_CHECK(((rows[r] >> c) & 1u) == ((original[c] >> r) & 1u));
+    }
+}
+
+/* Checks the bit-major layout against extracting every bit separately. */
+template <typename T>
+void testBitDecompose() {
+    using S = typename ValueTraits<T>::share_type;
+    constexpr std::size_t bits = ValueTraits<T>::num_of_bits;
+    for (std::size_t const n : testSizes) {
+        ShareVec<T> a(n);
+        for (std::size_t i = 0u; i < n; ++i)
+            a[i] = S(testValue(i));
+
+        BitShareVec<BoolType> b;
+        bitDecompose(b, a);
+        SHAREMIND_TEST_CHECK(b.size() == n * bits);
+        for (std::size_t j = 0u; j < bits; ++j)
+            for (std::size_t k = 0u; k < n; ++k)
+                SHAREMIND_TEST_CHECK(bool(b[j * n + k]) == (((a[k] >> j) & 1u) != 0u));
+
+        /* Bits above num_of_bits are dropped: */
+        ShareVec<T> c;
+        bitCompose(c, b);
+        SHAREMIND_TEST_CHECK(c.size() == n);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(c[i] == S(bits < 8u * sizeof(S) ? a[i] & ((S(1u) << bits) - 1u) : a[i]));
+    }
+}
+
+} /* namespace { */
+
+int main() {
+    testTranspose64x64();
+    testBitDecompose<UInt32Type>();
+    testBitDecompose<UInt64Type>();
+    testBitDecompose<UInt5Type>();
+    return testResult();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#ifndef SHAREMIND_PDKHEADERS_TESTS_TESTCOMMON_H
+#define SHAREMIND_PDKHEADERS_TESTS_TESTCOMMON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "ValueTraits.h"
+
+
+/*
+ * Value types and checks shared by the tests. A failed check is reported
+ * and the test continues, main() returns testResult() at the end.
+ */
+
+namespace sharemind {
+namespace test {
+
+struct __attribute__ ((visibility("internal"))) TestValueTag : any_value_tag {};
+
+struct UInt32Type {
+    using value_category = TestValueTag;
+    using share_type = std::uint32_t;
+    using public_type = std::uint32_t;
+    static constexpr std::uint8_t heap_type_id = 3u;
+    static constexpr std::size_t num_of_bits = 32u;
+    static constexpr std::size_t log_of_bits = 5u;
+};
+
+/* Shares of fewer bits than their share type, the kernels mask them: */
+struct UInt5Type {
+    using value_category = TestValueTag;
+    using share_type = std::uint8_t;
+    using public_type = std::uint8_t;
+    static constexpr std::uint8_t heap_type_id = 9u;
+    static constexpr std::size_t num_of_bits = 5u;
+    static constexpr std::size_t log_of_bits = 3u;
+};
+
+struct UInt64Type {
+    using value_category = TestValueTag;
+    using share_type = std::uint64_t;
+    using public_type = std::uint64_t;
+    static constexpr std::uint8_t heap_type_id = 4u;
+    static constexpr std::size_t num_of_bits = 64u;
+    static constexpr std::size_t log_of_bits = 6u;
+};
+
+struct BoolType {
+    using value_category = TestValueTag;
+    using share_type = std::uint8_t;
+    using public_type = bool;
+    static constexpr std::uint8_t heap_type_id = 1u;
+    static constexpr std::size_t num_of_bits = 1u;
+    static constexpr std::size_t log_of_bits = 0u;
+};
+
+inline unsigned & failures() noexcept {
+    static unsigned n = 0u;
+    return n;
+}
+
+inline int testResult() noexcept {
+    if (failures() != 0u)
+        std::fprintf(stderr, "%u checks failed.\n", failures());
+    return failures() == 0u ? 0 : 1;
+}
+
+/* Deterministic pseudorandom values, see splitmix64. */
+inline std::uint64_t testValue(std::uint64_t i) noexcept {
+    std::uint64_t z = i * UINT64_C(0x9E3779B97F4A7C15) + UINT64_C(0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30u)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27u)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31u);
+}
+
+} /* namespace test { */
+} /* namespace sharemind { */
+
+#define SHAREMIND_TEST_CHECK(...) \
+    do { \
+        if (!(__VA_ARGS__)) { \
+            std::fprintf(stderr, "%s:%d: Check failed: %s\n", \
+                         __FILE__, __LINE__, #__VA_ARGS__); \
+            ++sharemind::test::failures(); \
+        } \
+    } while (false)
+
+#endif /* SHAREMIND_PDKHEADERS_TESTS_TESTCOMMON_H */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "ConcurrentSharedValueHeap.h"
+#include "MappedFileAllocator.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+void testHandles() {
+    ConcurrentSharedValueHeap heap;
+    SHAREMIND_TEST_CHECK(!heap.insert_handle(static_cast<ShareVec<UInt32Type> *>(nullptr)));
+    void * const a = heap.insert_handle(new ShareVec<UInt32Type>(3u, 1u));
+    void * const b = heap.insert_handle(new ShareVec<UInt64Type>(2u, 2u));
+    SHAREMIND_TEST_CHECK(heap.size() == 2u);
+
+    ShareVec<UInt32Type> * const va = heap.get<UInt32Type>(a);
+    SHAREMIND_TEST_CHECK(va && va->size() == 3u && (*va)[2] == 1u);
+    SHAREMIND_TEST_CHECK(heap.check<UInt32Type>(a) && heap.check_exact<UInt32Type>(a));
+    SHAREMIND_TEST_CHECK(!heap.check<UInt64Type>(a) && !heap.get<UInt64Type>(a));
+    SHAREMIND_TEST_CHECK(!heap.erase_handle<UInt64Type>(a));
+    SHAREMIND_TEST_CHECK(heap.check<UInt64Type>(b) && !heap.check<UInt32Type>(b));
+
+    /* Stale handles stay invalid after their slot is reused: */
+    SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(a));
+    SHAREMIND_TEST_CHECK(!heap.check<UInt32Type>(a) && !heap.get<UInt32Type>(a));
+    SHAREMIND_TEST_CHECK(!heap.erase_handle<UInt32Type>(a));
+    void * const c = heap.insert_handle(new ShareVec<UInt32Type>(1u, 3u));
+    SHAREMIND_TEST_CHECK(c != a && !heap.check<UInt32Type>(a) && heap.check<UInt32Type>(c));
+    SHAREMIND_TEST_CHECK(heap.size() == 2u);
+
+    /* Pointers that are not handles are rejected: */
+    int local = 0;
+    SHAREMIND_TEST_CHECK(!heap.check<UInt32Type>(&local) && !heap.get<UInt32Type>(nullptr));
+}
+
+/* As in SharedValueHeap, check() ignores the allocator and get() does not. */
+void testAllocatorTypes() {
+    ConcurrentSharedValueHeap heap;
+    void * const m = heap.insert_handle(new MappedShareVec<UInt32Type>(4u, 9u));
+    SHAREMIND_TEST_CHECK(heap.check<UInt32Type>(m));
+    SHAREMIND_TEST_CHECK(!heap.check_exact<UInt32Type>(m) && !heap.get<UInt32Type>(m));
+    MappedShareVec<UInt32Type> * const vm = heap.get<UInt32Type, MappedFileAllocator<std::uint32_t> >(m);
+    SHAREMIND_TEST_CHECK(vm && (*vm)[3] == 9u);
+    SHAREMIND_TEST_CHECK(heap.check_exact<UInt32Type, MappedFileAllocator<std::uint32_t> >(m));
+    SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(m) && heap.size() == 0u);
+}
+
+void testThreads() {
+    ConcurrentSharedValueHeap heap;
+    std::size_t const numThreads = 4u;
+    std::size_t const perThread = 2000u;
+    std::vector<std::vector<void *> > handles(numThreads);
+    std::atomic<unsigned> errors(0u);
+
+    /* Every thread inserts, checks and erases its own vectors while reading the others': */
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0u; t < numThreads; ++t) {
+        threads.emplace_back([&heap, &handles, &errors, t, perThread] {
+            std::vector<void *> & mine = handles[t];
+            std::vector<void *> erased;
+            for (std::size_t round = 0u; round < 3u; ++round) {
+                for (std::size_t i = 0u; i < perThread; ++i) {
+                    std::uint32_t const value = std::uint32_t(t * perThread + i);
+                    mine.push_back(heap.insert_handle(new ShareVec<UInt32Type>(1u, value)));
+                }
+                for (std::size_t i = 0u; i < mine.size(); ++i) {
+                    ShareVec<UInt32Type> * const vec = heap.get<UInt32Type>(mine[i]);
+                    if (!vec || (*vec)[0] != std::uint32_t(t * perThread + i % perThread))
+                        ++errors;
+                }
+                for (void * const h : erased)
+                    if (heap.check<UInt32Type>(h))
+                        ++errors;
+                for (std::size_t i = 0u; i < mine.size(); ++i) {
+                    if (!heap.erase_handle<UInt32Type>(mine[i]))
+                        ++errors;
+                    erased.push_back(mine[i]);
+                }
+                mine.clear();
+            }
+            for (std::size_t i = 0u; i < perThread; ++i)
+                mine.push_back(heap.insert_handle(new ShareVec<UInt32Type>(1u, std::uint32_t(i))));
+        });
+    }
+    for (std::thread & thread : threads)
+        thread.join();
+
+    SHAREMIND_TEST_CHECK(errors.load() == 0u);
+    SHAREMIND_TEST_CHECK(heap.size() == numThreads * perThread);
+    bool ok = true;
+    for (std::size_t t = 0u; t < numThreads; ++t) {
+        for (std::size_t i = 0u; i < perThread; ++i) {
+            ShareVec<UInt32Type> * const vec = heap.get<UInt32Type>(handles[t][i]);
+            ok = ok && vec && (*vec)[0] == std::uint32_t(i);
+        }
+    }
+    SHAREMIND_TEST_CHECK(ok);
+}
+
+} /* namespace { */
+
+int main() {
+    testHandles();
+    testAllocatorTypes();
+    testThreads();
+    return testResult();
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include "MappedFileAllocator.h"
+#include "MetaSyscalls.h"
+#include "SharedValueHeap.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+#include "TestSyscalls.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+/* A value type all of whose vectors are file backed: */
+struct MappedUInt32Type : UInt32Type {
+    using share_allocator = MappedFileAllocator<std::uint32_t>;
+};
+
+struct AddProtocol {
+    template <typename Pdpi>
+    explicit AddProtocol(Pdpi &) noexcept {}
+
+    template <typename Vec>
+    bool invoke(const Vec & a, const Vec & b, Vec & out) {
+        out.resize(a.size());
+        for (std::size_t i = 0u; i < a.size(); ++i)
+            out[i] = a[i] + b[i];
+        return true;
+    }
+};
+
+/* Resolves handles with SharedValueHeap::get. */
+struct HeapPdpi {
+    bool isComputingNode() const noexcept { return true; }
+    SharedValueHeap & sharedValueHeap() noexcept { return heap; }
+    SharedValueHeap heap;
+};
+
+/* Validates address handles by value type only and casts them. */
+struct LegacyPdpi {
+    bool isComputingNode() const noexcept { return true; }
+    template <typename T>
+    bool isValidHandle(void * const handle) const { return heap.check<T>(handle); }
+    SharedValueHeap heap;
+};
+
+template <typename T, typename Pdpi>
+SharemindModuleApi0x1Error add(Pdpi & pdpi, void * const a, void * const b, void * const out) {
+    TestSyscallContext context(pdpi);
+    SharemindCodeBlock args[4];
+    args[0].uint64[0] = 0u;
+    args[1].p[0] = a;
+    args[2].p[0] = b;
+    args[3].p[0] = out;
+    return MetaSyscalls<Pdpi, 0u>::template binary_arith_vec<T, AddProtocol>(
+                args, 4u, nullptr, nullptr, nullptr, context.get());
+}
+
+void testAllocation() {
+    std::size_t const n = 100000u;
+    MappedShareVec<UInt32Type> big(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        big[i] = std::uint32_t(i);
+    big.resize(2u * n);
+    bool ok = true;
+    for (std::size_t i = 0u; i < n; ++i)
+        ok = ok && big[i] == std::uint32_t(i) && big[n + i] == 0u;
+    SHAREMIND_TEST_CHECK(ok);
+    release_processed(big, 0u, n);
+    SHAREMIND_TEST_CHECK(big[n - 1u] == std::uint32_t(n - 1u));
+
+    /* Storage is freed the way it was allocated after the threshold changes: */
+    MappedShareVec<UInt32Type> small(10u, 7u);
+    std::size_t const threshold = MappedFileStorage::minFileSize();
+    MappedFileStorage::setMinFileSize(1u);
+    MappedShareVec<UInt32Type> mapped(10u, 8u);
+    MappedFileStorage::setMinFileSize(threshold);
+    big.clear_and_release();
+    small.clear_and_release();
+    mapped.clear_and_release();
+    SHAREMIND_TEST_CHECK(big.empty() && small.empty() && mapped.empty());
+}
+
+void testHeapHandles() {
+    HeapPdpi pdpi;
+    SharedValueHeap & heap = pdpi.heap;
+    void * const a = heap.insert_handle(new ShareVec<MappedUInt32Type>(100000u, 2u));
+    void * const b = heap.insert_handle(new ShareVec<MappedUInt32Type>(100000u, 3u));
+    void * const out = heap.insert_handle(new ShareVec<MappedUInt32Type>());
+    SHAREMIND_TEST_CHECK(add<MappedUInt32Type>(pdpi, a, b, out) == SHAREMIND_MODULE_API_0x1_OK);
+    ShareVec<MappedUInt32Type> * const result = heap.get<MappedUInt32Type>(out);
+    SHAREMIND_TEST_CHECK(result && result->size() == 100000u && (*result)[99999u] == 5u);
+
+    /* Vectors with another allocator than the value type are not resolved: */
+    void * const m = heap.insert_handle(new MappedShareVec<UInt32Type>(10u));
+    void * const v = heap.insert_handle(new ShareVec<UInt32Type>(10u));
+    SHAREMIND_TEST_CHECK(heap.check<UInt32Type>(m) && !heap.check_exact<UInt32Type>(m));
+    SHAREMIND_TEST_CHECK(heap.check_exact<UInt32Type>(v));
+    SHAREMIND_TEST_CHECK(heap.check_exact<UInt32Type, MappedFileAllocator<std::uint32_t> >(m));
+    SHAREMIND_TEST_CHECK(!heap.get<UInt32Type>(m));
+    SHAREMIND_TEST_CHECK(add<UInt32Type>(pdpi, m, v, v) == SHAREMIND_MODULE_API_0x1_GENERAL_ERROR);
+    SHAREMIND_TEST_CHECK(add<UInt32Type>(pdpi, v, v, v) == SHAREMIND_MODULE_API_0x1_OK);
+}
+
+void testLegacyHandles() {
+    LegacyPdpi pdpi;
+    MappedShareVec<UInt32Type> * const m = new MappedShareVec<UInt32Type>(10u, 1u);
+    ShareVec<UInt32Type> * const v = new ShareVec<UInt32Type>(10u, 2u);
+    SHAREMIND_TEST_CHECK(pdpi.heap.insert(m) && pdpi.heap.insert(v));
+
+    /* isValidHandle accepts the mapped vector, the cast must not: */
+    SHAREMIND_TEST_CHECK(pdpi.isValidHandle<UInt32Type>(m));
+    SHAREMIND_TEST_CHECK(add<UInt32Type>(pdpi, m, v, v) == SHAREMIND_MODULE_API_0x1_GENERAL_ERROR);
+    SHAREMIND_TEST_CHECK(add<UInt32Type>(pdpi, v, v, m) == SHAREMIND_MODULE_API_0x1_GENERAL_ERROR);
+    SHAREMIND_TEST_CHECK((*m)[0] == 1u && m->size() == 10u);
+    SHAREMIND_TEST_CHECK(add<UInt32Type>(pdpi, v, v, v) == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK((*v)[9] == 4u);
+}
+
+} /* namespace { */
+
+int main() {
+    MappedFileStorage::setMinFileSize(65536u);
+    testAllocation();
+    testHeapHandles();
+    testLegacyHandles();
+    return testResult();
+}
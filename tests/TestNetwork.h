@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_PDKHEADERS_TESTS_TESTNETWORK_H
+#define SHAREMIND_PDKHEADERS_TESTS_TESTNETWORK_H
+
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <vector>
+#include "libpd.h"
+
+namespace sharemind {
+namespace test {
+
+/*
+ * A node whose sent messages are queued and received back in order. Also
+ * provides a gathering send facility, which records the segments it is
+ * given before concatenating them.
+ */
+class LoopbackNode {
+
+public: /* Methods: */
+
+    LoopbackNode() noexcept
+        : m_node{&lastError, &clearError, &isComputingNode, &nodeNumber,
+                 &sendMessage, &receiveMessage, &freeMessage}
+        , m_gather{sizeof(SharemindNodeGatherFacility),
+                   SHAREMIND_NODE_GATHER_FACILITY_VERSION,
+                   &sendMessageV}
+    {}
+
+    LoopbackNode(const LoopbackNode &) = delete;
+    LoopbackNode & operator=(const LoopbackNode &) = delete;
+
+    SharemindNode & node() noexcept { return m_node; }
+    const SharemindNodeGatherFacility & gather() const noexcept { return m_gather; }
+
+    /** \returns the number of sent messages not received yet. */
+    std::size_t pending() const noexcept { return m_queue.size(); }
+
+    /** \returns the messages received but not freed. */
+    std::size_t unfreed() const noexcept { return m_received.size(); }
+
+private: /* Fields: */
+
+    SharemindNode m_node; /* Must be the first member, see self(). */
+    SharemindNodeGatherFacility const m_gather;
+    std::deque<std::vector<char> > m_queue;
+    std::list<std::vector<char> > m_received;
+
+public: /* Fields: */
+
+    std::size_t sends = 0u;         /**< Calls to send_message. */
+    std::size_t gatheredSends = 0u; /**< Calls to send_message_v. */
+    std::vector<SharemindMessage> lastSegments; /**< Of the last send_message_v. */
+    bool failSends = false;
+
+private: /* Methods: */
+
+    /* The node is the first member: */
+    static LoopbackNode & self(const SharemindNode * node) noexcept
+    { return *reinterpret_cast<LoopbackNode *>(const_cast<SharemindNode *>(node)); }
+
+    static SharemindNetworkError lastError(const SharemindNode *)
+    { return SHAREMIND_NETWORK_OK; }
+
+    static void clearError(SharemindNode *) {}
+
+    static bool isComputingNode(const SharemindNode *) { return true; }
+
+    static size_t nodeNumber(const SharemindNode *) { return 1u; }
+
+    static SharemindNetworkError sendMessage(SharemindNode * node,
+                                             const SharemindMessage message)
+    {
+        LoopbackNode & n = self(node);
+        ++n.sends;
+        if (n.failSends)
+            return SHAREMIND_NETWORK_NETWORK_FATAL_ERROR;
+        const char * const first = static_cast<const char *>(message.data);
+        n.m_queue.emplace_back(first, first + message.size);
+        return SHAREMIND_NETWORK_OK;
+    }
+
+    static SharemindNetworkError sendMessageV(const SharemindNodeGatherFacility *,
+                                              SharemindNode * node,
+                                              const SharemindMessage * segments,
+                                              size_t numSegments)
+    {
+        LoopbackNode & n = self(node);
+        ++n.gatheredSends;
+        if (n.failSends)
+            return SHAREMIND_NETWORK_NETWORK_FATAL_ERROR;
+        n.lastSegments.assign(segments, segments + numSegments);
+        std::vector<char> whole;
+        for (std::size_t i = 0u; i < numSegments; ++i) {
+            const char * const first = static_cast<const char *>(segments[i].data);
+            whole.insert(whole.end(), first, first + segments[i].size);
+        }
+        n.m_queue.push_back(std::move(whole));
+        return SHAREMIND_NETWORK_OK;
+    }
+
+    static SharemindMessage receiveMessage(SharemindNode * node) {
+        LoopbackNode & n = self(node);
+        if (n.m_queue.empty())
+            return { nullptr, 0u };
+        n.m_received.push_back(std::move(n.m_queue.front()));
+        n.m_queue.pop_front();
+        /* Empty messages still need a non-null pointer: */
+        std::vector<char> & message = n.m_received.back();
+        return { message.empty() ? static_cast<const void *>(&n) : message.data(),
+                 message.size() };
+    }
+
+    static void freeMessage(SharemindNode * node, SharemindMessage * message) {
+        LoopbackNode & n = self(node);
+        for (auto it = n.m_received.begin(); it != n.m_received.end(); ++it) {
+            if (it->size() == message->size
+                && (it->empty() || it->data() == message->data))
+            {
+                n.m_received.erase(it);
+                return;
+            }
+        }
+    }
+
+}; /* class LoopbackNode { */
+
+} /* namespace test { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_PDKHEADERS_TESTS_TESTNETWORK_H */
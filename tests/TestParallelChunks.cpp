@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "ParallelChunks.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+/* Every chunk is run exactly once, whatever the number of workers. */
+void testRunCoversChunks() {
+    for (std::size_t const workers : { 0u, 1u, 3u, 8u }) {
+        ChunkThreadPool pool(workers);
+        SHAREMIND_TEST_CHECK(pool.concurrency() == workers + 1u);
+        for (std::size_t const n : { 0u, 1u, 2u, 7u, 1000u }) {
+            std::vector<std::atomic<unsigned> > runs(n);
+            for (std::atomic<unsigned> & r : runs)
+                r.store(0u);
+            pool.run(n, [&runs] (std::size_t const i) { ++runs[i]; });
+            for (std::atomic<unsigned> const & r : runs)
+                SHAREMIND_TEST_CHECK(r.load() == 1u);
+        }
+    }
+}
+
+void testConstCallable() {
+    ChunkThreadPool pool(3u);
+    std::atomic<std::size_t> sum(0u);
+    auto const f = [&sum] (std::size_t const i) { sum += i; };
+    pool.run(100u, f);
+    SHAREMIND_TEST_CHECK(sum.load() == 4950u);
+}
+
+void testExceptions() {
+    ChunkThreadPool pool(3u);
+    bool thrown = false;
+    try {
+        pool.run(100u, [] (std::size_t const i) {
+            if (i == 42u)
+                throw std::runtime_error("chunk");
+        });
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    SHAREMIND_TEST_CHECK(thrown);
+
+    /* The pool remains usable: */
+    std::atomic<std::size_t> count(0u);
+    pool.run(10u, [&count] (std::size_t) { ++count; });
+    SHAREMIND_TEST_CHECK(count.load() == 10u);
+}
+
+/* Jobs started from within a job run serially instead of deadlocking. */
+void testNestedRuns() {
+    ChunkThreadPool pool(3u);
+    std::atomic<std::size_t> count(0u);
+    pool.run(8u, [&pool, &count] (std::size_t) {
+        pool.run(8u, [&count] (std::size_t) { ++count; });
+    });
+    SHAREMIND_TEST_CHECK(count.load() == 64u);
+}
+
+struct Chunk {
+    std::size_t begin;
+    std::size_t end;
+};
+
+/* Checks that the chunks partition [0, size) into multiples of multiple. */
+void checkChunks(std::vector<Chunk> chunks, std::size_t const size, std::size_t const multiple) {
+    std::vector<bool> seen(size, false);
+    for (Chunk const & c : chunks) {
+        SHAREMIND_TEST_CHECK(c.begin < c.end && c.end <= size);
+        SHAREMIND_TEST_CHECK(c.begin % multiple == 0u);
+        SHAREMIND_TEST_CHECK(c.end == size || c.end % multiple == 0u);
+        for (std::size_t i = c.begin; i < c.end && i < size; ++i) {
+            SHAREMIND_TEST_CHECK(!seen[i]);
+            seen[i] = true;
+        }
+    }
+    for (std::size_t i = 0u; i < size; ++i)
+        SHAREMIND_TEST_CHECK(seen[i]);
+}
+
+template <typename F>
+std::vector<Chunk> collectChunks(F f) {
+    std::mutex mutex;
+    std::vector<Chunk> chunks;
+    f([&mutex, &chunks] (std::size_t const begin, std::size_t const end) {
+        std::lock_guard<std::mutex> const guard(mutex);
+        chunks.push_back(Chunk{begin, end});
+    });
+    return chunks;
+}
+
+void testParallelForChunks() {
+    ChunkThreadPool pool(3u);
+    for (std::size_t const size : { 0u, 1u, 99u, 100u, 101u, 10000u }) {
+        std::vector<Chunk> const chunks = collectChunks([&pool, size] (
+                    const std::function<void(std::size_t, std::size_t)> & f)
+        { parallel_for_chunks(pool, size, 100u, f); });
+        checkChunks(chunks, size, 100u);
+        SHAREMIND_TEST_CHECK(chunks.size() == (size + 99u) / 100u);
+    }
+
+    /* Chunk boundaries of share vectors lie on 64 byte multiples past data(): */
+    ShareVec<UInt32Type> vec(1000u);
+    std::vector<Chunk> chunks = collectChunks([&vec] (
+                const std::function<void(std::size_t, std::size_t)> & f)
+    { parallel_for_chunks(vec, 10u, f); });
+    checkChunks(chunks, vec.size(), 16u);
+
+    /* Chunks of bit vectors never share a block: */
+    BitShareVec<BoolType> bits(1000u);
+    chunks = collectChunks([&bits] (const std::function<void(std::size_t, std::size_t)> & f)
+                           { parallel_for_chunks(bits, 100u, f); });
+    checkChunks(chunks, bits.size(), 64u);
+
+    /* Huge grains do not overflow when rounded: */
+    chunks = collectChunks([&bits] (const std::function<void(std::size_t, std::size_t)> & f)
+                           { parallel_for_chunks(bits, SIZE_MAX, f); });
+    SHAREMIND_TEST_CHECK(chunks.size() == 1u && chunks[0].end == bits.size());
+}
+
+} /* namespace { */
+
+int main() {
+    testRunCoversChunks();
+    testConstCallable();
+    testExceptions();
+    testNestedRuns();
+    testParallelForChunks();
+    return testResult();
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "PdChunkedTransfer.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+#include "TestNetwork.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+ShareVec<UInt32Type> makeVector(std::size_t const n) {
+    ShareVec<UInt32Type> vec(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        vec[i] = static_cast<std::uint32_t>(testValue(i));
+    return vec;
+}
+
+void testChunkSize() {
+    SHAREMIND_TEST_CHECK(transferChunkSize<UInt32Type>() == defaultTransferChunkBytes / 4u);
+    SHAREMIND_TEST_CHECK(transferChunkSize<UInt64Type>(100u) == 12u);
+    SHAREMIND_TEST_CHECK(transferChunkSize<UInt64Type>(1u) == 1u);
+}
+
+void testRoundTrip(bool const gather) {
+    LoopbackNode loopback;
+    ShareVec<UInt32Type> const sent = makeVector(1000u);
+    SHAREMIND_TEST_CHECK(sendChunked(loopback.node(), sent, 300u,
+                                     gather ? &loopback.gather() : nullptr));
+    SHAREMIND_TEST_CHECK(loopback.pending() == 4u);
+    SHAREMIND_TEST_CHECK(loopback.sends + loopback.gatheredSends == 4u);
+    if (gather) {
+        /* The last chunk is referenced in place: */
+        SHAREMIND_TEST_CHECK(loopback.lastSegments.size() == 1u);
+        SHAREMIND_TEST_CHECK(loopback.lastSegments[0].data == sent.data() + 900u
+                             && loopback.lastSegments[0].size == 400u);
+    }
+
+    ShareVec<UInt32Type> received(sent.size());
+    std::vector<std::pair<std::size_t, std::size_t> > ranges;
+    bool inOrder = true;
+    SHAREMIND_TEST_CHECK(receiveChunked(loopback.node(), received, 300u,
+        [&] (std::size_t const begin, std::size_t const end) {
+            /* Every chunk is stored before the callback sees it: */
+            for (std::size_t i = begin; i < end; ++i)
+                inOrder = inOrder && received[i] == sent[i];
+            ranges.emplace_back(begin, end);
+        }));
+    SHAREMIND_TEST_CHECK(inOrder);
+    SHAREMIND_TEST_CHECK(ranges.size() == 4u && ranges[0].first == 0u && ranges[0].second == 300u
+                         && ranges[3].first == 900u && ranges[3].second == 1000u);
+    SHAREMIND_TEST_CHECK(std::equal(received.begin(), received.end(), sent.begin()));
+    SHAREMIND_TEST_CHECK(loopback.pending() == 0u && loopback.unfreed() == 0u);
+}
+
+void testEmpty() {
+    LoopbackNode loopback;
+    ShareVec<UInt32Type> vec;
+    SHAREMIND_TEST_CHECK(sendChunked(loopback.node(), vec, 10u, &loopback.gather()));
+    SHAREMIND_TEST_CHECK(loopback.pending() == 0u);
+    SHAREMIND_TEST_CHECK(receiveChunked(loopback.node(), vec, 10u));
+}
+
+void testChunkSizeMismatch() {
+    LoopbackNode loopback;
+    ShareVec<UInt32Type> const sent = makeVector(100u);
+    SHAREMIND_TEST_CHECK(sendChunked(loopback.node(), sent, 30u));
+    ShareVec<UInt32Type> received(sent.size());
+    std::size_t chunks = 0u;
+    SHAREMIND_TEST_CHECK(!receiveChunked(loopback.node(), received, 40u,
+        [&chunks] (std::size_t, std::size_t) { ++chunks; }));
+    SHAREMIND_TEST_CHECK(chunks == 0u && loopback.unfreed() == 0u);
+}
+
+void testFailures() {
+    LoopbackNode loopback;
+    ShareVec<UInt32Type> vec = makeVector(100u);
+
+    /* Nothing to receive: */
+    SHAREMIND_TEST_CHECK(!receiveChunked(loopback.node(), vec, 30u));
+
+    /* Sending stops at the first failed chunk: */
+    loopback.failSends = true;
+    SHAREMIND_TEST_CHECK(!sendChunked(loopback.node(), vec, 30u, &loopback.gather()));
+    SHAREMIND_TEST_CHECK(loopback.gatheredSends == 1u);
+}
+
+} /* namespace { */
+
+int main() {
+    testChunkSize();
+    testRoundTrip(false);
+    testRoundTrip(true);
+    testEmpty();
+    testChunkSizeMismatch();
+    testFailures();
+    return testResult();
+}
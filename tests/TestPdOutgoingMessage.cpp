@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "PdIncomingMessage.h"
+#include "PdOutgoingMessage.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+#include "TestNetwork.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+ShareVec<UInt32Type> makeVector(std::size_t const n) {
+    ShareVec<UInt32Type> vec(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        vec[i] = static_cast<std::uint32_t>(testValue(i));
+    return vec;
+}
+
+/* Receives a message of a header, the vector and a trailer. */
+bool receiveFramed(LoopbackNode & loopback, const ShareVec<UInt32Type> & expected) {
+    SharemindMessage const message = loopback.node().receive_message(&loopback.node());
+    if (!message.data
+        || message.size != 2u * sizeof(std::uint64_t) + expected.size() * sizeof(std::uint32_t))
+        return false;
+    PdIncomingMessage msg(message, loopback.node());
+    std::uint64_t header = 0u;
+    std::uint64_t trailer = 0u;
+    ShareVec<UInt32Type> vec(expected.size());
+    return msg.read(header) && header == expected.size()
+           && vec.deserialize(msg)
+           && msg.read(trailer) && trailer == 42u
+           && std::equal(vec.begin(), vec.end(), expected.begin());
+}
+
+void testGatheredSend() {
+    LoopbackNode loopback;
+    ShareVec<UInt32Type> const vec = makeVector(1000u);
+    PdOutgoingMessage msg(loopback.node(), &loopback.gather());
+    msg.write(std::uint64_t(vec.size()));
+    vec.serialize_zero_copy(msg);
+    msg.write(std::uint64_t(42u));
+    SHAREMIND_TEST_CHECK(msg.totalSize() == 16u + 4000u);
+    SHAREMIND_TEST_CHECK(msg.send());
+    SHAREMIND_TEST_CHECK(loopback.gatheredSends == 1u && loopback.sends == 0u);
+
+    /* The vector is referenced between the buffered header and trailer: */
+    SHAREMIND_TEST_CHECK(loopback.lastSegments.size() == 3u);
+    SHAREMIND_TEST_CHECK(loopback.lastSegments[0].size == 8u);
+    SHAREMIND_TEST_CHECK(loopback.lastSegments[1].data == vec.data()
+                         && loopback.lastSegments[1].size == 4000u);
+    SHAREMIND_TEST_CHECK(loopback.lastSegments[2].size == 8u);
+    SHAREMIND_TEST_CHECK(receiveFramed(loopback, vec));
+    SHAREMIND_TEST_CHECK(loopback.unfreed() == 0u);
+}
+
+void testCopyingSend() {
+    LoopbackNode loopback;
+    ShareVec<UInt32Type> const vec = makeVector(1000u);
+    {
+        PdOutgoingMessage msg(loopback.node());
+        msg.write(std::uint64_t(vec.size()));
+        vec.serialize_zero_copy(msg);
+        msg.write(std::uint64_t(42u));
+        SHAREMIND_TEST_CHECK(msg.send());
+    }
+    {
+        /* Facilities without send_message_v are not used: */
+        SharemindNodeGatherFacility const old = { sizeof(SharemindNodeGatherFacility), 0u, nullptr };
+        PdOutgoingMessage msg(loopback.node(), &old);
+        msg.write(std::uint64_t(vec.size()));
+        vec.serialize_zero_copy(msg);
+        msg.write(std::uint64_t(42u));
+        SHAREMIND_TEST_CHECK(msg.send());
+    }
+    SHAREMIND_TEST_CHECK(loopback.sends == 2u && loopback.gatheredSends == 0u);
+    SHAREMIND_TEST_CHECK(receiveFramed(loopback, vec));
+    SHAREMIND_TEST_CHECK(receiveFramed(loopback, vec));
+}
+
+void testPlainSend() {
+    LoopbackNode loopback;
+    PdOutgoingMessage msg(loopback.node(), &loopback.gather());
+    msg.write(std::uint32_t(7u));
+    SHAREMIND_TEST_CHECK(msg.totalSize() == 4u);
+    SHAREMIND_TEST_CHECK(msg.send());
+    SHAREMIND_TEST_CHECK(loopback.sends == 1u && loopback.gatheredSends == 0u);
+
+    /* Empty referenced arrays add no segments: */
+    PdOutgoingMessage empty(loopback.node(), &loopback.gather());
+    ShareVec<UInt32Type>().serialize_zero_copy(empty);
+    SHAREMIND_TEST_CHECK(empty.totalSize() == 0u);
+}
+
+void testChainSend() {
+    LoopbackNode loopback;
+    ShareVec<UInt32Type> const a = makeVector(10u);
+    ShareVec<UInt32Type> const b = makeVector(20u);
+    iterator_chain<const std::uint32_t *> chain;
+    chain.push_back(a.data(), a.data() + a.size());
+    chain.push_back(b.data(), b.data());
+    chain.push_back(b.data() + 5u, b.data() + b.size());
+
+    PdOutgoingMessage msg(loopback.node(), &loopback.gather());
+    chain.serialize_zero_copy(msg);
+    SHAREMIND_TEST_CHECK(msg.send());
+    SHAREMIND_TEST_CHECK(loopback.lastSegments.size() == 2u);
+    SHAREMIND_TEST_CHECK(loopback.lastSegments[0].data == a.data()
+                         && loopback.lastSegments[1].data == b.data() + 5u);
+
+    SharemindMessage const message = loopback.node().receive_message(&loopback.node());
+    SHAREMIND_TEST_CHECK(message.size == 25u * sizeof(std::uint32_t));
+    std::vector<std::uint32_t> expected(a.begin(), a.end());
+    expected.insert(expected.end(), b.begin() + 5, b.end());
+    SHAREMIND_TEST_CHECK(std::memcmp(message.data, expected.data(), message.size) == 0);
+    loopback.node().free_message(&loopback.node(), const_cast<SharemindMessage *>(&message));
+}
+
+void testFailedSend() {
+    LoopbackNode loopback;
+    loopback.failSends = true;
+    ShareVec<UInt32Type> const vec = makeVector(10u);
+    PdOutgoingMessage gathered(loopback.node(), &loopback.gather());
+    vec.serialize_zero_copy(gathered);
+    SHAREMIND_TEST_CHECK(!gathered.send());
+    PdOutgoingMessage copied(loopback.node());
+    vec.serialize_zero_copy(copied);
+    SHAREMIND_TEST_CHECK(!copied.send());
+    SHAREMIND_TEST_CHECK(loopback.pending() == 0u);
+}
+
+} /* namespace { */
+
+int main() {
+    testGatheredSend();
+    testCopyingSend();
+    testPlainSend();
+    testChainSend();
+    testFailedSend();
+    return testResult();
+}
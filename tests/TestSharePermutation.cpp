@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "SharePermutation.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+/* Sizes around the blocks of bit vectors and above the parallel grain: */
+const std::size_t testSizes[] = { 0u, 1u, 63u, 64u, 65u, 1000u, 100000u };
+
+std::vector<std::uint32_t> randomPermutation(std::size_t const n, std::uint64_t const seed) {
+    std::vector<std::uint32_t> perm(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        perm[i] = static_cast<std::uint32_t>(i);
+    for (std::size_t i = n; i > 1u; --i)
+        std::swap(perm[i - 1u], perm[testValue(seed + i) % i]);
+    return perm;
+}
+
+/* Indices into n elements with repetitions: */
+std::vector<std::uint64_t> randomIndices(std::size_t const count, std::size_t const n) {
+    std::vector<std::uint64_t> indices(count);
+    for (std::size_t i = 0u; i < count; ++i)
+        indices[i] = testValue(i) % n;
+    return indices;
+}
+
+ShareVec<UInt32Type> testVec(std::size_t const n) {
+    ShareVec<UInt32Type> v(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        v[i] = static_cast<std::uint32_t>(testValue(1000000u + i));
+    return v;
+}
+
+void testBits(BitShareVec<BoolType> & v, std::size_t const n) {
+    v.resize(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        v[i] = (testValue(2000000u + i) & 1u) != 0u;
+}
+
+void testInverse() {
+    for (std::size_t const n : testSizes) {
+        std::vector<std::uint32_t> const perm = randomPermutation(n, n);
+        std::vector<std::uint32_t> const inv = inverse_permutation(perm);
+        bool ok = inv.size() == n;
+        for (std::size_t i = 0u; ok && i < n; ++i)
+            ok = inv[perm[i]] == i;
+        SHAREMIND_TEST_CHECK(ok);
+    }
+}
+
+void testRing() {
+    for (std::size_t const n : testSizes) {
+        ShareVec<UInt32Type> const in = testVec(n);
+        std::vector<std::uint32_t> const perm = randomPermutation(n, 7u * n);
+
+        ShareVec<UInt32Type> permuted;
+        apply_permutation(permuted, in, perm);
+        bool ok = permuted.size() == n;
+        for (std::size_t i = 0u; ok && i < n; ++i)
+            ok = permuted[i] == in[perm[i]];
+        SHAREMIND_TEST_CHECK(ok);
+
+        /* Scattering through the permutation undoes it: */
+        ShareVec<UInt32Type> restored(n);
+        scatter(restored, permuted, perm);
+        SHAREMIND_TEST_CHECK(std::equal(restored.begin(), restored.end(), in.begin()));
+
+        ShareVec<UInt32Type> inPlace = testVec(n);
+        apply_permutation(inPlace, perm);
+        SHAREMIND_TEST_CHECK(std::equal(inPlace.begin(), inPlace.end(), permuted.begin()));
+
+        if (n == 0u)
+            continue;
+        std::vector<std::uint64_t> const indices = randomIndices(n / 2u + 3u, n);
+        ShareVec<UInt32Type> gathered;
+        gather(gathered, in, indices);
+        ok = gathered.size() == indices.size();
+        for (std::size_t i = 0u; ok && i < indices.size(); ++i)
+            ok = gathered[i] == in[indices[i]];
+        SHAREMIND_TEST_CHECK(ok);
+    }
+}
+
+void testBit() {
+    for (std::size_t const n : testSizes) {
+        BitShareVec<BoolType> in;
+        testBits(in, n);
+        std::vector<std::uint32_t> const perm = randomPermutation(n, 11u * n);
+
+        BitShareVec<BoolType> permuted;
+        apply_permutation(permuted, in, perm);
+        bool ok = permuted.size() == n;
+        for (std::size_t i = 0u; ok && i < n; ++i)
+            ok = bool(permuted[i]) == bool(in[perm[i]]);
+        SHAREMIND_TEST_CHECK(ok);
+
+        BitShareVec<BoolType> restored(n);
+        scatter(restored, permuted, perm);
+        SHAREMIND_TEST_CHECK(restored == in);
+
+        BitShareVec<BoolType> inPlace;
+        testBits(inPlace, n);
+        apply_permutation(inPlace, perm);
+        SHAREMIND_TEST_CHECK(inPlace == permuted);
+
+        if (n == 0u)
+            continue;
+        std::vector<std::uint64_t> const indices = randomIndices(n / 2u + 3u, n);
+        BitShareVec<BoolType> gathered;
+        gather(gathered, in, indices);
+        ok = gathered.size() == indices.size();
+        for (std::size_t i = 0u; ok && i < indices.size(); ++i)
+            ok = bool(gathered[i]) == bool(in[indices[i]]);
+        SHAREMIND_TEST_CHECK(ok);
+    }
+}
+
+/* Scattering into a larger vector leaves the other bits unchanged. */
+void testBitScatterPartial() {
+    std::size_t const n = 200u;
+    BitShareVec<BoolType> in;
+    testBits(in, 70u);
+    std::vector<std::uint32_t> const perm = randomPermutation(n, 3u);
+    std::vector<std::uint32_t> const indices(perm.begin(), perm.begin() + 70);
+    BitShareVec<BoolType> out(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        out[i] = true;
+    scatter(out, in, indices);
+    std::vector<bool> expected(n, true);
+    for (std::size_t i = 0u; i < indices.size(); ++i)
+        expected[indices[i]] = bool(in[i]);
+    bool ok = true;
+    for (std::size_t i = 0u; i < n; ++i)
+        ok = ok && bool(out[i]) == expected[i];
+    SHAREMIND_TEST_CHECK(ok);
+}
+
+} /* namespace { */
+
+int main() {
+    testInverse();
+    testRing();
+    testBit();
+    testBitScatterPartial();
+    return testResult();
+}
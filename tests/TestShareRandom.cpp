@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "ShareRandom.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+using Kernel = void (*)(const std::uint32_t *, std::uint64_t, unsigned char *, std::size_t);
+
+/* RFC 8439 section 2.3.2, serialized block with counter 1: */
+const unsigned char rfcBlock[64u] = {
+    0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+    0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+    0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+    0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+};
+
+/* RFC 8439 section 2.4.2, encrypted with counter 1: */
+const char rfcPlaintext[] =
+    "Ladies and Gentlemen of the class of '99: If I could offer you only one "
+    "tip for the future, sunscreen would be it.";
+const unsigned char rfcCiphertext[114u] = {
+    0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+    0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+    0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+    0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+    0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+    0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+    0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+    0x87, 0x4d
+};
+
+/* The key 00 01 ... 1f of both RFC 8439 examples: */
+void rfcKey(unsigned char (&key)[ChaCha20Rng::seedSize]) noexcept {
+    for (std::size_t i = 0u; i < sizeof(key); ++i)
+        key[i] = static_cast<unsigned char>(i);
+}
+
+/*
+ * The input words of the RFC 8439 example of 2.3.2. Words 12 and 13 are the
+ * 64-bit block counter of the kernels, they hold the 32-bit RFC counter and
+ * the first word of the nonce.
+ */
+void rfcInput(std::uint32_t (&input)[16u]) noexcept {
+    input[0u] = 0x61707865u;
+    input[1u] = 0x3320646eu;
+    input[2u] = 0x79622d32u;
+    input[3u] = 0x6b206574u;
+    for (std::uint32_t i = 0u; i < 8u; ++i)
+        input[4u + i] = (4u * i) | ((4u * i + 1u) << 8u) | ((4u * i + 2u) << 16u) | ((4u * i + 3u) << 24u);
+    input[12u] = 0u;
+    input[13u] = 0u;
+    input[14u] = 0x4a000000u;
+    input[15u] = 0u;
+}
+
+/* Checks every instruction set the CPU supports, not only the selected one. */
+void testKernels() {
+    std::vector<Kernel> variants(1u, &detail::chachaGeneric);
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+    kernels::Isa const isa = kernels::selectedIsa();
+    if (isa >= kernels::Isa::Avx2)
+        variants.push_back(&detail::chachaAvx2);
+    if (isa >= kernels::Isa::Avx512)
+        variants.push_back(&detail::chachaAvx512);
+#endif
+
+    std::uint32_t input[16u];
+    rfcInput(input);
+    std::uint64_t const counter = (std::uint64_t(0x09000000u) << 32u) | 1u;
+
+    /* Lengths that end within, at and after the lanes of all variants: */
+    std::size_t const lengths[] = { 1u, 63u, 64u, 65u, 1023u, 1024u, 1025u, 5000u };
+    std::vector<unsigned char> expected(5000u);
+    detail::chachaGeneric(input, counter, expected.data(), expected.size());
+    SHAREMIND_TEST_CHECK(std::memcmp(expected.data(), rfcBlock, 64u) == 0);
+
+    for (Kernel const kernel : variants) {
+        unsigned char block[64u];
+        kernel(input, counter, block, sizeof(block));
+        SHAREMIND_TEST_CHECK(std::memcmp(block, rfcBlock, sizeof(block)) == 0);
+
+        for (std::size_t const n : lengths) {
+            std::vector<unsigned char> out(n + 1u, 0xa5u);
+            kernel(input, counter, out.data(), n);
+            SHAREMIND_TEST_CHECK(std::memcmp(out.data(), expected.data(), n) == 0);
+            SHAREMIND_TEST_CHECK(out[n] == 0xa5u);
+        }
+
+        /* Counters continue across lanes and blocks: */
+        unsigned char later[64u];
+        kernel(input, counter + 70u, later, sizeof(later));
+        SHAREMIND_TEST_CHECK(std::memcmp(later, expected.data() + 70u * 64u, sizeof(later)) == 0);
+    }
+}
+
+void testRngKnownAnswer() {
+    unsigned char key[ChaCha20Rng::seedSize];
+    rfcKey(key);
+    ChaCha20Rng rng(key, 0x4a000000u);
+    unsigned char stream[64u + sizeof(rfcCiphertext)];
+    rng.fillBytes(stream, sizeof(stream));
+    SHAREMIND_TEST_CHECK(rng.counter() == 3u);
+
+    /* Block 0 is skipped, the RFC example starts from counter 1: */
+    bool matches = true;
+    for (std::size_t i = 0u; i < sizeof(rfcCiphertext); ++i)
+        matches = matches && static_cast<unsigned char>(stream[64u + i] ^ rfcPlaintext[i]) == rfcCiphertext[i];
+    SHAREMIND_TEST_CHECK(matches);
+
+    /* Every fill starts from a new block: */
+    unsigned char next[64u];
+    rng.fillBytes(next, sizeof(next));
+    SHAREMIND_TEST_CHECK(rng.counter() == 4u);
+    std::uint32_t input[16u];
+    rfcInput(input);
+    unsigned char expected[64u];
+    detail::chachaGeneric(input, 3u, expected, sizeof(expected));
+    SHAREMIND_TEST_CHECK(std::memcmp(next, expected, sizeof(next)) == 0);
+}
+
+/* Parallel output must not depend on the number of threads. */
+void testParallel() {
+    unsigned char key[ChaCha20Rng::seedSize];
+    rfcKey(key);
+    std::size_t const sizes[] = { 100u, ChaCha20Rng::parallelThreshold + 1000u, 3u * ChaCha20Rng::parallelGrain };
+    std::vector<std::vector<unsigned char> > serial;
+    std::vector<std::vector<unsigned char> > parallel;
+    for (std::size_t const n : sizes) {
+        serial.emplace_back(n);
+        parallel.emplace_back(n);
+    }
+    std::vector<RandomTarget> serialTargets;
+    std::vector<RandomTarget> parallelTargets;
+    for (std::size_t i = 0u; i < serial.size(); ++i) {
+        serialTargets.push_back(RandomTarget{ serial[i].data(), serial[i].size() });
+        parallelTargets.push_back(RandomTarget{ parallel[i].data(), parallel[i].size() });
+    }
+
+    ChaCha20Rng serialRng(key, 5u);
+    serialRng.fillSerial(serialTargets.data(), serialTargets.size());
+    ChunkThreadPool pool(3u);
+    ChaCha20Rng parallelRng(key, 5u);
+    parallelRng.fillMany(pool, parallelTargets.data(), parallelTargets.size());
+    SHAREMIND_TEST_CHECK(serial == parallel);
+    SHAREMIND_TEST_CHECK(serialRng.counter() == parallelRng.counter());
+
+    /* Other streams differ: */
+    ChaCha20Rng otherRng(key, 6u);
+    std::vector<unsigned char> other(serial[0].size());
+    otherRng.fillBytes(other.data(), other.size());
+    SHAREMIND_TEST_CHECK(other != serial[0]);
+}
+
+void testRandomizeAll() {
+    unsigned char key[ChaCha20Rng::seedSize];
+    rfcKey(key);
+    ChaCha20Rng rng(key);
+    ShareVec<UInt32Type> a(100u);
+    ShareVec<UInt64Type> b(33u);
+    BitShareVec<BoolType> bits(70u);
+    randomize_all(rng, a, b, bits);
+
+    ChaCha20Rng reference(key);
+    ShareVec<UInt32Type> ra(100u);
+    ShareVec<UInt64Type> rb(33u);
+    reference.fillBlock(ra.data(), ra.data() + ra.size());
+    reference.fillBlock(rb.data(), rb.data() + rb.size());
+    SHAREMIND_TEST_CHECK(std::equal(a.begin(), a.end(), ra.begin()));
+    SHAREMIND_TEST_CHECK(std::equal(b.begin(), b.end(), rb.begin()));
+
+    /* Bits past the size are cleared: */
+    auto const last = bits.blocks()[bits.num_blocks() - 1u];
+    std::size_t const used = bits.size() % (8u * sizeof(last));
+    SHAREMIND_TEST_CHECK(used == 0u || (last >> used) == 0u);
+}
+
+void testPool() {
+    unsigned char key[ChaCha20Rng::seedSize];
+    rfcKey(key);
+    {
+        RandomnessPool pool(key, 4096u, 1024u);
+        std::vector<unsigned char> out(10000u);
+        pool.fillBytes(out.data(), out.size());
+        SHAREMIND_TEST_CHECK(pool.servedBytes() + pool.generatedBytes() == out.size());
+        SHAREMIND_TEST_CHECK(pool.available() <= 4096u);
+        std::size_t zeros = 0u;
+        for (unsigned char const c : out)
+            zeros += c == 0u;
+        SHAREMIND_TEST_CHECK(zeros < out.size() / 64u);
+    }
+    {
+        /* Without a buffer everything is generated on request: */
+        RandomnessPool pool(key, 0u);
+        unsigned char out[100u];
+        pool.fillBytes(out, sizeof(out));
+        SHAREMIND_TEST_CHECK(pool.servedBytes() == 0u && pool.generatedBytes() == sizeof(out));
+    }
+}
+
+} /* namespace { */
+
+int main() {
+    testKernels();
+    testRngKnownAnswer();
+    testParallel();
+    testRandomizeAll();
+    testPool();
+    return testResult();
+}
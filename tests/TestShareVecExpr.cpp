@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include "ShareVecExpr.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+const std::size_t testSizes[] = { 0u, 1u, 15u, 64u, 65u, 1000u };
+
+template <typename T>
+typename ValueTraits<T>::share_type reduce(std::uint64_t const x) {
+    using S = typename ValueTraits<T>::share_type;
+    constexpr std::size_t bits = ValueTraits<T>::num_of_bits;
+    return S(bits < 64u ? x & ((UINT64_C(1) << bits) - 1u) : x);
+}
+
+/* Checks fused expressions against evaluating them operation by operation. */
+template <typename T>
+void testRingExpressions() {
+    using S = typename ValueTraits<T>::share_type;
+    for (std::size_t const n : testSizes) {
+        ShareVec<T> a(n), b(n), c(n), out;
+        for (std::size_t i = 0u; i < n; ++i) {
+            a[i] = reduce<T>(testValue(i));
+            b[i] = reduce<T>(testValue(n + i));
+            c[i] = reduce<T>(testValue(2u * n + i));
+        }
+
+        out = (a + b) * c ^ 0x15u;
+        SHAREMIND_TEST_CHECK(out.size() == n);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(out[i] == reduce<T>(((std::uint64_t(a[i]) + b[i]) * c[i]) ^ 0x15u));
+
+        /* Shifts see reduced operands, bits above the ring do not shift in: */
+        out = (a + b) >> 1u;
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(out[i] == S(reduce<T>(std::uint64_t(a[i]) + b[i]) >> 1u));
+        out = -a + (b << 3u) - ~c;
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(out[i] == reduce<T>(0u - std::uint64_t(a[i])
+                                                     + (std::uint64_t(b[i]) << 3u)
+                                                     - ~std::uint64_t(c[i])));
+        out = 3u * ((a & b) | c);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(out[i] == reduce<T>(3u * std::uint64_t((a[i] & b[i]) | c[i])));
+
+        /* The destination may be an operand: */
+        ShareVec<T> d(a.begin(), a.end());
+        d = d * d + b;
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(d[i] == reduce<T>(std::uint64_t(a[i]) * a[i] + b[i]));
+    }
+}
+
+void testBitExpressions() {
+    for (std::size_t const n : testSizes) {
+        BitShareVec<BoolType> p(n), q(n), r;
+        for (std::size_t i = 0u; i < n; ++i) {
+            p[i] = (testValue(i) & 1u) != 0u;
+            q[i] = (testValue(n + i) & 1u) != 0u;
+        }
+
+        r = ~(p & q) ^ (p | q);
+        SHAREMIND_TEST_CHECK(r.size() == n);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(bool(r[i]) == (!(p[i] && q[i]) != (p[i] || q[i])));
+
+        /* Negation must not set the bits past the end of the vector: */
+        r = ~p;
+        if (n % 64u != 0u)
+            SHAREMIND_TEST_CHECK((r.blocks()[r.num_blocks() - 1u] >> (n % 64u)) == 0u);
+    }
+}
+
+} /* namespace { */
+
+int main() {
+    testRingExpressions<UInt32Type>();
+    testRingExpressions<UInt64Type>();
+    testRingExpressions<UInt5Type>();
+    testBitExpressions();
+    return testResult();
+}
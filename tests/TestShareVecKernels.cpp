@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include "ShareVecKernels.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+/* Lengths around the vector widths of all instruction sets: */
+const std::size_t testSizes[] = { 0u, 1u, 3u, 15u, 16u, 17u, 31u, 33u, 63u, 64u, 65u, 1000u };
+
+template <typename T>
+ShareVec<T> testVec(std::size_t const n, std::uint64_t const seed) {
+    using S = typename ValueTraits<T>::share_type;
+    using M = kernels::detail::ring_mask<S, ValueTraits<T>::num_of_bits>;
+    ShareVec<T> v(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        v[i] = S(S(testValue(seed + i)) & M::value);
+    return v;
+}
+
+/* Checks the ring operations of T against scalar loops over the shares. */
+template <typename T>
+void testRingKernels() {
+    using S = typename ValueTraits<T>::share_type;
+    using M = kernels::detail::ring_mask<S, ValueTraits<T>::num_of_bits>;
+    const auto reduce = [] (std::uint64_t const x) { return S(S(x) & M::value); };
+    for (std::size_t const n : testSizes) {
+        ShareVec<T> const a = testVec<T>(n, 1u);
+        ShareVec<T> const b = testVec<T>(n, 1u << 20u);
+        ShareVec<T> c;
+
+#define SHAREMIND_TEST_BINARY(name, op) \
+        kernels::name(c, a, b); \
+        SHAREMIND_TEST_CHECK(c.size() == n); \
+        for (std::size_t i = 0u; i < n; ++i) \
+            SHAREMIND_TEST_CHECK(c[i] == reduce(std::uint64_t(a[i]) op std::uint64_t(b[i])));
+        SHAREMIND_TEST_BINARY(add, +)
+        SHAREMIND_TEST_BINARY(sub, -)
+        SHAREMIND_TEST_BINARY(mul, *)
+        SHAREMIND_TEST_BINARY(bitXor, ^)
+        SHAREMIND_TEST_BINARY(bitAnd, &)
+        SHAREMIND_TEST_BINARY(bitOr, |)
+#undef SHAREMIND_TEST_BINARY
+
+        kernels::negate(c, a);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(c[i] == reduce(0u - std::uint64_t(a[i])));
+        kernels::bitNot(c, a);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(c[i] == reduce(~std::uint64_t(a[i])));
+
+        for (unsigned const count : { 0u, 1u, 4u, unsigned(ValueTraits<T>::num_of_bits) - 1u,
+                                      unsigned(ValueTraits<T>::num_of_bits) })
+        {
+            kernels::shiftLeft(c, a, count);
+            for (std::size_t i = 0u; i < n; ++i)
+                SHAREMIND_TEST_CHECK(c[i] == (count >= 64u ? S(0u) : reduce(std::uint64_t(a[i]) << count)));
+            kernels::shiftRight(c, a, count);
+            for (std::size_t i = 0u; i < n; ++i)
+                SHAREMIND_TEST_CHECK(c[i] == (count >= 64u ? S(0u) : reduce(std::uint64_t(a[i]) >> count)));
+        }
+
+        /* The output may alias an input: */
+        c.assign(a);
+        kernels::add(c, c, b);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(c[i] == reduce(std::uint64_t(a[i]) + std::uint64_t(b[i])));
+    }
+}
+
+/* Checks every instruction set the CPU supports, not only the selected one. */
+void testIsaVariants() {
+    using L = std::uint32_t;
+    using Kernel = void (*)(L *, const L *, const L *, std::size_t, L, kernels::detail::MulOp);
+    Kernel variants[4] = { &kernels::detail::binaryGeneric<L, true, kernels::detail::MulOp>,
+                           nullptr, nullptr, nullptr };
+#ifdef SHAREMIND_PDKHEADERS_KERNELS_X86
+    kernels::Isa const isa = kernels::selectedIsa();
+    if (isa >= kernels::Isa::Sse2)
+        variants[1] = &kernels::detail::binarySse2<L, true, kernels::detail::MulOp>;
+    if (isa >= kernels::Isa::Avx2)
+        variants[2] = &kernels::detail::binaryAvx2<L, true, kernels::detail::MulOp>;
+    if (isa >= kernels::Isa::Avx512)
+        variants[3] = &kernels::detail::binaryAvx512<L, true, kernels::detail::MulOp>;
+#endif
+
+    std::size_t const n = 1000u;
+    L a[n], b[n], c[n];
+    for (std::size_t i = 0u; i < n; ++i) {
+        a[i] = L(testValue(i));
+        b[i] = L(testValue(n + i));
+    }
+
+    L const mask = 0xfffffu;
+    for (Kernel const kernel : variants) {
+        if (!kernel)
+            continue;
+        for (std::size_t const m : testSizes) {
+            kernel(c, a, b, m, mask, kernels::detail::MulOp());
+            for (std::size_t i = 0u; i < m; ++i)
+                SHAREMIND_TEST_CHECK(c[i] == L((a[i] * b[i]) & mask));
+        }
+    }
+}
+
+void testBitKernels() {
+    for (std::size_t const n : testSizes) {
+        BitShareVec<BoolType> a(n), b(n), c;
+        for (std::size_t i = 0u; i < n; ++i) {
+            a[i] = (testValue(i) & 1u) != 0u;
+            b[i] = (testValue(n + i) & 1u) != 0u;
+        }
+
+        kernels::bitXor(c, a, b);
+        SHAREMIND_TEST_CHECK(c.size() == n);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(bool(c[i]) == (bool(a[i]) != bool(b[i])));
+        kernels::mul(c, a, b);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(bool(c[i]) == (bool(a[i]) && bool(b[i])));
+        kernels::bitOr(c, a, b);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(bool(c[i]) == (bool(a[i]) || bool(b[i])));
+
+        /* Negation must not set the bits past the end of the vector: */
+        kernels::bitNot(c, a);
+        for (std::size_t i = 0u; i < n; ++i)
+            SHAREMIND_TEST_CHECK(bool(c[i]) != bool(a[i]));
+        if (n % 64u != 0u)
+            SHAREMIND_TEST_CHECK((c.blocks()[c.num_blocks() - 1u] >> (n % 64u)) == 0u);
+    }
+}
+
+} /* namespace { */
+
+int main() {
+    testRingKernels<UInt32Type>();
+    testRingKernels<UInt64Type>();
+    testRingKernels<UInt5Type>();
+    testIsaVariants();
+    testBitKernels();
+    return testResult();
+}
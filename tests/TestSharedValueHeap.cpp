@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include "MetaSyscalls.h"
+#include "SharedValueHeap.h"
+#include "ShareVector.h"
+#include "TestCommon.h"
+#include "TestSyscalls.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+template <typename F>
+bool throwsBadAlloc(F f) {
+    try {
+        f();
+    } catch (const std::bad_alloc &) {
+        return true;
+    }
+    return false;
+}
+
+/* Handles of erased vectors must stay invalid after their slot is reused. */
+void testHandleGenerations() {
+    SharedValueHeap heap;
+    std::vector<void *> handles;
+    for (std::size_t i = 0u; i < 100u; ++i)
+        handles.push_back(heap.insert_handle(new ShareVec<UInt32Type>(3u, std::uint32_t(i))));
+    SHAREMIND_TEST_CHECK(heap.size() == 100u);
+
+    for (std::size_t i = 0u; i < 100u; i += 2u)
+        SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(handles[i]));
+
+    for (std::size_t round = 0u; round < 3u; ++round) {
+        std::vector<void *> reused;
+        for (std::size_t i = 0u; i < 50u; ++i)
+            reused.push_back(heap.insert_handle(new ShareVec<UInt32Type>(1u, 7u)));
+        for (std::size_t i = 0u; i < 100u; i += 2u) {
+            SHAREMIND_TEST_CHECK(!heap.check<UInt32Type>(handles[i]));
+            SHAREMIND_TEST_CHECK(!heap.get<UInt32Type>(handles[i]));
+            SHAREMIND_TEST_CHECK(!heap.erase_handle<UInt32Type>(handles[i]));
+        }
+        for (void * const h : reused) {
+            ShareVec<UInt32Type> * const vec = heap.get<UInt32Type>(h);
+            SHAREMIND_TEST_CHECK(vec && vec->size() == 1u && (*vec)[0] == 7u);
+            for (std::size_t i = 0u; i < 100u; i += 2u)
+                SHAREMIND_TEST_CHECK(h != handles[i]);
+        }
+        for (void * const h : reused)
+            SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(h));
+    }
+
+    /* The surviving handles still resolve to their vectors: */
+    for (std::size_t i = 1u; i < 100u; i += 2u) {
+        ShareVec<UInt32Type> * const vec = heap.get<UInt32Type>(handles[i]);
+        SHAREMIND_TEST_CHECK(vec && (*vec)[2] == std::uint32_t(i));
+    }
+    SHAREMIND_TEST_CHECK(heap.size() == 50u);
+
+    /* Handles are checked by heap_type_id, resolved by exact type: */
+    SHAREMIND_TEST_CHECK(!heap.check<UInt64Type>(handles[1]));
+    SHAREMIND_TEST_CHECK(!heap.get<UInt64Type>(handles[1]));
+    SHAREMIND_TEST_CHECK(!heap.erase_handle<UInt64Type>(handles[1]));
+    SHAREMIND_TEST_CHECK(heap.check<UInt32Type>(handles[1]));
+
+    /* Vectors stored with insert() are looked up by address: */
+    ShareVec<UInt32Type> * const vec = new ShareVec<UInt32Type>(2u);
+    SHAREMIND_TEST_CHECK(heap.insert(vec) && !heap.insert(vec));
+    SHAREMIND_TEST_CHECK(heap.get<UInt32Type>(vec) == vec);
+    SHAREMIND_TEST_CHECK(heap.erase(vec) && !heap.check<UInt32Type>(vec));
+}
+
+void testRecycling() {
+    using Vec = ShareVec<UInt32Type>;
+    SharedValueHeap heap;
+
+    /* Recycling is off by default: */
+    heap.insert(heap.allocate<UInt32Type>(10u));
+    SHAREMIND_TEST_CHECK(heap.size() == 1u);
+    heap.trim_recycled();
+    {
+        void * const h = heap.insert_handle(heap.allocate<UInt32Type>(10u));
+        SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(h));
+        SharedValueHeap::RecycleStats const stats = heap.recycle_stats<UInt32Type>();
+        SHAREMIND_TEST_CHECK(stats.recycled == 0u && stats.dropped == 1u && stats.pooledVectors == 0u);
+    }
+
+    heap.set_recycle_limits({ 4u, 1u << 20u });
+    Vec * const small = heap.allocate<UInt32Type>(10u);
+    Vec * const big = heap.allocate<UInt32Type>(1000u);
+    void * const hs = heap.insert_handle(small);
+    void * const hb = heap.insert_handle(big);
+    std::fill(big->begin(), big->end(), 5u);
+    SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(hb) && heap.erase_handle<UInt32Type>(hs));
+    {
+        SharedValueHeap::RecycleStats const stats = heap.recycle_stats<UInt32Type>();
+        SHAREMIND_TEST_CHECK(stats.recycled == 2u && stats.pooledVectors == 2u);
+        SHAREMIND_TEST_CHECK(stats.pooledBytes == big->allocated_bytes() + small->allocated_bytes());
+        SHAREMIND_TEST_CHECK(heap.pooled_bytes() == stats.pooledBytes);
+    }
+
+    /* The vector with enough capacity is reused and its shares are reset: */
+    Vec * const reused = heap.allocate<UInt32Type>(800u);
+    SHAREMIND_TEST_CHECK(reused == big && reused->size() == 800u);
+    SHAREMIND_TEST_CHECK(std::count(reused->begin(), reused->end(), 0u) == 800);
+    Vec * const other = heap.allocate<UInt32Type>(3u);
+    SHAREMIND_TEST_CHECK(other == small);
+    {
+        SharedValueHeap::RecycleStats const stats = heap.recycle_stats<UInt32Type>();
+        SHAREMIND_TEST_CHECK(stats.hits == 2u && stats.pooledVectors == 0u && heap.pooled_bytes() == 0u);
+    }
+    delete reused;
+    delete other;
+
+    /* Full pools drop the erased vectors: */
+    std::vector<void *> handles;
+    for (std::size_t i = 0u; i < 6u; ++i)
+        handles.push_back(heap.insert_handle(heap.allocate<UInt32Type>(100u)));
+    for (void * const h : handles)
+        heap.erase_handle<UInt32Type>(h);
+    {
+        SharedValueHeap::RecycleStats const stats = heap.recycle_stats<UInt32Type>();
+        SHAREMIND_TEST_CHECK(stats.pooledVectors == 4u && stats.dropped == 3u);
+    }
+
+    /* Per type limits override the default and trim the pool: */
+    heap.set_recycle_limits(UInt32Type::heap_type_id, { 1u, 1u << 20u });
+    SHAREMIND_TEST_CHECK(heap.recycle_stats<UInt32Type>().pooledVectors == 1u);
+    void * const h64 = heap.insert_handle(heap.allocate<UInt64Type>(100u));
+    heap.erase_handle<UInt64Type>(h64);
+    SHAREMIND_TEST_CHECK(heap.recycle_stats<UInt64Type>().pooledVectors == 1u);
+    heap.set_recycle_limits({ 0u, 0u });
+    SHAREMIND_TEST_CHECK(heap.recycle_stats<UInt64Type>().pooledVectors == 0u);
+    SHAREMIND_TEST_CHECK(heap.recycle_stats<UInt32Type>().pooledVectors == 1u);
+
+    heap.trim_recycled();
+    SHAREMIND_TEST_CHECK(heap.recycle_stats<UInt32Type>().pooledVectors == 0u && heap.pooled_bytes() == 0u);
+}
+
+void testQuota() {
+    using Vec = ShareVec<UInt32Type>;
+    SharedValueHeap heap;
+    heap.set_recycle_limits({ 16u, 1u << 20u });
+    heap.set_memory_quota({ 8000u, 10000u });
+
+    /* Past the hard quota nothing is stored: */
+    Vec * const a = heap.allocate<UInt32Type>(1000u);
+    void * const ha = heap.insert_handle(a);
+    SHAREMIND_TEST_CHECK(heap.memory_usage().currentBytes == 4000u);
+    SHAREMIND_TEST_CHECK(throwsBadAlloc([&heap] { heap.allocate<UInt32Type>(2000u); }));
+    Vec * const big = new Vec(2000u);
+    SHAREMIND_TEST_CHECK(throwsBadAlloc([&heap, big] { heap.insert_handle(big); }));
+    SHAREMIND_TEST_CHECK(heap.size() == 1u && heap.memory_usage().currentBytes == 4000u);
+    delete big;
+
+    std::vector<void *> many(4u);
+    SHAREMIND_TEST_CHECK(throwsBadAlloc([&heap, &many] { heap.allocate_many<UInt32Type>(many.data(), 4u, 500u); }));
+    SHAREMIND_TEST_CHECK(heap.size() == 1u && heap.memory_usage().currentBytes == 4000u);
+
+    /* Pooled vectors count towards the quota and are freed past the soft quota: */
+    Vec * const b = heap.allocate<UInt32Type>(1000u);
+    heap.insert(b);
+    SHAREMIND_TEST_CHECK(heap.memory_usage().peakBytes == 8000u);
+    SHAREMIND_TEST_CHECK(heap.erase(b));
+    SHAREMIND_TEST_CHECK(heap.memory_usage().currentBytes == 4000u && heap.pooled_bytes() == 4000u);
+    SHAREMIND_TEST_CHECK(!heap.over_soft_quota());
+    void * const hc = heap.insert_handle(new Vec(1200u));
+    SHAREMIND_TEST_CHECK(heap.pooled_bytes() == 0u && heap.memory_usage().currentBytes == 8800u);
+
+    /* Growth is checked beforehand by check_usage and afterwards by update_usage: */
+    SHAREMIND_TEST_CHECK(heap.check_usage(ha, 4800u));
+    SHAREMIND_TEST_CHECK(throwsBadAlloc([&heap, ha] { heap.check_usage(ha, 6000u); }));
+    a->reserve(1200u);
+    SHAREMIND_TEST_CHECK(heap.update_usage(ha) && heap.memory_usage().currentBytes == 9600u);
+    a->resize(100000u);
+    SHAREMIND_TEST_CHECK(throwsBadAlloc([&heap, ha] { heap.update_usage(ha); }));
+    SHAREMIND_TEST_CHECK(a->empty() && a->allocated_bytes() == 0u);
+    SHAREMIND_TEST_CHECK(heap.memory_usage().currentBytes == 4800u);
+
+    SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(ha) && heap.erase_handle<UInt32Type>(hc));
+    SHAREMIND_TEST_CHECK(heap.memory_usage().currentBytes == 0u && heap.size() == 0u);
+    SHAREMIND_TEST_CHECK(heap.memory_usage().currentBytes + heap.pooled_bytes() <= 10000u);
+}
+
+void testManyHandles() {
+    using Vec = ShareVec<UInt32Type>;
+    SharedValueHeap heap;
+    void * const other = heap.insert_handle(new ShareVec<UInt64Type>(1u));
+
+    Vec * vecs[5] = { new Vec(1u, 1u), nullptr, new Vec(2u, 2u), new Vec(3u, 3u), nullptr };
+    void * hndls[5];
+    heap.insert_many(vecs, 5u, hndls);
+    SHAREMIND_TEST_CHECK(heap.size() == 4u && !hndls[1] && !hndls[4]);
+    SHAREMIND_TEST_CHECK(heap.get<UInt32Type>(hndls[0]) == vecs[0]
+                         && heap.get<UInt32Type>(hndls[2]) == vecs[2]
+                         && heap.get<UInt32Type>(hndls[3]) == vecs[3]);
+
+    void * allocated[3];
+    heap.allocate_many<UInt32Type>(allocated, 3u, 10u);
+    bool ok = heap.size() == 7u;
+    for (void * const h : allocated) {
+        Vec * const vec = heap.get<UInt32Type>(h);
+        ok = ok && vec && vec->size() == 10u && std::count(vec->begin(), vec->end(), 0u) == 10;
+    }
+    SHAREMIND_TEST_CHECK(ok);
+
+    /* Null, stale and differently typed handles are skipped: */
+    SHAREMIND_TEST_CHECK(heap.erase_handle<UInt32Type>(allocated[2]));
+    void * const toErase[] = { hndls[0], hndls[1], other, allocated[2], hndls[2], allocated[0] };
+    SHAREMIND_TEST_CHECK(heap.erase_many<UInt32Type>(toErase, 6u) == 3u);
+    SHAREMIND_TEST_CHECK(heap.size() == 3u);
+    SHAREMIND_TEST_CHECK(heap.get<UInt32Type>(hndls[3]) == vecs[3] && heap.check<UInt32Type>(allocated[1]));
+    SHAREMIND_TEST_CHECK(heap.check<UInt64Type>(other));
+    SHAREMIND_TEST_CHECK(heap.erase_many<UInt32Type>(toErase, 0u) == 0u);
+}
+
+struct HeapPdpi {
+    bool isComputingNode() const noexcept { return computing; }
+    SharedValueHeap & sharedValueHeap() noexcept { return heap; }
+    SharedValueHeap heap;
+    bool computing = true;
+};
+
+void testManySyscalls() {
+    using Syscalls = MetaSyscalls<HeapPdpi, 0u>;
+    HeapPdpi pdpi;
+    TestSyscallContext context(pdpi);
+    SharemindCodeBlock args[2];
+    args[0].uint64[0] = 0u;
+    args[1].uint64[0] = 5u;
+    void * hndls[4] = { nullptr, nullptr, nullptr, nullptr };
+    SharemindModuleApi0x1Reference const refs[] = { { hndls, sizeof(hndls) }, { nullptr, 0u } };
+    SHAREMIND_TEST_CHECK(Syscalls::new_vec_many<UInt32Type>(args, 2u, refs, nullptr, nullptr, context.get())
+                         == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK(pdpi.heap.size() == 4u);
+    ShareVec<UInt32Type> * const vec = pdpi.heap.get<UInt32Type>(hndls[3]);
+    SHAREMIND_TEST_CHECK(vec && vec->size() == 5u);
+
+    /* All vectors are erased even if some handles are invalid: */
+    SHAREMIND_TEST_CHECK(pdpi.heap.erase_handle<UInt32Type>(hndls[1]));
+    SharemindModuleApi0x1CReference const crefs[] = { { hndls, sizeof(hndls) }, { nullptr, 0u } };
+    SHAREMIND_TEST_CHECK(Syscalls::delete_vec_many<UInt32Type>(args, 1u, nullptr, crefs, nullptr, context.get())
+                         == SHAREMIND_MODULE_API_0x1_GENERAL_ERROR);
+    SHAREMIND_TEST_CHECK(pdpi.heap.size() == 0u);
+
+    /* Malformed arrays are rejected, other nodes do nothing: */
+    SharemindModuleApi0x1Reference const odd[] = { { hndls, sizeof(void *) + 1u }, { nullptr, 0u } };
+    SHAREMIND_TEST_CHECK(Syscalls::new_vec_many<UInt32Type>(args, 2u, odd, nullptr, nullptr, context.get())
+                         == SHAREMIND_MODULE_API_0x1_INVALID_CALL);
+    pdpi.computing = false;
+    SHAREMIND_TEST_CHECK(Syscalls::new_vec_many<UInt32Type>(args, 2u, refs, nullptr, nullptr, context.get())
+                         == SHAREMIND_MODULE_API_0x1_OK);
+    SHAREMIND_TEST_CHECK(pdpi.heap.size() == 0u);
+}
+
+} /* namespace { */
+
+int main() {
+    testHandleGenerations();
+    testRecycling();
+    testQuota();
+    testManyHandles();
+    testManySyscalls();
+    return testResult();
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#ifndef SHAREMIND_PDKHEADERS_TESTS_TESTSYSCALLS_H
+#define SHAREMIND_PDKHEADERS_TESTS_TESTSYSCALLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sharemind/module-apis/api_0x1.h>
+#include <type_traits>
+
+
+namespace sharemind {
+namespace test {
+
+/*
+ * Syscall context of a single PDPI, for invoking syscalls directly. Only
+ * the members read by PdpiVmHandles are set, the context is built bytewise
+ * since its members are const.
+ */
+class TestSyscallContext {
+
+private: /* Types: */
+
+    using Context = SharemindModuleApi0x1SyscallContext;
+    using GetPdpiInfo = typename std::remove_const<decltype(Context::get_pdpi_info)>::type;
+
+public: /* Methods: */
+
+    template <typename Pdpi>
+    explicit TestSyscallContext(Pdpi & pdpi, std::size_t const pdkIndex = 0u) noexcept {
+        std::memset(&m_storage, 0, sizeof(m_storage));
+        void * const moduleHandle = &m_module;
+        GetPdpiInfo const getPdpiInfo = &TestSyscallContext::getPdpiInfo;
+        unsigned char * const bytes = reinterpret_cast<unsigned char *>(&m_storage);
+        std::memcpy(bytes + offsetof(Context, moduleHandle), &moduleHandle, sizeof(moduleHandle));
+        std::memcpy(bytes + offsetof(Context, get_pdpi_info), &getPdpiInfo, sizeof(getPdpiInfo));
+        m_info.pdpiHandle = &pdpi;
+        m_info.pdHandle = nullptr;
+        m_info.pdkIndex = pdkIndex;
+        m_info.moduleHandle = moduleHandle;
+    }
+
+    TestSyscallContext(const TestSyscallContext &) = delete;
+    TestSyscallContext & operator=(const TestSyscallContext &) = delete;
+
+    Context * get() noexcept { return reinterpret_cast<Context *>(&m_storage); }
+
+private: /* Methods: */
+
+    static const SharemindModuleApi0x1PdpiInfo * getPdpiInfo(Context * c, std::uint64_t const pdIndex) {
+        /* The context is the first member: */
+        TestSyscallContext * const self = reinterpret_cast<TestSyscallContext *>(c);
+        return pdIndex == 0u ? &self->m_info : nullptr;
+    }
+
+private: /* Fields: */
+
+    typename std::aligned_storage<sizeof(Context), alignof(Context)>::type m_storage;
+    SharemindModuleApi0x1PdpiInfo m_info;
+    char m_module = 0;
+
+}; /* class TestSyscallContext { */
+
+} /* namespace test { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_PDKHEADERS_TESTS_TESTSYSCALLS_H */
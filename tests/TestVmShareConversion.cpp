@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ShareVector.h"
+#include "ShareVecView.h"
+#include "TestCommon.h"
+#include "VmShareConversion.h"
+#include "VmVector.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+/* Public values narrower than their shares: */
+struct Int16Type {
+    using value_category = TestValueTag;
+    using share_type = std::uint32_t;
+    using public_type = std::int16_t;
+    static constexpr std::uint8_t heap_type_id = 10u;
+    static constexpr std::size_t num_of_bits = 32u;
+    static constexpr std::size_t log_of_bits = 5u;
+};
+
+/* Sizes around the vector widths and above the parallel grain: */
+const std::size_t testSizes[] = { 0u, 1u, 7u, 63u, 64u, 65u, 127u, 128u, 1000u, 100000u };
+
+/* VM memory of n public values, VM references are never null. */
+template <typename T>
+struct VmMemory {
+    using P = typename ValueTraits<T>::public_type;
+
+    explicit VmMemory(std::size_t const n)
+        : values(new P[n + 1u]())
+        , size(n)
+    {}
+
+    MutableVmVec<T> mutableVec() const {
+        SharemindModuleApi0x1Reference const ref = { values.get(), size * sizeof(P) };
+        return MutableVmVec<T>(ref);
+    }
+
+    ImmutableVmVec<T> immutableVec() const {
+        SharemindModuleApi0x1CReference const cref = { values.get(), size * sizeof(P) };
+        return ImmutableVmVec<T>(cref);
+    }
+
+    std::unique_ptr<P[]> values;
+    std::size_t size;
+};
+
+/* Checks classify and declassify of T against converting value by value. */
+template <typename T>
+void testConversion() {
+    using S = typename ValueTraits<T>::share_type;
+    using P = typename ValueTraits<T>::public_type;
+    using M = kernels::detail::ring_mask<S, ValueTraits<T>::num_of_bits>;
+    for (std::size_t const n : testSizes) {
+        VmMemory<T> in(n);
+        for (std::size_t i = 0u; i < n; ++i)
+            in.values[i] = P(testValue(i));
+
+        ShareVec<T> shares;
+        classify(shares, in.immutableVec());
+        bool ok = shares.size() == n;
+        for (std::size_t i = 0u; ok && i < n; ++i)
+            ok = shares[i] == S(S(in.values[i]) & M::value);
+        SHAREMIND_TEST_CHECK(ok);
+
+        VmMemory<T> out(n);
+        MutableVmVec<T> outVec = out.mutableVec();
+        declassify(outVec, shares);
+        ok = true;
+        for (std::size_t i = 0u; ok && i < n; ++i)
+            ok = out.values[i] == P(shares[i]);
+        SHAREMIND_TEST_CHECK(ok);
+
+        /* Strided views are converted element by element: */
+        if (n < 2u)
+            continue;
+        ShareVec<T> every(n, S(0u));
+        classify(ShareVecView<T>(every, 0u, n / 2u, 2), in.immutableVec().subspan(0u, n / 2u));
+        ok = true;
+        for (std::size_t i = 0u; ok && i < n / 2u; ++i)
+            ok = every[2u * i] == shares[i] && every[2u * i + 1u] == 0u;
+        SHAREMIND_TEST_CHECK(ok);
+        MutableVmVec<T> half = out.mutableVec().subspan(0u, n / 2u);
+        declassify(half, ConstShareVecView<T>(shares, 1u, n / 2u, 2));
+        ok = true;
+        for (std::size_t i = 0u; ok && i < n / 2u; ++i)
+            ok = out.values[i] == P(shares[2u * i + 1u]);
+        SHAREMIND_TEST_CHECK(ok);
+    }
+}
+
+/* Integers of the share width are viewed in place. */
+void testShareView() {
+    VmMemory<UInt32Type> mem(10u);
+    for (std::size_t i = 0u; i < 10u; ++i)
+        mem.values[i] = std::uint32_t(i);
+    ConstShareVecView<UInt32Type> const view = share_view_of(mem.immutableVec());
+    SHAREMIND_TEST_CHECK(view.data() == mem.values.get() && view.size() == 10u && view[9] == 9u);
+    MutableVmVec<UInt32Type> out = mem.mutableVec();
+    share_view_of(out)[3] = 42u;
+    SHAREMIND_TEST_CHECK(mem.values[3] == 42u);
+    SHAREMIND_TEST_CHECK(vm_layout_matches<UInt32Type>::value);
+    SHAREMIND_TEST_CHECK(!vm_layout_matches<UInt5Type>::value);
+    SHAREMIND_TEST_CHECK(!vm_layout_matches<Int16Type>::value);
+    SHAREMIND_TEST_CHECK(!vm_layout_matches<BoolType>::value);
+}
+
+void testBooleans() {
+    for (std::size_t const n : testSizes) {
+        VmMemory<BoolType> in(n);
+        for (std::size_t i = 0u; i < n; ++i)
+            in.values[i] = (testValue(i) & 1u) != 0u;
+
+        BitShareVec<BoolType> bits;
+        classify(bits, in.immutableVec());
+        bool ok = bits.size() == n;
+        for (std::size_t i = 0u; ok && i < n; ++i)
+            ok = bool(bits[i]) == in.values[i];
+        SHAREMIND_TEST_CHECK(ok);
+
+        VmMemory<BoolType> out(n);
+        MutableVmVec<BoolType> outVec = out.mutableVec();
+        declassify(outVec, bits);
+        ok = true;
+        for (std::size_t i = 0u; ok && i < n; ++i)
+            ok = out.values[i] == in.values[i];
+        SHAREMIND_TEST_CHECK(ok);
+    }
+}
+
+/* Checks the SWAR packing of booleans against packing bit by bit. */
+void testPackBits() {
+    std::vector<std::uint8_t> bytes(100000u + 3u);
+    for (std::size_t i = 0u; i < bytes.size(); ++i)
+        bytes[i] = std::uint8_t(testValue(i) & 1u);
+
+    for (std::size_t const n : testSizes) {
+        /* Unaligned input must work too: */
+        for (std::size_t const offset : { 0u, 3u }) {
+            std::uint8_t const * const in = bytes.data() + offset;
+            std::vector<std::uint64_t> packed(n / 64u + 1u, ~std::uint64_t(0u));
+            kernels::detail::packBits(packed.data(), in, n);
+            for (std::size_t i = 0u; i < n; ++i)
+                SHAREMIND_TEST_CHECK(((packed[i / 64u] >> (i % 64u)) & 1u) == in[i]);
+            if (n % 64u != 0u)
+                SHAREMIND_TEST_CHECK((packed[n / 64u] >> (n % 64u)) == 0u);
+
+            std::vector<std::uint8_t> unpacked(n + 1u, 0xaau);
+            kernels::detail::unpackBits(unpacked.data(), packed.data(), n);
+            for (std::size_t i = 0u; i < n; ++i)
+                SHAREMIND_TEST_CHECK(unpacked[i] == in[i]);
+            SHAREMIND_TEST_CHECK(unpacked[n] == 0xaau);
+        }
+    }
+
+    /* Every bit pattern of a byte is unpacked to 0 or 1: */
+    std::uint64_t words[4];
+    for (std::size_t i = 0u; i < 4u; ++i)
+        words[i] = testValue(i) | (i == 0u ? UINT64_C(0xff00ff00ff00ff00) : 0u);
+    std::uint8_t out[256];
+    kernels::detail::unpackBits(out, words, 256u);
+    for (std::size_t i = 0u; i < 256u; ++i)
+        SHAREMIND_TEST_CHECK(out[i] == ((words[i / 64u] >> (i % 64u)) & 1u));
+}
+
+} /* namespace { */
+
+int main() {
+    testConversion<UInt32Type>();
+    testConversion<UInt5Type>();
+    testConversion<UInt64Type>();
+    testConversion<Int16Type>();
+    testShareView();
+    testBooleans();
+    testPackBits();
+    return testResult();
+}
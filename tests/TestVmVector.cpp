@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#include "TestCommon.h"
+#include "VmVector.h"
+
+
+using namespace sharemind;
+using namespace sharemind::test;
+
+namespace {
+
+/* Collects written arrays and reads them back in order. */
+struct BufferMessage {
+    template <typename T>
+    void writeArray(const T * const data, std::size_t const n) {
+        const char * const bytes = reinterpret_cast<const char *>(data);
+        buffer.insert(buffer.end(), bytes, bytes + n * sizeof(T));
+        ++writes;
+    }
+
+    template <typename T>
+    void writeArrayRef(const T * const data, std::size_t const n) {
+        refs.push_back(data);
+        writeArray(data, n);
+    }
+
+    template <typename T>
+    bool readArray(T * const data, std::size_t const n) {
+        if (buffer.size() - offset < n * sizeof(T))
+            return false;
+        std::memcpy(data, buffer.data() + offset, n * sizeof(T));
+        offset += n * sizeof(T);
+        return true;
+    }
+
+    std::vector<char> buffer;
+    std::vector<const void *> refs;
+    std::size_t offset = 0u;
+    std::size_t writes = 0u;
+};
+
+ImmutableVmVec<UInt32Type> immutable(const std::vector<std::uint32_t> & values) {
+    SharemindModuleApi0x1CReference const cref = { values.data(), values.size() * sizeof(std::uint32_t) };
+    return ImmutableVmVec<UInt32Type>(cref);
+}
+
+std::vector<std::uint32_t> testValues(std::size_t const n) {
+    std::vector<std::uint32_t> r(n);
+    for (std::size_t i = 0u; i < n; ++i)
+        r[i] = std::uint32_t(testValue(i));
+    return r;
+}
+
+void testSubspans() {
+    std::vector<std::uint32_t> values = testValues(100u);
+    MutableVmVec<UInt32Type> vec(values);
+    MutableVmVec<UInt32Type> sub = vec.subspan(10u, 20u);
+    SHAREMIND_TEST_CHECK(sub.size() == 20u && sub.begin() == values.data() + 10);
+    sub[0] = 7u;
+    SHAREMIND_TEST_CHECK(values[10] == 7u);
+    SHAREMIND_TEST_CHECK(vec.subspan(100u, 0u).empty());
+
+    ImmutableVmVec<UInt32Type> const view = immutable(values);
+    ImmutableVmVec<UInt32Type> const tail = view.subspan(90u, 10u);
+    SHAREMIND_TEST_CHECK(tail.size() == 10u && tail[9] == values[99]);
+
+    /* Subspans are serialized by reference: */
+    BufferMessage msg;
+    tail.serialize_zero_copy(msg);
+    SHAREMIND_TEST_CHECK(msg.refs.size() == 1u && msg.refs[0] == values.data() + 90);
+    SHAREMIND_TEST_CHECK(msg.buffer.size() == 40u);
+}
+
+void testChunks() {
+    std::vector<std::uint32_t> values = testValues(100u);
+    MutableVmVec<UInt32Type> vec(values);
+    for (std::size_t const chunkSize : { 1u, 7u, 50u, 100u, 1000u }) {
+        VmVecChunks<MutableVmVec<UInt32Type> > const chunks = vec.chunks(chunkSize);
+        SHAREMIND_TEST_CHECK(chunks.size() == (100u + chunkSize - 1u) / chunkSize);
+        std::size_t count = 0u;
+        std::size_t expectedOffset = 0u;
+        bool ok = true;
+        for (auto it = chunks.begin(); it != chunks.end(); ++it, ++count) {
+            MutableVmVec<UInt32Type> chunk = *it;
+            ok = ok && it.offset() == expectedOffset
+                 && chunk.begin() == values.data() + expectedOffset
+                 && chunk.size() == std::min<std::size_t>(chunkSize, 100u - expectedOffset);
+            expectedOffset += chunk.size();
+        }
+        SHAREMIND_TEST_CHECK(ok && count == chunks.size() && expectedOffset == 100u);
+        MutableVmVec<UInt32Type> const last = chunks[chunks.size() - 1u];
+        SHAREMIND_TEST_CHECK(last.end() == values.data() + 100);
+    }
+
+    /* Chunk iterators yield values, they are input iterators: */
+    using Iterator = VmVecChunks<ImmutableVmVec<UInt32Type> >::iterator;
+    SHAREMIND_TEST_CHECK((std::is_same<std::iterator_traits<Iterator>::iterator_category,
+                                       std::input_iterator_tag>::value));
+
+    ImmutableVmVec<UInt32Type> const view = immutable(values);
+    std::size_t total = 0u;
+    for (ImmutableVmVec<UInt32Type> const chunk : view.chunks(30u))
+        total += chunk.size();
+    SHAREMIND_TEST_CHECK(total == 100u);
+    SHAREMIND_TEST_CHECK(view.subspan(0u, 0u).chunks(8u).empty()
+                         && view.subspan(0u, 0u).chunks(8u).size() == 0u);
+}
+
+void testStrided() {
+    std::vector<std::uint32_t> values = testValues(100u);
+    MutableVmVec<UInt32Type> vec(values);
+
+    /* Every third element starting from 1, the last one is element 97: */
+    auto strided = vec.strided(1u, 33u, 3);
+    SHAREMIND_TEST_CHECK(strided.size() == 33u && strided.stride() == 3);
+    SHAREMIND_TEST_CHECK(strided[32] == values[97]);
+    SHAREMIND_TEST_CHECK(strided.end() - strided.begin() == 33);
+    SHAREMIND_TEST_CHECK(*(strided.begin() + 2) == values[7]);
+    strided[1] = 5u;
+    SHAREMIND_TEST_CHECK(values[4] == 5u);
+
+    /* Strided views are serialized in order and read back in place: */
+    BufferMessage msg;
+    strided.serialize(msg);
+    SHAREMIND_TEST_CHECK(msg.buffer.size() == 33u * 4u);
+    std::uint32_t first = 0u;
+    std::memcpy(&first, msg.buffer.data() + 4u, 4u);
+    SHAREMIND_TEST_CHECK(first == 5u);
+
+    std::vector<std::uint32_t> copy(100u, 0u);
+    MutableVmVec<UInt32Type> target(copy);
+    SHAREMIND_TEST_CHECK(target.strided(1u, 33u, 3).deserialize(msg));
+    bool ok = true;
+    for (std::size_t i = 0u; i < 100u; ++i)
+        ok = ok && copy[i] == (i % 3u == 1u ? values[i] : 0u);
+    SHAREMIND_TEST_CHECK(ok);
+    SHAREMIND_TEST_CHECK(!target.strided(0u, 1u, 1).deserialize(msg));
+
+    /* Views longer than the serialization buffer: */
+    std::vector<std::uint32_t> big = testValues(2000u);
+    ImmutableVmVec<UInt32Type> const bigView = immutable(big);
+    BufferMessage bigMsg;
+    bigView.strided(0u, 1000u, 2).serialize(bigMsg);
+    SHAREMIND_TEST_CHECK(bigMsg.writes > 1u && bigMsg.buffer.size() == 4000u);
+    std::uint32_t lastValue = 0u;
+    std::memcpy(&lastValue, bigMsg.buffer.data() + 3996u, 4u);
+    SHAREMIND_TEST_CHECK(lastValue == big[1998]);
+
+    SHAREMIND_TEST_CHECK(vec.strided(100u, 0u, 4).empty());
+}
+
+} /* namespace { */
+
+int main() {
+    testSubspans();
+    testChunks();
+    testStrided();
+    return testResult();
+}